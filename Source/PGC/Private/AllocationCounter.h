@@ -0,0 +1,118 @@
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include "Runtime/Core/Public/HAL/MemoryBase.h"
+
+PRAGMA_DISABLE_OPTIMIZATION
+
+// stands in front of GMalloc, passing everything straight through to the real allocator,
+// and counts each allocation (and reallocation) into whatever ScopedAllocationCounter the allocating thread has going
+//
+// once installed it stays for good, another thread can have read GMalloc just before any attempt to put it back,
+// and would then call into us after we'd gone
+class CountingMalloc : public FMalloc {
+public:
+	static void Install()
+	{
+		// thread-safe, and only ever once
+		static CountingMalloc* installed = []() {
+			auto ret = new CountingMalloc(GMalloc);
+
+			// everything we are made of is visible before anyone can find us through GMalloc
+			FPlatformMisc::MemoryBarrier();
+
+			GMalloc = ret;
+
+			return ret;
+		}();
+
+		(void)installed;
+	}
+
+	// the counter this thread is counting into, if any
+	static int*& ThreadCounter()
+	{
+		static thread_local int* counter = nullptr;
+
+		return counter;
+	}
+
+	virtual void* Malloc(SIZE_T count, uint32 alignment) override
+	{
+		CountOne();
+
+		return Inner->Malloc(count, alignment);
+	}
+
+	virtual void* Realloc(void* original, SIZE_T count, uint32 alignment) override
+	{
+		// a realloc to zero is a free
+		if (count)
+		{
+			CountOne();
+		}
+
+		return Inner->Realloc(original, count, alignment);
+	}
+
+	virtual void Free(void* original) override
+	{
+		Inner->Free(original);
+	}
+
+	virtual bool GetAllocationSize(void* original, SIZE_T& size_out) override
+	{
+		return Inner->GetAllocationSize(original, size_out);
+	}
+
+	virtual SIZE_T QuantizeSize(SIZE_T count, uint32 alignment) override
+	{
+		return Inner->QuantizeSize(count, alignment);
+	}
+
+	virtual const TCHAR* GetDescriptiveName() override { return TEXT("CountingMalloc"); }
+
+private:
+	explicit CountingMalloc(FMalloc* inner) : Inner(inner) {}
+
+	FMalloc* Inner;
+
+	static void CountOne()
+	{
+		if (auto counter = ThreadCounter())
+		{
+			(*counter)++;
+		}
+	}
+};
+
+// counts the heap allocations (and reallocations) made by this thread while it exists
+//
+// only for tests: make one on the stack around the code of interest and look at Count(),
+// other threads' allocations aren't counted, and they can't be nested
+class ScopedAllocationCounter {
+public:
+	ScopedAllocationCounter()
+	{
+		CountingMalloc::Install();
+
+		check(CountingMalloc::ThreadCounter() == nullptr);
+
+		CountingMalloc::ThreadCounter() = &Allocations;
+	}
+
+	~ScopedAllocationCounter()
+	{
+		check(CountingMalloc::ThreadCounter() == &Allocations);
+
+		CountingMalloc::ThreadCounter() = nullptr;
+	}
+
+	int Count() const { return Allocations; }
+
+private:
+	int Allocations = 0;
+};
+
+PRAGMA_ENABLE_OPTIMIZATION
@@ -0,0 +1,255 @@
+#include "CubeChunks.h"
+
+#include "FlatMesh.h"
+
+#include "Runtime/Core/Public/Async/ParallelFor.h"
+
+PRAGMA_DISABLE_OPTIMIZATION
+
+// snaps each position onto the first one seen within "tolerance" of it
+// the grid cells are "tolerance" across and we search the 27 around each point,
+// so nothing within tolerance is missed for being just over a cell boundary
+class PositionWelder {
+public:
+	explicit PositionWelder(float tolerance) : Tolerance(tolerance) {}
+
+	FVector Weld(const FVector& pos)
+	{
+		FIntVector cell{
+			FMath::FloorToInt(pos.X / Tolerance),
+			FMath::FloorToInt(pos.Y / Tolerance),
+			FMath::FloorToInt(pos.Z / Tolerance)
+		};
+
+		for (int x = -1; x <= 1; x++)
+		{
+			for (int y = -1; y <= 1; y++)
+			{
+				for (int z = -1; z <= 1; z++)
+				{
+					auto bucket = Cells.Find(cell + FIntVector(x, y, z));
+
+					if (!bucket)
+						continue;
+
+					for (const auto& seen : *bucket)
+					{
+						if (FVector::DistSquared(seen, pos) <= Tolerance * Tolerance)
+						{
+							return seen;
+						}
+					}
+				}
+			}
+		}
+
+		Cells.FindOrAdd(cell).Push(pos);
+
+		return pos;
+	}
+
+private:
+	float Tolerance;
+	TMap<FIntVector, TArray<FVector, TInlineAllocator<1>>> Cells;
+};
+
+static int FloorDiv(int num, int den)
+{
+	return num >= 0 ? num / den : (num - den + 1) / den;
+}
+
+FIntVector CubeChunks::ChunkOf(const FIntVector& cell) const
+{
+	return FIntVector(FloorDiv(cell.X, ChunkSize), FloorDiv(cell.Y, ChunkSize), FloorDiv(cell.Z, ChunkSize));
+}
+
+void CubeChunks::Subdivide(const TArray<FPGCCube>& cubes, int divisions, Mesh& into, bool parallel)
+{
+	check(into.Faces.Num().AsInt() == 0);
+
+	// which cube is in each cell, the first one wins if there are duplicates, as in Mesh::AddCubes
+	TMap<FIntVector, int> cells;
+	cells.Reserve(cubes.Num());
+
+	TSet<FIntVector> live;
+
+	for (int i = 0; i < cubes.Num(); i++)
+	{
+		FIntVector cell(cubes[i].X, cubes[i].Y, cubes[i].Z);
+
+		if (!cells.Contains(cell))
+		{
+			cells.Add(cell, i);
+			live.Add(ChunkOf(cell));
+		}
+	}
+
+	for (auto it = Chunks.CreateIterator(); it; ++it)
+	{
+		if (!live.Contains(it.Key()))
+		{
+			it.RemoveCurrent();
+		}
+	}
+
+	// in a fixed order, so that the welded result doesn't depend on the order of "cubes"
+	TArray<FIntVector> chunk_keys = live.Array();
+
+	chunk_keys.Sort([](const FIntVector& a, const FIntVector& b) {
+		return a.X != b.X ? a.X < b.X : a.Y != b.Y ? a.Y < b.Y : a.Z < b.Z;
+	});
+
+	TArray<Chunk*> to_build;
+
+	for (const auto& key : chunk_keys)
+	{
+		auto& chunk = Chunks.FindOrAdd(key);
+
+		chunk.Cells.Reset();
+		chunk.HaloCells.Reset();
+
+		FIntVector origin = key * ChunkSize;
+		uint32 hash = 0;
+
+		for (int z = -1; z <= ChunkSize; z++)
+		{
+			for (int y = -1; y <= ChunkSize; y++)
+			{
+				for (int x = -1; x <= ChunkSize; x++)
+				{
+					FIntVector cell = origin + FIntVector(x, y, z);
+
+					auto cube_idx = cells.Find(cell);
+
+					if (!cube_idx)
+						continue;
+
+					bool inside = x >= 0 && x < ChunkSize
+						&& y >= 0 && y < ChunkSize
+						&& z >= 0 && z < ChunkSize;
+
+					(inside ? chunk.Cells : chunk.HaloCells).Push(cell);
+
+					hash = HashCombine(hash, HashCombine(::GetTypeHash(inside), cubes[*cube_idx].GetTypeHash()));
+				}
+			}
+		}
+
+		// anything made from other cubes, or to another level, is no use
+		if (hash != chunk.Hash || divisions != chunk.Divisions)
+		{
+			chunk.Hash = hash;
+			chunk.Divisions = divisions;
+			chunk.Level.Reset();
+		}
+
+		if (!chunk.Level.IsValid())
+		{
+			to_build.Push(&chunk);
+		}
+	}
+
+	LastRebuilt = to_build.Num();
+
+	TArray<TSharedPtr<Patch>> built;
+	built.SetNum(to_build.Num());
+
+	// chunks are independent, so spread them over the threads rather than the levels within each
+	ParallelFor(to_build.Num(), [&](int32 i) {
+		built[i] = BuildPatch(cubes, cells, *to_build[i], divisions, into.CosAutoSharpAngle);
+	}, !parallel);
+
+	for (int i = 0; i < to_build.Num(); i++)
+	{
+		to_build[i]->Level = built[i];
+	}
+
+	// a tenth of the edge length of a unit cube subdivided this far, far more than rounding and far less than any real gap
+	PositionWelder welder(0.1f / (1 << divisions));
+
+	for (const auto& key : chunk_keys)
+	{
+		const auto& chunk = Chunks[key];
+		const auto& patch = *chunk.Level;
+
+		for (int f = 0; f < patch.NumFaces(); f++)
+		{
+			int start = patch.FaceStarts[f];
+			int n = patch.FaceStarts[f + 1] - start;
+
+			TFaceArray<MeshVertRaw> corners;
+
+			for (int j = 0; j < n; j++)
+			{
+				auto corner = patch.Corners[start + j];
+				corner.Pos = welder.Weld(corner.Pos);
+				corners.Push(corner);
+			}
+
+			// renumber the UV group to what AddCubes on the whole set gives the same face
+			int local_group = patch.FaceUVGroups[f];
+			int UVGroup = cells[chunk.Cells[local_group / 6]] * 6 + local_group % 6;
+
+			into.AddFaceFromRawVerts(corners, UVGroup, MakeArrayView(&patch.EdgeTypes[start], n), patch.FaceChannels[f]);
+		}
+	}
+
+	into.NextUVGroup = cubes.Num() * 6;
+}
+
+TSharedPtr<CubeChunks::Patch> CubeChunks::BuildPatch(const TArray<FPGCCube>& cubes, const TMap<FIntVector, int>& cells,
+	const Chunk& chunk, int divisions, float cos_auto_sharp_angle)
+{
+	// our own cubes first, so that their faces get the lowest UV groups
+	TArray<FPGCCube> chunk_cubes;
+	chunk_cubes.Reserve(chunk.Cells.Num() + chunk.HaloCells.Num());
+
+	for (const auto& cell : chunk.Cells)
+	{
+		chunk_cubes.Push(cubes[cells[cell]]);
+	}
+
+	for (const auto& cell : chunk.HaloCells)
+	{
+		chunk_cubes.Push(cubes[cells[cell]]);
+	}
+
+	auto base = MakeShared<Mesh>(cos_auto_sharp_angle);
+
+	base->AddCubes(chunk_cubes);
+	base->PrepareForSharing();
+
+	auto divided = base->SubdivideN(divisions, false);
+
+	FlatMesh flat(*divided);
+
+	int own_groups = chunk.Cells.Num() * 6;
+
+	auto ret = MakeShared<Patch>();
+	ret->FaceStarts.Push(0);
+
+	for (Idx<MeshFace> face_idx{ 0 }; face_idx.AsInt() < flat.NumFaces(); face_idx++)
+	{
+		// descended from a face of the halo
+		if (flat.FaceUVGroups[face_idx.AsInt()] >= own_groups)
+			continue;
+
+		auto verts = flat.FaceVertsOf(face_idx);
+		auto edges = flat.FaceEdgesOf(face_idx);
+		auto uvs = flat.FaceUVsOf(face_idx);
+
+		for (int j = 0; j < verts.Num(); j++)
+		{
+			ret->Corners.Push(MeshVertRaw(flat.Positions[verts[j].AsInt()], uvs[j]));
+			ret->EdgeTypes.Push(flat.EdgeSetTypes[edges[j].AsInt()]);
+		}
+
+		ret->FaceStarts.Push(ret->Corners.Num());
+		ret->FaceUVGroups.Push(flat.FaceUVGroups[face_idx.AsInt()]);
+		ret->FaceChannels.Push(flat.FaceChannels[face_idx.AsInt()]);
+	}
+
+	return ret;
+}
+
+PRAGMA_ENABLE_OPTIMIZATION
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "Mesh.h"
+#include "PGCCube.h"
+
+#include "Runtime/Core/Public/Math/IntVector.h"
+
+PRAGMA_DISABLE_OPTIMIZATION
+
+// subdivides a set of cubes a chunk of cells at a time, and keeps each chunk's result,
+// so that after an edit only the chunks the edit can reach are subdivided again
+//
+// only the result for the last number of divisions asked for is kept, asking for another throws every chunk's away
+//
+// not thread-safe, whoever owns one must make sure only one Subdivide runs on it at a time
+//
+// each chunk is meshed along with a halo of the cells one step outside it, which holds everything
+// (faces, and the cubes whose edge types merge into its edges) that any face of the chunk shares a vert with,
+// and the subdivision of a face at any level depends only on those, so the chunk's own faces come out
+// as they would from subdividing the whole thing, and only those are kept
+//
+// chunks are then welded back together by position, with a tolerance, because the same point on the border
+// of two chunks is summed in a different order in each
+class CubeChunks {
+public:
+	explicit CubeChunks(int chunk_size) : ChunkSize(chunk_size) { check(chunk_size > 0); }
+
+	int GetChunkSize() const { return ChunkSize; }
+
+	// fills the empty "into" with the same as AddCubes followed by SubdivideN(divisions) would give, up to rounding
+	void Subdivide(const TArray<FPGCCube>& cubes, int divisions, Mesh& into, bool parallel);
+
+	// how many chunks the last Subdivide had to build, rather than reuse
+	int NumRebuilt() const { return LastRebuilt; }
+
+private:
+	// a chunk's own faces from one level of subdivision, with UV groups still numbered as in the chunk's mesh
+	struct Patch {
+		TArray<MeshVertRaw> Corners;
+		TArray<PGCEdgeType> EdgeTypes;				///< EdgeTypes[j] is the edge from corner j to the next corner of the same face
+		TArray<int> FaceStarts;
+		TArray<int> FaceUVGroups;
+		TArray<int> FaceChannels;
+
+		int NumFaces() const { return FMath::Max(FaceStarts.Num() - 1, 0); }
+	};
+
+	struct Chunk {
+		uint32 Hash = 0;							///< of the cubes in the chunk and its halo
+		TArray<FIntVector> Cells;					///< the chunk's own cells, the first cubes in its mesh, in this order
+		TArray<FIntVector> HaloCells;
+		int Divisions = -1;							///< what Level was subdivided to
+		TSharedPtr<Patch> Level;
+	};
+
+	int ChunkSize;
+	int LastRebuilt = 0;
+
+	TMap<FIntVector, Chunk> Chunks;
+
+	FIntVector ChunkOf(const FIntVector& cell) const;
+	static TSharedPtr<Patch> BuildPatch(const TArray<FPGCCube>& cubes, const TMap<FIntVector, int>& cells,
+		const Chunk& chunk, int divisions, float cos_auto_sharp_angle);
+};
+
+PRAGMA_ENABLE_OPTIMIZATION
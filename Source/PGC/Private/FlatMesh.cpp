@@ -0,0 +1,337 @@
+#include "FlatMesh.h"
+
+#include "Util.h"
+
+PRAGMA_DISABLE_OPTIMIZATION
+
+FlatMesh::FlatMesh(const Mesh& mesh)
+{
+	auto num_verts = mesh.Vertices.Num().AsInt();
+	auto num_edges = mesh.Edges.Num().AsInt();
+	auto num_faces = mesh.Faces.Num().AsInt();
+
+	// not meant for meshes with removals pending
+	check(mesh.NumDead == 0);
+
+	Positions.Reserve(num_verts);
+	VertEdgeStarts.Reserve(num_verts + 1);
+	VertFaceStarts.Reserve(num_verts + 1);
+	VertFirstUVs.Reserve(num_verts);
+
+	for (Idx<MeshVert> vert_idx{ 0 }; vert_idx < mesh.Vertices.Num(); vert_idx++)
+	{
+		const auto& v = mesh.Vertices[vert_idx];
+
+		Positions.Push(v.Pos);
+
+		auto edge_idxs = mesh.VertEdgesOf(vert_idx);
+		auto face_idxs = mesh.VertFacesOf(vert_idx);
+
+		VertEdgeStarts.Push(VertEdges.Num());
+		VertEdges.Append(edge_idxs.GetData(), edge_idxs.Num());
+
+		VertFaceStarts.Push(VertFaces.Num());
+		VertFaces.Append(face_idxs.GetData(), face_idxs.Num());
+
+		VertFirstUVs.Push(mesh.AnyUV(vert_idx));
+	}
+
+	VertEdgeStarts.Push(VertEdges.Num());
+	VertFaceStarts.Push(VertFaces.Num());
+
+	EdgeStartVerts.Reserve(num_edges);
+	EdgeEndVerts.Reserve(num_edges);
+	EdgeForwardFaces.Reserve(num_edges);
+	EdgeBackwardsFaces.Reserve(num_edges);
+	EdgeSetTypes.Reserve(num_edges);
+	EdgeEffectiveTypes.Reserve(num_edges);
+
+	for (const auto& e : mesh.Edges)
+	{
+		EdgeStartVerts.Push(e.StartVertIdx);
+		EdgeEndVerts.Push(e.EndVertIdx);
+		EdgeForwardFaces.Push(e.ForwardFaceIdx);
+		EdgeBackwardsFaces.Push(e.BackwardsFaceIdx);
+		EdgeSetTypes.Push(e.SetType);
+		EdgeEffectiveTypes.Push(e.EffectiveType);
+	}
+
+	FaceVertStarts.Reserve(num_faces + 1);
+	FaceUVGroups.Reserve(num_faces);
+	FaceChannels.Reserve(num_faces);
+
+	for (Idx<MeshFace> face_idx{ 0 }; face_idx < mesh.Faces.Num(); face_idx++)
+	{
+		const auto& f = mesh.Faces[face_idx];
+		auto start = FaceVerts.Num();
+		auto n = f.VertIdxs.Num();
+
+		FaceVertStarts.Push(start);
+		FaceVerts.Append(f.VertIdxs);
+		FaceEdges.AddDefaulted(n);
+
+		for (int i = 0; i < n; i++)
+		{
+			FaceUVs.Push(mesh.CornerUV(f, i));
+		}
+
+		// the face's EdgeIdxs aren't in any particular order (merging edges reorders them)
+		// but an edge runs forwards round the face it has as its ForwardFace, so we know which vert it leaves
+		for (auto edge_idx : f.EdgeIdxs)
+		{
+			const auto& e = mesh.Edges[edge_idx];
+			auto from_vert_idx = e.ForwardFaceIdx == face_idx ? e.StartVertIdx : e.EndVertIdx;
+
+			auto corner = f.VertIdxs.Find(from_vert_idx);
+			check(corner != INDEX_NONE);
+			check(!FaceEdges[start + corner].Valid());
+
+			FaceEdges[start + corner] = edge_idx;
+		}
+
+		FaceUVGroups.Push(f.UVGroup);
+		FaceChannels.Push(f.Channel);
+	}
+
+	FaceVertStarts.Push(FaceVerts.Num());
+}
+
+int FlatMesh::Corner(Idx<MeshFace> face_idx, Idx<MeshVert> vert_idx) const
+{
+	auto verts = FaceVertsOf(face_idx);
+
+	for (int i = 0; i < verts.Num(); i++)
+	{
+		if (verts[i] == vert_idx)
+			return i;
+	}
+
+	check(false);
+
+	return INDEX_NONE;
+}
+
+FVector FlatMesh::FaceNormal(Idx<MeshFace> face_idx) const
+{
+	TFaceArray<FVector> positions;
+
+	for (auto vert_idx : FaceVertsOf(face_idx))
+	{
+		positions.Push(Positions[vert_idx.AsInt()]);
+	}
+
+	return Util::NewellPolyNormal(TArrayView<const FVector>(positions));
+}
+
+FVector2D FlatMesh::FaceCentreUV(Idx<MeshFace> face_idx) const
+{
+	auto uvs = FaceUVsOf(face_idx);
+
+	FVector2D sum{ 0, 0 };
+
+	for (const auto& uv : uvs)
+	{
+		sum += uv;
+	}
+
+	return sum / uvs.Num();
+}
+
+// the arrays of a FlatMesh or FlatMeshView, in layout order
+template <typename Flat, typename Visitor>
+static void VisitArrays(Flat& flat, Visitor&& visit)
+{
+	visit(flat.Positions);
+	visit(flat.VertEdgeStarts);
+	visit(flat.VertEdges);
+	visit(flat.VertFaceStarts);
+	visit(flat.VertFaces);
+	visit(flat.VertFirstUVs);
+
+	visit(flat.EdgeStartVerts);
+	visit(flat.EdgeEndVerts);
+	visit(flat.EdgeForwardFaces);
+	visit(flat.EdgeBackwardsFaces);
+	visit(flat.EdgeSetTypes);
+	visit(flat.EdgeEffectiveTypes);
+
+	visit(flat.FaceVertStarts);
+	visit(flat.FaceVerts);
+	visit(flat.FaceEdges);
+	visit(flat.FaceUVs);
+	visit(flat.FaceUVGroups);
+	visit(flat.FaceChannels);
+}
+
+// "PGCF" and then the version, the rest is a count and the raw elements for each array,
+// all on LayoutAlignment boundaries so the elements can be used where they lie
+static const uint32 LayoutMagic = 0x46434750;
+static const uint32 LayoutVersion = 1;
+
+static int64 AlignLayout(int64 pos)
+{
+	return (pos + FlatMeshView::LayoutAlignment - 1) & ~(FlatMeshView::LayoutAlignment - 1);
+}
+
+FlatMeshView FlatMesh::View() const
+{
+	FlatMeshView ret;
+
+	ret.Positions = Positions;
+	ret.VertEdgeStarts = VertEdgeStarts;
+	ret.VertEdges = VertEdges;
+	ret.VertFaceStarts = VertFaceStarts;
+	ret.VertFaces = VertFaces;
+	ret.VertFirstUVs = VertFirstUVs;
+
+	ret.EdgeStartVerts = EdgeStartVerts;
+	ret.EdgeEndVerts = EdgeEndVerts;
+	ret.EdgeForwardFaces = EdgeForwardFaces;
+	ret.EdgeBackwardsFaces = EdgeBackwardsFaces;
+	ret.EdgeSetTypes = EdgeSetTypes;
+	ret.EdgeEffectiveTypes = EdgeEffectiveTypes;
+
+	ret.FaceVertStarts = FaceVertStarts;
+	ret.FaceVerts = FaceVerts;
+	ret.FaceEdges = FaceEdges;
+	ret.FaceUVs = FaceUVs;
+	ret.FaceUVGroups = FaceUVGroups;
+	ret.FaceChannels = FaceChannels;
+
+	return ret;
+}
+
+void FlatMesh::WriteLayout(TArray<uint8>& out) const
+{
+	auto pad = [&out]() {
+		out.AddZeroed(AlignLayout(out.Num()) - out.Num());
+	};
+
+	// the start of "out" is aligned, so lay out relative to where we begin
+	check(AlignLayout(out.Num()) == out.Num());
+
+	uint32 header[2] = { LayoutMagic, LayoutVersion };
+	out.Append(reinterpret_cast<const uint8*>(header), sizeof(header));
+	pad();
+
+	VisitArrays(*this, [&out, &pad](const auto& arr) {
+		int64 count = arr.Num();
+
+		out.Append(reinterpret_cast<const uint8*>(&count), sizeof(count));
+		pad();
+
+		out.Append(reinterpret_cast<const uint8*>(arr.GetData()), count * sizeof(arr[0]));
+		pad();
+	});
+}
+
+// each row starts where the last ended or after, from 0, so with the last start checked against the array
+// every row lies inside it
+static bool RowsValid(TArrayView<const int> starts)
+{
+	if (starts[0] != 0)
+		return false;
+
+	for (int i = 1; i < starts.Num(); i++)
+	{
+		if (starts[i] < starts[i - 1])
+			return false;
+	}
+
+	return true;
+}
+
+// every idx names one of "num" elements, or, with "allow_none", none at all
+template <typename T>
+static bool IdxsValid(TArrayView<const Idx<T>> idxs, int num, bool allow_none = false)
+{
+	for (auto idx : idxs)
+	{
+		if (idx.Valid() ? idx.AsInt() < 0 || idx.AsInt() >= num : !allow_none)
+			return false;
+	}
+
+	return true;
+}
+
+static bool EdgeTypesValid(TArrayView<const PGCEdgeType> types)
+{
+	for (auto type : types)
+	{
+		if ((int)type < (int)PGCEdgeType::Rounded || (int)type > (int)PGCEdgeType::Unset)
+			return false;
+	}
+
+	return true;
+}
+
+int64 FlatMeshView::ReadLayout(const uint8* data, int64 size)
+{
+	check(reinterpret_cast<UPTRINT>(data) % LayoutAlignment == 0);
+
+	*this = FlatMeshView();
+
+	if (size < AlignLayout(sizeof(uint32) * 2))
+		return -1;
+
+	const uint32* header = reinterpret_cast<const uint32*>(data);
+
+	if (header[0] != LayoutMagic || header[1] != LayoutVersion)
+		return -1;
+
+	int64 pos = AlignLayout(sizeof(uint32) * 2);
+	bool ok = true;
+
+	VisitArrays(*this, [data, size, &pos, &ok](auto& view) {
+		using Element = typename TRemoveReference<decltype(view[0])>::Type;
+
+		if (!ok || pos + (int64)sizeof(int64) > size)
+		{
+			ok = false;
+			return;
+		}
+
+		int64 count = *reinterpret_cast<const int64*>(data + pos);
+		pos = AlignLayout(pos + sizeof(int64));
+
+		if (count < 0 || count > (size - pos) / (int64)sizeof(Element))
+		{
+			ok = false;
+			return;
+		}
+
+		view = MakeArrayView(reinterpret_cast<Element*>(data + pos), (int32)count);
+		pos = AlignLayout(pos + count * sizeof(Element));
+	});
+
+	// the rows must fit what they index
+	ok = ok
+		&& VertEdgeStarts.Num() == NumVerts() + 1 && VertEdgeStarts[NumVerts()] == VertEdges.Num()
+		&& VertFaceStarts.Num() == NumVerts() + 1 && VertFaceStarts[NumVerts()] == VertFaces.Num()
+		&& FaceVertStarts.Num() == NumFaces() + 1 && FaceVertStarts[NumFaces()] == FaceVerts.Num()
+		&& FaceEdges.Num() == FaceVerts.Num() && FaceUVs.Num() == FaceVerts.Num() && FaceChannels.Num() == NumFaces()
+		&& VertFirstUVs.Num() == NumVerts()
+		&& EdgeEndVerts.Num() == NumEdges() && EdgeSetTypes.Num() == NumEdges() && EdgeEffectiveTypes.Num() == NumEdges()
+		&& EdgeForwardFaces.Num() == NumEdges() && EdgeBackwardsFaces.Num() == NumEdges();
+
+	// and everything must point inside the layout, the bakes index straight into it, so a damaged file
+	// has to be a miss here rather than a read off the end later
+	ok = ok
+		&& RowsValid(VertEdgeStarts) && RowsValid(VertFaceStarts) && RowsValid(FaceVertStarts)
+		&& IdxsValid(VertEdges, NumEdges()) && IdxsValid(VertFaces, NumFaces())
+		&& IdxsValid(EdgeStartVerts, NumVerts()) && IdxsValid(EdgeEndVerts, NumVerts())
+		&& IdxsValid(EdgeForwardFaces, NumFaces(), true) && IdxsValid(EdgeBackwardsFaces, NumFaces(), true)
+		&& IdxsValid(FaceVerts, NumVerts()) && IdxsValid(FaceEdges, NumEdges())
+		&& EdgeTypesValid(EdgeSetTypes) && EdgeTypesValid(EdgeEffectiveTypes);
+
+	if (!ok)
+	{
+		*this = FlatMeshView();
+
+		return -1;
+	}
+
+	return FMath::Min(pos, size);
+}
+
+PRAGMA_ENABLE_OPTIMIZATION
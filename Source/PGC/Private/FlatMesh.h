@@ -0,0 +1,152 @@
+#pragma once
+
+#include "Mesh.h"
+
+#include "Runtime/Core/Public/Containers/ArrayView.h"
+
+PRAGMA_DISABLE_OPTIMIZATION
+
+// a read-only snapshot of a Mesh with everything in flat arrays
+//
+// while a Mesh is being built it needs its per-element arrays (and the searches over them)
+// but passes which just walk a finished mesh (subdivision, edge-type resolution, bake) are much
+// faster over contiguous data than chasing two or three small allocations per element
+//
+// adjacency is stored as compressed sparse rows: the entries for element i are
+// [xxxStarts[i], xxxStarts[i + 1]) in the matching flat array, in the same order as the Mesh has them
+class FlatMeshView;
+
+class FlatMesh {
+public:
+	explicit FlatMesh(const Mesh& mesh);
+
+	FlatMeshView View() const;
+
+	// appends every array to "out" as raw bytes, for FlatMeshView::ReadLayout to point straight into
+	void WriteLayout(TArray<uint8>& out) const;
+
+	// verts
+	TArray<FVector> Positions;
+	TArray<int> VertEdgeStarts;
+	TArray<Idx<MeshEdge>> VertEdges;
+	TArray<int> VertFaceStarts;
+	TArray<Idx<MeshFace>> VertFaces;
+	// the first UV the vert's map has, for debug edges, which don't care which UV they get
+	TArray<FVector2D> VertFirstUVs;
+
+	// edges
+	TArray<Idx<MeshVert>> EdgeStartVerts;
+	TArray<Idx<MeshVert>> EdgeEndVerts;
+	TArray<Idx<MeshFace>> EdgeForwardFaces;
+	TArray<Idx<MeshFace>> EdgeBackwardsFaces;
+	TArray<PGCEdgeType> EdgeSetTypes;
+	TArray<PGCEdgeType> EdgeEffectiveTypes;
+
+	// faces
+	TArray<int> FaceVertStarts;
+	TArray<Idx<MeshVert>> FaceVerts;
+	// lines up with FaceVerts, each is the edge from that vert to the next one round the face
+	TArray<Idx<MeshEdge>> FaceEdges;
+	// also lines up with FaceVerts, the UV of each corner, so a seam is just two faces
+	// giving the same vert different UVs and nothing needs looking up by UVGroup
+	TArray<FVector2D> FaceUVs;
+	TArray<int> FaceUVGroups;
+	TArray<int> FaceChannels;
+
+	int NumVerts() const { return Positions.Num(); }
+	int NumEdges() const { return EdgeStartVerts.Num(); }
+	int NumFaces() const { return FaceUVGroups.Num(); }
+
+	TArrayView<const Idx<MeshEdge>> VertEdgesOf(Idx<MeshVert> vert_idx) const {
+		return Row(VertEdges, VertEdgeStarts, vert_idx.AsInt());
+	}
+
+	TArrayView<const Idx<MeshFace>> VertFacesOf(Idx<MeshVert> vert_idx) const {
+		return Row(VertFaces, VertFaceStarts, vert_idx.AsInt());
+	}
+
+	TArrayView<const Idx<MeshVert>> FaceVertsOf(Idx<MeshFace> face_idx) const {
+		return Row(FaceVerts, FaceVertStarts, face_idx.AsInt());
+	}
+
+	TArrayView<const Idx<MeshEdge>> FaceEdgesOf(Idx<MeshFace> face_idx) const {
+		return Row(FaceEdges, FaceVertStarts, face_idx.AsInt());
+	}
+
+	TArrayView<const FVector2D> FaceUVsOf(Idx<MeshFace> face_idx) const {
+		return Row(FaceUVs, FaceVertStarts, face_idx.AsInt());
+	}
+
+	// which corner of the face the vert is
+	int Corner(Idx<MeshFace> face_idx, Idx<MeshVert> vert_idx) const;
+
+	// Util::NewellPolyNormal of the face's corners
+	FVector FaceNormal(Idx<MeshFace> face_idx) const;
+
+	// average of the face's corner UVs
+	FVector2D FaceCentreUV(Idx<MeshFace> face_idx) const;
+
+private:
+	template <typename T>
+	static TArrayView<const T> Row(const TArray<T>& data, const TArray<int>& starts, int i)
+	{
+		return MakeArrayView(data.GetData() + starts[i], starts[i + 1] - starts[i]);
+	}
+};
+
+// the same arrays as a FlatMesh, without owning them, so that passes which only read (bake) can run over a FlatMesh
+// or straight over bytes laid out by FlatMesh::WriteLayout, such as a cache file mapped into memory
+class FlatMeshView {
+public:
+	// verts
+	TArrayView<const FVector> Positions;
+	TArrayView<const int> VertEdgeStarts;
+	TArrayView<const Idx<MeshEdge>> VertEdges;
+	TArrayView<const int> VertFaceStarts;
+	TArrayView<const Idx<MeshFace>> VertFaces;
+	TArrayView<const FVector2D> VertFirstUVs;
+
+	// edges
+	TArrayView<const Idx<MeshVert>> EdgeStartVerts;
+	TArrayView<const Idx<MeshVert>> EdgeEndVerts;
+	TArrayView<const Idx<MeshFace>> EdgeForwardFaces;
+	TArrayView<const Idx<MeshFace>> EdgeBackwardsFaces;
+	TArrayView<const PGCEdgeType> EdgeSetTypes;
+	TArrayView<const PGCEdgeType> EdgeEffectiveTypes;
+
+	// faces
+	TArrayView<const int> FaceVertStarts;
+	TArrayView<const Idx<MeshVert>> FaceVerts;
+	TArrayView<const Idx<MeshEdge>> FaceEdges;
+	TArrayView<const FVector2D> FaceUVs;
+	TArrayView<const int> FaceUVGroups;
+	TArrayView<const int> FaceChannels;
+
+	// each array in the layout starts on this, so "data" given to ReadLayout must too
+	static const int64 LayoutAlignment = 16;
+
+	int NumVerts() const { return Positions.Num(); }
+	int NumEdges() const { return EdgeStartVerts.Num(); }
+	int NumFaces() const { return FaceUVGroups.Num(); }
+
+	TArrayView<const Idx<MeshVert>> FaceVertsOf(Idx<MeshFace> face_idx) const {
+		return Row(FaceVerts, FaceVertStarts, face_idx.AsInt());
+	}
+
+	TArrayView<const FVector2D> FaceUVsOf(Idx<MeshFace> face_idx) const {
+		return Row(FaceUVs, FaceVertStarts, face_idx.AsInt());
+	}
+
+	// points the view into "data", which must outlive it, and returns how many bytes of "size" the layout took,
+	// or -1 (leaving the view empty) if it isn't a whole layout
+	int64 ReadLayout(const uint8* data, int64 size);
+
+private:
+	template <typename T>
+	static TArrayView<const T> Row(TArrayView<const T> data, TArrayView<const int> starts, int i)
+	{
+		return MakeArrayView(data.GetData() + starts[i], starts[i + 1] - starts[i]);
+	}
+};
+
+PRAGMA_ENABLE_OPTIMIZATION
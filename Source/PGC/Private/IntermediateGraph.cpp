@@ -122,6 +122,22 @@ void IGraph<NM, GM>::Serialize(FArchive& Ar)
 	}
 }
 
+template<typename NM, typename GM>
+SIZE_T IGraph<NM, GM>::GetAllocatedSize() const
+{
+	auto ret = Nodes.GetAllocatedSize() + Edges.GetAllocatedSize() + MD.GetAllocatedSize();
+
+	// each node and edge is an allocation of its own
+	for (const auto& n : Nodes)
+	{
+		ret += sizeof(INode) + n->Edges.GetAllocatedSize();
+	}
+
+	ret += Edges.Num() * sizeof(IEdge);
+
+	return ret;
+}
+
 template<typename NM>
 IEdge<NM>::IEdge(const TWeakPtr<INode>& fromNode, const TWeakPtr<INode>& toNode, double d0)
 	: FromNode(fromNode), ToNode(toNode), D0(d0) {
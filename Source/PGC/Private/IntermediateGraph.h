@@ -95,6 +95,9 @@ namespace IntermediateGraph {
 		int FindNodeIdx(const TWeakPtr<INode>& node) const;
 
 		void Serialize(FArchive& Ar);
+
+		// the heap we hold, nodes and edges included, not counting sizeof(IGraph), GM must have a GetAllocatedSize too
+		SIZE_T GetAllocatedSize() const;
 	};
 
 	template<typename NM>
@@ -3,8 +3,18 @@
 #include "Mesh.h"
 
 #include "PGCCube.h"
+#include "FlatMesh.h"
+#include "QuadMesh.h"
+#include "SubdivisionStencils.h"
+#include "CubeChunks.h"
+#include "AllocationCounter.h"
 
 #include "Runtime/Core/Public/Templates/UniquePtr.h"
+#include "Runtime/Core/Public/Math/IntVector.h"
+#include "Runtime/Core/Public/Algo/Reverse.h"
+#include "Runtime/Core/Public/Serialization/BufferArchive.h"
+#include "Runtime/Core/Public/Serialization/MemoryReader.h"
+#include "Runtime/Core/Public/Async/ParallelFor.h"
 #include "Runtime/Engine/Classes/Engine/World.h"
 #include "Util.h"
 
@@ -15,13 +25,18 @@ const Idx<T> Idx<T>::None{ -1 };
 
 Idx<MeshEdge> Mesh::FindEdge(Idx<MeshVert> vert_idx1, Idx<MeshVert> vert_idx2, Idx<MeshFace> face_idx) const
 {
-	for (Idx<MeshEdge> i{ 0 }; i < Edges.Num(); i++)
-	{
-		auto& edge = Edges[i];
+	auto bucket = EdgeLookup.Find(HashIdxPair(vert_idx1, vert_idx2));
 
-		if (edge.Contains(vert_idx1) && edge.Contains(vert_idx2) && edge.Contains(face_idx))
+	if (bucket)
+	{
+		for (auto i : *bucket)
 		{
-			return i;
+			auto& edge = Edges[i];
+
+			if (edge.Contains(vert_idx1) && edge.Contains(vert_idx2) && edge.Contains(face_idx))
+			{
+				return i;
+			}
 		}
 	}
 
@@ -32,13 +47,18 @@ TArray<Idx<MeshEdge>> Mesh::FindAllEdges(Idx<MeshVert> vert_idx1, Idx<MeshVert>
 {
 	TArray<Idx<MeshEdge>> ret;
 
-	for (Idx<MeshEdge> i{ 0 }; i < Edges.Num(); i++)
-	{
-		auto& edge = Edges[i];
+	auto bucket = EdgeLookup.Find(HashIdxPair(vert_idx1, vert_idx2));
 
-		if (edge.Contains(vert_idx1) && edge.Contains(vert_idx2))
+	if (bucket)
+	{
+		for (auto i : *bucket)
 		{
-			ret.Push(i);
+			auto& edge = Edges[i];
+
+			if (edge.Contains(vert_idx1) && edge.Contains(vert_idx2))
+			{
+				ret.Push(i);
+			}
 		}
 	}
 
@@ -47,13 +67,18 @@ TArray<Idx<MeshEdge>> Mesh::FindAllEdges(Idx<MeshVert> vert_idx1, Idx<MeshVert>
 
 Idx<MeshEdge> Mesh::FindEdge(Idx<MeshVert> vert_idx1, Idx<MeshVert> vert_idx2, bool partial_only) const
 {
-	for (Idx<MeshEdge> i{ 0 }; i < Edges.Num(); i++)
-	{
-		auto& edge = Edges[i];
+	auto bucket = EdgeLookup.Find(HashIdxPair(vert_idx1, vert_idx2));
 
-		if (edge.Contains(vert_idx1) && edge.Contains(vert_idx2) && (!partial_only || edge.Contains(Idx<MeshFace>::None)))
+	if (bucket)
+	{
+		for (auto i : *bucket)
 		{
-			return i;
+			auto& edge = Edges[i];
+
+			if (edge.Contains(vert_idx1) && edge.Contains(vert_idx2) && (!partial_only || edge.Contains(Idx<MeshFace>::None)))
+			{
+				return i;
+			}
 		}
 	}
 
@@ -62,6 +87,8 @@ Idx<MeshEdge> Mesh::FindEdge(Idx<MeshVert> vert_idx1, Idx<MeshVert> vert_idx2, b
 
 Idx<MeshEdge> Mesh::AddFindEdge(Idx<MeshVert> idx1, Idx<MeshVert> idx2)
 {
+	UnpackAdjacency();
+
 	// do we ever need to propagate the "partial_only" parameter of FindEdge up to the caller?  Not yet...
 	auto edge_idx = FindEdge(idx1, idx2, true);
 
@@ -73,22 +100,30 @@ Idx<MeshEdge> Mesh::AddFindEdge(Idx<MeshVert> idx1, Idx<MeshVert> idx2)
 	MeshEdge ne{ ne.StartVertIdx = idx1, ne.EndVertIdx = idx2 };
 
 	Edges.Push(ne);
+	EdgeLookup.Add(HashIdxPair(idx1, idx2), Edges.LastIdx());
 
 	Vertices[idx1].EdgeIdxs.Push(Idx<MeshEdge>(Edges.LastIdx()));
 	Vertices[idx2].EdgeIdxs.Push(Idx<MeshEdge>(Edges.LastIdx()));
 
+	TouchEdge(Edges.LastIdx());
+	TouchVert(idx1);
+	TouchVert(idx2);
+
 	return Edges.LastIdx();
 }
 
 Idx<MeshVert> Mesh::FindVert(const FVector& pos) const
 {
-	for (Idx<MeshVert> i{ 0 }; i < Vertices.Num(); i++)
-	{
-		auto& vert = Vertices[i];
+	auto bucket = VertLookup.Find(HashPosition(pos));
 
-		if (vert.Pos == pos)
+	if (bucket)
+	{
+		for (auto i : *bucket)
 		{
-			return i;
+			if (Vertices[i].Pos == pos)
+			{
+				return i;
+			}
 		}
 	}
 
@@ -97,95 +132,352 @@ Idx<MeshVert> Mesh::FindVert(const FVector& pos) const
 
 Idx<MeshVert> Mesh::FindVert(const FVector& pos, int UVGroup) const
 {
-	for (Idx<MeshVert> i{ 0 }; i < Vertices.Num(); i++)
-	{
-		auto& vert = Vertices[i];
+	auto bucket = VertLookup.Find(HashPosition(pos));
 
-		// did have tolerance here, but it makes things worse with near-zero sizes triangles as they develop duplicate verts
-		// which crashes other logic
-		if (vert.UVs.Contains(UVGroup) && vert.Pos == pos)
+	if (bucket)
+	{
+		for (auto i : *bucket)
 		{
-			return i;
+			auto& vert = Vertices[i];
+
+			// did have tolerance here, but it makes things worse with near-zero sizes triangles as they develop duplicate verts
+			// which crashes other logic
+			if (vert.UVs.Contains(UVGroup) && vert.Pos == pos)
+			{
+				return i;
+			}
 		}
 	}
 
 	return Idx<MeshVert>::None;
 }
 
-// a closed mesh has no holes, an unclosed on may have faces not added yet...
-void Mesh::CheckConsistent(bool closed)
+FVector2D Mesh::CornerUV(const MeshFace& face, int corner) const
+{
+	if (UVsInCorners)
+		return face.CornerUVs[corner];
+
+	return Vertices[face.VertIdxs[corner]].UVs[face.UVGroup];
+}
+
+FVector2D Mesh::AnyUV(Idx<MeshVert> vert_idx) const
+{
+	auto face_idxs = VertFacesOf(vert_idx);
+
+	if (!UVsInCorners || face_idxs.Num() == 0)
+		return Vertices[vert_idx].ToMeshVertRaw(-1).UV;
+
+	// the map would have had this one first
+	const auto& face = Faces[face_idxs[0]];
+
+	return face.CornerUVs[face.VertIdxs.Find(vert_idx)];
+}
+
+MeshMultiUV Mesh::CornerUVsOf(Idx<MeshVert> vert_idx) const
+{
+	check(UVsInCorners);
+
+	MeshMultiUV ret;
+
+	for (auto face_idx : VertFacesOf(vert_idx))
+	{
+		const auto& face = Faces[face_idx];
+
+		if (!ret.Contains(face.UVGroup))
+		{
+			auto corner = face.VertIdxs.Find(vert_idx);
+			check(corner != INDEX_NONE);
+
+			ret.Add(face.UVGroup) = face.CornerUVs[corner];
+		}
+	}
+
+	return ret;
+}
+
+void Mesh::MoveCornerUVsToVerts()
 {
-	for (Idx<MeshEdge> edge_idx{ 0 }; edge_idx < Edges.Num(); edge_idx++)
+	if (!UVsInCorners)
+		return;
+
+	for (Idx<MeshVert> vert_idx{ 0 }; vert_idx < Vertices.Num(); vert_idx++)
 	{
-		auto e = Edges[edge_idx];
+		if (!Vertices[vert_idx].Dead)
+		{
+			Vertices[vert_idx].UVs = CornerUVsOf(vert_idx);
+		}
+	}
 
-		check(e.StartVertIdx.Valid() && e.StartVertIdx < Vertices.Num());
-		check(e.EndVertIdx.Valid() && e.EndVertIdx < Vertices.Num());
-		check(e.ForwardFaceIdx < Faces.Num());
-		check(e.BackwardsFaceIdx < Faces.Num());
-		// we should have both edges if we're closed
-		// (redundant edges should have been removed...)
-		check(!closed || e.ForwardFaceIdx.Valid());
-		check(!closed || e.BackwardsFaceIdx.Valid());
-		check(Vertices[e.StartVertIdx].EdgeIdxs.Contains(edge_idx));
-		check(Vertices[e.EndVertIdx].EdgeIdxs.Contains(edge_idx));
-		check(!e.ForwardFaceIdx.Valid() || Faces[e.ForwardFaceIdx].EdgeIdxs.Contains(edge_idx));
-		check(!e.BackwardsFaceIdx.Valid() || Faces[e.BackwardsFaceIdx].EdgeIdxs.Contains(edge_idx));
+	for (auto& face : Faces)
+	{
+		face.CornerUVs.Empty();
 	}
 
+	UVsInCorners = false;
+}
+
+void Mesh::UnpackAdjacency()
+{
+	if (!AdjacencyPacked)
+		return;
+
 	for (Idx<MeshVert> vert_idx{ 0 }; vert_idx < Vertices.Num(); vert_idx++)
 	{
-		auto v = Vertices[vert_idx];
+		auto& v = Vertices[vert_idx];
+		auto edge_idxs = VertEdgesOf(vert_idx);
+		auto face_idxs = VertFacesOf(vert_idx);
+
+		v.EdgeIdxs.Append(edge_idxs.GetData(), edge_idxs.Num());
+		v.FaceIdxs.Append(face_idxs.GetData(), face_idxs.Num());
+	}
+
+	AdjacencyPacked = false;
+
+	PackedVertEdgeStarts.Empty();
+	PackedVertEdges.Empty();
+	PackedVertFaceStarts.Empty();
+	PackedVertFaces.Empty();
+}
+
+void Mesh::PackAdjacency()
+{
+	if (AdjacencyPacked)
+		return;
+
+	int num_edge_idxs = 0;
+	int num_face_idxs = 0;
+
+	for (const auto& v : Vertices)
+	{
+		num_edge_idxs += v.EdgeIdxs.Num();
+		num_face_idxs += v.FaceIdxs.Num();
+	}
+
+	PackedVertEdgeStarts.Reset(Vertices.Num().AsInt() + 1);
+	PackedVertEdges.Reset(num_edge_idxs);
+	PackedVertFaceStarts.Reset(Vertices.Num().AsInt() + 1);
+	PackedVertFaces.Reset(num_face_idxs);
+
+	for (auto& v : Vertices)
+	{
+		PackedVertEdgeStarts.Push(PackedVertEdges.Num());
+		PackedVertEdges.Append(v.EdgeIdxs);
+		PackedVertFaceStarts.Push(PackedVertFaces.Num());
+		PackedVertFaces.Append(v.FaceIdxs);
+
+		v.EdgeIdxs.Empty();
+		v.FaceIdxs.Empty();
+	}
+
+	PackedVertEdgeStarts.Push(PackedVertEdges.Num());
+	PackedVertFaceStarts.Push(PackedVertFaces.Num());
+
+	AdjacencyPacked = true;
+}
+
+void Mesh::RebuildLookups()
+{
+	TouchAll();
+
+	VertLookup.Empty();
+	EdgeLookup.Empty();
+	FaceLookup.Empty();
+
+	for (Idx<MeshVert> i{ 0 }; i < Vertices.Num(); i++)
+	{
+		VertLookup.Add(HashPosition(Vertices[i].Pos), i);
+	}
+
+	for (Idx<MeshEdge> i{ 0 }; i < Edges.Num(); i++)
+	{
+		EdgeLookup.Add(HashIdxPair(Edges[i].StartVertIdx, Edges[i].EndVertIdx), i);
+	}
+
+	for (Idx<MeshFace> i{ 0 }; i < Faces.Num(); i++)
+	{
+		FaceLookup.Add(HashIdxSequence(Faces[i].VertIdxs), i);
+	}
+}
+
+void Mesh::CheckConsistentInner(bool closed)
+{
+	bool full = MeshValidationLevel != MeshValidation::Cheap;
+
+	if (MeshValidationLevel == MeshValidation::Incremental && !TouchedAll)
+	{
+		for (auto edge_idx : TouchedEdges)
+		{
+			CheckEdge(edge_idx, closed, true);
+		}
+
+		for (auto vert_idx : TouchedVerts)
+		{
+			CheckVert(vert_idx, closed, true);
+		}
 
-		// we expect one-to-one for edges and faces (true for closed meshes...)
-		check(!closed || v.FaceIdxs.Num() == v.EdgeIdxs.Num());
+		for (auto face_idx : TouchedFaces)
+		{
+			CheckFace(face_idx, true);
+		}
+	}
+	else
+	{
+		for (Idx<MeshEdge> edge_idx{ 0 }; edge_idx < Edges.Num(); edge_idx++)
+		{
+			CheckEdge(edge_idx, closed, full);
+		}
 
-		// if we know about an edge, it should know about us
-		for (auto edge_idx : v.EdgeIdxs)
+		for (Idx<MeshVert> vert_idx{ 0 }; vert_idx < Vertices.Num(); vert_idx++)
 		{
-			check(Edges[edge_idx].Contains(vert_idx));
+			CheckVert(vert_idx, closed, full);
 		}
 
-		// if we know about a face, it should know about us
-		for (auto face_idx : v.FaceIdxs)
+		for (Idx<MeshFace> face_idx{ 0 }; face_idx < Faces.Num(); face_idx++)
 		{
-			check(Faces[face_idx].VertIdxs.Contains(vert_idx));
+			CheckFace(face_idx, full);
 		}
 	}
 
-	for (Idx<MeshFace> face_idx{ 0 }; face_idx < Faces.Num(); face_idx++)
+	// unclosed checks come part way through building something, so hang on to everything touched
+	// until the closed check at the end, which can then see that none of it was left open
+	// (and when nothing was, we're only read, as a mesh shared between threads can be checked from any of them)
+	if (closed && (TouchedAll || TouchedVerts.Num() || TouchedEdges.Num() || TouchedFaces.Num()))
 	{
-		auto& face = Faces[face_idx];
+		ResetTouched();
+	}
+}
 
-		check(face.VertsAreRegular());
+void Mesh::CheckEdge(Idx<MeshEdge> edge_idx, bool closed, bool full) const
+{
+	const auto& e = Edges[edge_idx];
 
-		auto prev_vert_idx = face.VertIdxs.Last();
+	// dead elements are unreferenced and can be ignored, their contents are stale
+	if (e.Dead)
+		return;
 
-		for (auto vert_idx : face.VertIdxs)
-		{
-			check(vert_idx.Valid() && vert_idx < Vertices.Num());
+	check(e.StartVertIdx.Valid() && e.StartVertIdx < Vertices.Num());
+	check(e.EndVertIdx.Valid() && e.EndVertIdx < Vertices.Num());
+	check(e.ForwardFaceIdx < Faces.Num());
+	check(e.BackwardsFaceIdx < Faces.Num());
+	// we should have both edges if we're closed
+	// (redundant edges should have been removed...)
+	check(!closed || e.ForwardFaceIdx.Valid());
+	check(!closed || e.BackwardsFaceIdx.Valid());
+	check(!Vertices[e.StartVertIdx].Dead && !Vertices[e.EndVertIdx].Dead);
+	check(!e.ForwardFaceIdx.Valid() || !Faces[e.ForwardFaceIdx].Dead);
+	check(!e.BackwardsFaceIdx.Valid() || !Faces[e.BackwardsFaceIdx].Dead);
+
+	if (!full)
+		return;
 
-			auto edge_idx = FindEdge(prev_vert_idx, vert_idx, face_idx);
-			check(edge_idx != Idx<MeshEdge>::None);
+	check(VertEdgesOf(e.StartVertIdx).Contains(edge_idx));
+	check(VertEdgesOf(e.EndVertIdx).Contains(edge_idx));
+	check(!e.ForwardFaceIdx.Valid() || Faces[e.ForwardFaceIdx].EdgeIdxs.Contains(edge_idx));
+	check(!e.BackwardsFaceIdx.Valid() || Faces[e.BackwardsFaceIdx].EdgeIdxs.Contains(edge_idx));
 
-			auto& edge = Edges[edge_idx];
+	auto bucket = EdgeLookup.Find(HashIdxPair(e.StartVertIdx, e.EndVertIdx));
+	check(bucket && bucket->Contains(edge_idx));
+}
 
-			// should have us as a face on one or the other side
-			check(edge.Contains(face_idx));
+void Mesh::CheckVert(Idx<MeshVert> vert_idx, bool closed, bool full) const
+{
+	const auto& v = Vertices[vert_idx];
+
+	if (v.Dead)
+		return;
 
-			// if the edge starts with our previous vert, then we are the forward face of this edge,
-			// otherwise we are its backwards face
-			check((edge.StartVertIdx == prev_vert_idx) == (edge.ForwardFaceIdx == face_idx));
-			check((edge.EndVertIdx == prev_vert_idx) == (edge.BackwardsFaceIdx == face_idx));
+	auto edge_idxs = VertEdgesOf(vert_idx);
+	auto face_idxs = VertFacesOf(vert_idx);
 
-			auto v = Vertices[vert_idx];
+	// packed, the verts' own arrays aren't used
+	check(!AdjacencyPacked || (v.EdgeIdxs.Num() == 0 && v.FaceIdxs.Num() == 0));
 
-			check(v.FaceIdxs.Contains(face_idx));
+	// we expect one-to-one for edges and faces (true for closed meshes...)
+	check(!closed || face_idxs.Num() == edge_idxs.Num());
 
-			prev_vert_idx = vert_idx;
-		}
+	for (auto edge_idx : edge_idxs)
+	{
+		check(edge_idx.Valid() && edge_idx < Edges.Num());
+		check(!Edges[edge_idx].Dead);
+	}
+
+	for (auto face_idx : face_idxs)
+	{
+		check(face_idx.Valid() && face_idx < Faces.Num());
+		check(!Faces[face_idx].Dead);
+	}
+
+	if (!full)
+		return;
+
+	// lookups must be able to find us
+	auto bucket = VertLookup.Find(HashPosition(v.Pos));
+	check(bucket && bucket->Contains(vert_idx));
+
+	// if we know about an edge, it should know about us
+	for (auto edge_idx : edge_idxs)
+	{
+		check(Edges[edge_idx].Contains(vert_idx));
+	}
+
+	// if we know about a face, it should know about us
+	for (auto face_idx : face_idxs)
+	{
+		check(Faces[face_idx].VertIdxs.Contains(vert_idx));
+	}
+}
+
+void Mesh::CheckFace(Idx<MeshFace> face_idx, bool full) const
+{
+	const auto& face = Faces[face_idx];
+
+	if (face.Dead)
+		return;
+
+	check(face.VertIdxs.Num() == face.EdgeIdxs.Num());
+	check(face.CornerUVs.Num() == (UVsInCorners ? face.VertIdxs.Num() : 0));
+
+	for (auto vert_idx : face.VertIdxs)
+	{
+		check(vert_idx.Valid() && vert_idx < Vertices.Num());
+		check(!Vertices[vert_idx].Dead);
+	}
+
+	for (auto edge_idx : face.EdgeIdxs)
+	{
+		check(edge_idx.Valid() && edge_idx < Edges.Num());
+		check(!Edges[edge_idx].Dead);
 	}
 
+	if (!full)
+		return;
+
+	check(face.VertsAreRegular());
+
+	auto bucket = FaceLookup.Find(HashIdxSequence(face.VertIdxs));
+	check(bucket && bucket->Contains(face_idx));
+
+	auto prev_vert_idx = face.VertIdxs.Last();
+
+	for (auto vert_idx : face.VertIdxs)
+	{
+		auto edge_idx = FindEdge(prev_vert_idx, vert_idx, face_idx);
+		check(edge_idx != Idx<MeshEdge>::None);
+
+		auto& edge = Edges[edge_idx];
+
+		// should have us as a face on one or the other side
+		check(edge.Contains(face_idx));
+
+		// if the edge starts with our previous vert, then we are the forward face of this edge,
+		// otherwise we are its backwards face
+		check((edge.StartVertIdx == prev_vert_idx) == (edge.ForwardFaceIdx == face_idx));
+		check((edge.EndVertIdx == prev_vert_idx) == (edge.BackwardsFaceIdx == face_idx));
+
+		check(VertFacesOf(vert_idx).Contains(face_idx));
+
+		prev_vert_idx = vert_idx;
+	}
 }
 
 #ifndef UE_BUILD_RELEASE
@@ -313,6 +605,8 @@ static void TestOne(const TArray<FVector>& config, int x_from, int y_from, int z
 		mesh->AddCube(FPGCCube(cell[x_from] * neg, cell[y_from] * neg, cell[z_from] * neg));
 	}
 
+	mesh->PrepareForSharing();
+
 	auto div1 = mesh->Subdivide();
 	auto div2 = div1->Subdivide();
 }
@@ -339,201 +633,1124 @@ void Mesh::UnitTest()
 		check(count_sharp == 1);
 	}
 
-	for(auto config : working_configs)
+	// finding a face we already have mustn't touch the heap
 	{
-		TestOne(config, 0, 1, 2, false);
-		TestOne(config, 0, 2, 1, false);
-		TestOne(config, 1, 0, 2, false);
-		TestOne(config, 1, 2, 0, false);
-		TestOne(config, 2, 0, 1, false);
-		TestOne(config, 2, 1, 0, false);
+		Mesh mesh(FMath::Cos(FMath::DegreesToRadians(20.0f)));
 
-		TestOne(config, 0, 2, 1, true);
-		TestOne(config, 0, 1, 2, true);
-		TestOne(config, 1, 0, 2, true);
-		TestOne(config, 1, 2, 0, true);
-		TestOne(config, 2, 0, 1, true);
-		TestOne(config, 2, 1, 0, true);
-	}
-}
+		TArray<FVector> verts{ { 0, 0, 0 }, { 1, 0, 0 }, { 1, 1, 0 }, { 0, 1, 0 } };
+		TArray<FVector2D> uvs{ { 0, 0 }, { 1, 0 }, { 1, 1 }, { 0, 1 } };
+		TArray<PGCEdgeType> edge_types{ PGCEdgeType::Sharp, PGCEdgeType::Sharp, PGCEdgeType::Sharp, PGCEdgeType::Sharp };
 
-#endif
+		auto face_idx = mesh.AddFaceFromVects(verts, uvs, 0, edge_types, 0);
 
-Idx<MeshVert> Mesh::AddVert(MeshVertRaw vert, int UVGRoup)
-{
-	auto vert_idx = FindVert(vert.Pos, UVGRoup);
+		ScopedAllocationCounter counter;
 
-	// we have it with this UV already set
-	if (vert_idx.Valid())
-		return vert_idx;
+		auto found_face_idx = mesh.AddFaceFromVects(verts, uvs, 0, edge_types, 0);
 
-	// do we have it without the UV?
-	vert_idx = FindVert(vert.Pos);
+		check(found_face_idx == face_idx);
+		check(counter.Count() == 0);
+	}
 
-	if (!vert_idx.Valid())
+	// and a new face only allocates what it keeps, not any temporaries per corner, here the last face of a cube,
+	// whose verts and edges are all there already: its own VertIdxs and EdgeIdxs, at most one growth of each corner's FaceIdxs,
+	// and at most two each (elements and hash) for its entries in FaceLookup and TouchedFaces
 	{
-		// no, add it
-		vert_idx = Vertices.Num();
-		MeshVert mv;
-		mv.Pos = vert.Pos;
-		Vertices.Push(mv);
-	}
+		Mesh mesh(FMath::Cos(FMath::DegreesToRadians(20.0f)));
 
-	// set the UV into it
-	Vertices[vert_idx].UVs.Add(UVGRoup) = vert.UV;
+		FVector corners[8];
 
-	return vert_idx;
-}
+		for (int i = 0; i < 8; i++)
+		{
+			corners[i] = FVector(i & 1, (i >> 1) & 1, (i >> 2) & 1);
+		}
 
-Idx<MeshVert> Mesh::AddVert(FVector pos)
-{
-	auto vert_idx = FindVert(pos);
+		const int faces[6][4]{ { 0, 2, 3, 1 }, { 4, 5, 7, 6 }, { 0, 1, 5, 4 }, { 2, 6, 7, 3 }, { 0, 4, 6, 2 }, { 1, 3, 7, 5 } };
 
-	// we have it with this UV already set
-	if (vert_idx.Valid())
-		return vert_idx;
+		TArray<FVector2D> uvs{ { 0, 0 }, { 1, 0 }, { 1, 1 }, { 0, 1 } };
+		TArray<PGCEdgeType> edge_types{ PGCEdgeType::Sharp, PGCEdgeType::Sharp, PGCEdgeType::Sharp, PGCEdgeType::Sharp };
 
-	MeshVert mv;
-	mv.Pos = pos;
-	Vertices.Push(mv);
+		for (int f = 0; f < 6; f++)
+		{
+			TArray<FVector> verts;
 
-	return Vertices.LastIdx();
-}
+			for (int corner : faces[f])
+			{
+				verts.Push(corners[corner]);
+			}
 
-Idx<MeshFace> Mesh::FindFaceByVertIdxs(const TArray<Idx<MeshVert>>& vert_idxs) const
-{
-	for (Idx<MeshFace> face_idx{ 0 }; face_idx < Faces.Num(); face_idx++)
-	{
-		auto mf = Faces[face_idx];
+			int count;
 
-		if (mf.VertIdxs == vert_idxs)
-		{
-			return face_idx;
-		}
-	}
+			{
+				ScopedAllocationCounter counter;
 
-	return Idx<MeshFace>::None;
-}
+				check(mesh.AddFaceFromVects(verts, uvs, 0, edge_types, 0).Valid());
 
-void Mesh::RemoveFace(Idx<MeshFace> face_idx)
-{
-	for (auto& v : Vertices)
-	{
-		v.FaceIdxs.Remove(face_idx);
+				count = counter.Count();
+			}
 
-		for(auto& idx : v.FaceIdxs)
-		{
-			if (idx > face_idx)
+			if (f == 5)
 			{
-				idx--;
+				check(count <= 2 + 4 + 2 + 2);
 			}
 		}
+
+		mesh.CheckConsistent(true);
 	}
 
-	for (auto& e : Edges)
+	// a vert with no UVs yet (as AddVert(FVector) makes) mustn't stop us being walked
 	{
-		if (e.ForwardFaceIdx == face_idx)
-		{
-			e.ForwardFaceIdx = Idx<MeshFace>::None;
-		}
-		else if (e.ForwardFaceIdx > face_idx)
-		{
-			e.ForwardFaceIdx--;
-		}
+		Mesh mesh(FMath::Cos(FMath::DegreesToRadians(20.0f)));
 
-		if (e.BackwardsFaceIdx== face_idx)
-		{
-			e.BackwardsFaceIdx = Idx<MeshFace>::None;
-		}
-		else if (e.BackwardsFaceIdx > face_idx)
-		{
-			e.BackwardsFaceIdx--;
-		}
-	}
+		mesh.AddVert(FVector(0, 0, 0));
 
-	Faces.RemoveAt(face_idx);
+		FlatMesh flat(mesh);
 
-	MergePartialEdges();
+		check(flat.VertFirstUVs[0] == FVector2D::ZeroVector);
+	}
 
-	CleanUpRedundantEdges();
-}
+	// a finished mesh keeps its verts' edges and faces packed, which nothing outside can see: editing it afterwards
+	// unpacks it to what it would have been, and loading gives a packed mesh that saves the same as it was saved
+	{
+		auto edited = MakeShared<Mesh>(FMath::Cos(FMath::DegreesToRadians(20.0f)));
+		auto direct = MakeShared<Mesh>(FMath::Cos(FMath::DegreesToRadians(20.0f)));
 
-void Mesh::RemoveEdge(Idx<MeshEdge> edge_idx)
-{
-	auto e = Edges[edge_idx];
+		edited->AddCube(FPGCCube());
+		edited->PrepareForSharing();
 
-	check(!e.ForwardFaceIdx.Valid() && !e.BackwardsFaceIdx.Valid());
+		check(edited->AdjacencyPacked);
 
-	for (auto& v : Vertices)
+		for (const auto& v : edited->Vertices)
+		{
+			check(v.EdgeIdxs.Num() == 0 && v.FaceIdxs.Num() == 0);
+		}
+
+		edited->AddCube(FPGCCube(3, 0, 0));
+
+		check(!edited->AdjacencyPacked);
+
+		edited->PrepareForSharing();
+
+		direct->AddCube(FPGCCube());
+		direct->AddCube(FPGCCube(3, 0, 0));
+		direct->PrepareForSharing();
+
+		FBufferArchive edited_ar;
+		FBufferArchive direct_ar;
+
+		edited_ar << *edited;
+		direct_ar << *direct;
+
+		check(edited_ar == direct_ar);
+
+		Mesh loaded;
+		FMemoryReader reader(direct_ar);
+
+		reader << loaded;
+
+		check(loaded.AdjacencyPacked);
+		loaded.CheckConsistent(true);
+
+		FBufferArchive loaded_ar;
+
+		loaded_ar << loaded;
+
+		check(loaded_ar == direct_ar);
+	}
+
+	// a layout read back (e.g. from a damaged cache file) must be refused if anything in it points outside it,
+	// rather than the bakes reading past the end
+	{
+		Mesh mesh(FMath::Cos(FMath::DegreesToRadians(20.0f)));
+
+		mesh.AddCube(FPGCCube());
+
+		TArray<uint8> bytes;
+		mesh.MakeBakeableFlat()->WriteLayout(bytes);
+
+		FlatMeshView view;
+		check(view.ReadLayout(bytes.GetData(), bytes.Num()) == bytes.Num());
+
+		auto offset_of = [&bytes](const void* p) { return (int)(static_cast<const uint8*>(p) - bytes.GetData()); };
+
+		int corner_offset = offset_of(view.FaceVerts.GetData());
+		int start_offset = offset_of(view.FaceVertStarts.GetData() + 1);
+		int face_offset = offset_of(view.EdgeForwardFaces.GetData());
+
+		{
+			auto damaged = bytes;
+			*reinterpret_cast<int*>(damaged.GetData() + corner_offset) = 8;
+
+			check(view.ReadLayout(damaged.GetData(), damaged.Num()) == -1);
+		}
+
+		{
+			auto damaged = bytes;
+			*reinterpret_cast<int*>(damaged.GetData() + start_offset) = -4;
+
+			check(view.ReadLayout(damaged.GetData(), damaged.Num()) == -1);
+		}
+
+		{
+			auto damaged = bytes;
+			*reinterpret_cast<int*>(damaged.GetData() + face_offset) = 6;
+
+			check(view.ReadLayout(damaged.GetData(), damaged.Num()) == -1);
+		}
+	}
+
+	// a batch must give the same faces and edges as adding the same faces one at a time,
+	// numbering can differ so compare them by position, each face from its lowest corner
+	auto describe = [](Mesh& mesh) {
+		TArray<FString> face_names;
+		face_names.SetNum(mesh.Faces.Num().AsInt());
+
+		TArray<FString> ret;
+
+		for (auto face_idx = Idx<MeshFace>(0); face_idx < mesh.Faces.Num(); face_idx++)
+		{
+			const auto& face = mesh.Faces[face_idx];
+
+			if (face.Dead)
+				continue;
+
+			TArray<FString> corners;
+
+			for (auto vert_idx : face.VertIdxs)
+			{
+				auto pos = mesh.Vertices[vert_idx].Pos;
+				corners.Push(FString::Printf(TEXT("(%g %g %g)"), pos.X, pos.Y, pos.Z));
+			}
+
+			int lowest = 0;
+
+			for (int i = 1; i < corners.Num(); i++)
+			{
+				if (corners[i] < corners[lowest])
+				{
+					lowest = i;
+				}
+			}
+
+			for (int i = 0; i < corners.Num(); i++)
+			{
+				face_names[face_idx.AsInt()] += corners[(i + lowest) % corners.Num()];
+			}
+
+			ret.Push(TEXT("F") + face_names[face_idx.AsInt()]);
+		}
+
+		for (const auto& edge : mesh.Edges)
+		{
+			if (edge.Dead)
+				continue;
+
+			auto start = mesh.Vertices[edge.StartVertIdx].Pos;
+			auto end = mesh.Vertices[edge.EndVertIdx].Pos;
+
+			FString ends[2]{ FString::Printf(TEXT("(%g %g %g)"), start.X, start.Y, start.Z), FString::Printf(TEXT("(%g %g %g)"), end.X, end.Y, end.Z) };
+			FString faces[2]{ edge.ForwardFaceIdx.Valid() ? face_names[edge.ForwardFaceIdx.AsInt()] : FString(),
+				edge.BackwardsFaceIdx.Valid() ? face_names[edge.BackwardsFaceIdx.AsInt()] : FString() };
+
+			// the same edge can run either way, depending on which of its faces made it
+			if (ends[1] < ends[0])
+			{
+				Swap(ends[0], ends[1]);
+				Swap(faces[0], faces[1]);
+			}
+
+			ret.Push(FString::Printf(TEXT("E%s%s %d "), *ends[0], *ends[1], (int)edge.SetType) + faces[0] + TEXT("|") + faces[1]);
+		}
+
+		ret.Sort();
+
+		return ret;
+	};
+
+	for (auto config : working_configs)
+	{
+		Mesh one_by_one(FMath::Cos(FMath::DegreesToRadians(20.0f)));
+		Mesh batched(FMath::Cos(FMath::DegreesToRadians(20.0f)));
+
+		batched.BeginBatch();
+
+		for (auto cell : config)
+		{
+			one_by_one.AddCube(FPGCCube(cell[0], cell[1], cell[2]));
+			batched.AddCube(FPGCCube(cell[0], cell[1], cell[2]));
+		}
+
+		batched.EndBatch();
+
+		check(describe(one_by_one) == describe(batched));
+	}
+
+	// including where a face is cancelled within the batch: an edge only it had goes with it,
+	// so a face making that edge again starts it afresh, while one another face still has keeps its type
+	{
+		TArray<FVector2D> uvs{ { 0, 0 }, { 1, 0 }, { 1, 1 }, { 0, 1 } };
+		TArray<PGCEdgeType> sharp{ PGCEdgeType::Sharp, PGCEdgeType::Sharp, PGCEdgeType::Sharp, PGCEdgeType::Sharp };
+		TArray<PGCEdgeType> rounded{ PGCEdgeType::Rounded, PGCEdgeType::Rounded, PGCEdgeType::Rounded, PGCEdgeType::Rounded };
+
+		TArray<FVector> a{ { 0, 0, 0 }, { 1, 0, 0 }, { 1, 1, 0 }, { 0, 1, 0 } };
+		TArray<FVector> a_reversed{ { 0, 0, 0 }, { 0, 1, 0 }, { 1, 1, 0 }, { 1, 0, 0 } };
+		// on a's edge along x = 1, while a is there
+		TArray<FVector> c{ { 1, 0, 0 }, { 2, 0, 0 }, { 2, 1, 0 }, { 1, 1, 0 } };
+		// on a's edge along y = 0, once a has gone
+		TArray<FVector> b{ { 0, 0, 0 }, { 0, -1, 0 }, { 1, -1, 0 }, { 1, 0, 0 } };
+
+		Mesh one_by_one(FMath::Cos(FMath::DegreesToRadians(20.0f)));
+		Mesh batched(FMath::Cos(FMath::DegreesToRadians(20.0f)));
+
+		batched.BeginBatch();
+
+		for (auto mesh : { &one_by_one, &batched })
+		{
+			mesh->AddFaceFromVects(a, uvs, 0, sharp, 0);
+			mesh->AddFaceFromVects(c, uvs, 0, rounded, 0);
+			mesh->AddFaceFromVects(a_reversed, uvs, 0, sharp, 0);
+			mesh->AddFaceFromVects(b, uvs, 0, rounded, 0);
+		}
+
+		batched.EndBatch();
+
+		check(describe(one_by_one) == describe(batched));
+
+		auto type_of = [](const Mesh& mesh, const FVector& start, const FVector& end) {
+			return mesh.Edges[mesh.FindEdge(mesh.FindVert(start), mesh.FindVert(end), false)].SetType;
+		};
+
+		check(type_of(batched, { 0, 0, 0 }, { 1, 0, 0 }) == PGCEdgeType::Rounded);
+		check(type_of(batched, { 1, 0, 0 }, { 1, 1, 0 }) == PGCEdgeType::Sharp);
+	}
+
+	// and so must adding whole sets of cubes at once, with a mix of edge types to check those get merged the same way
+	for (auto config : working_configs)
+	{
+		for (int mix = 0; mix < 2; mix++)
+		{
+			TArray<FPGCCube> cubes;
+
+			for (auto cell : config)
+			{
+				FPGCCube cube(cell[0], cell[1], cell[2]);
+
+				for (int e = 0; e < (int)PGCEdgeId::MAX; e++)
+				{
+					cube.EdgeTypes[e] = mix ? (PGCEdgeType)((cubes.Num() + e) % 3) : PGCEdgeType::Rounded;
+				}
+
+				cubes.Push(cube);
+			}
+
+			Mesh one_by_one(FMath::Cos(FMath::DegreesToRadians(20.0f)));
+			Mesh all_at_once(FMath::Cos(FMath::DegreesToRadians(20.0f)));
+
+			for (const auto& cube : cubes)
+			{
+				one_by_one.AddCube(cube);
+			}
+
+			all_at_once.AddCubes(cubes);
+
+			check(describe(one_by_one) == describe(all_at_once));
+		}
+	}
+
+	// polys added the way SGraph adds them (Util::AddPolyToMesh) meet along edges which become partial edges and are merged again,
+	// here three boxes in an L, the outer two touching only along an edge until the middle one cancels the faces between,
+	// with sharp and rounded boxes, the merged edges must get the types of both halves (sharp if either is), whatever the order
+	{
+		FVector corners[8];
+
+		for (int i = 0; i < 8; i++)
+		{
+			corners[i] = FVector(i & 1, (i >> 1) & 1, (i >> 2) & 1);
+		}
+
+		const int box_faces[6][4]{ { 0, 2, 3, 1 }, { 4, 5, 7, 6 }, { 0, 1, 5, 4 }, { 2, 6, 7, 3 }, { 0, 4, 6, 2 }, { 1, 3, 7, 5 } };
+
+		const FVector offsets[3]{ { 0, 0, 0 }, { 1, 0, 0 }, { 1, 1, 0 } };
+		const PGCEdgeType box_types[3]{ PGCEdgeType::Sharp, PGCEdgeType::Rounded, PGCEdgeType::Rounded };
+
+		const int orders[6][3]{ { 0, 1, 2 }, { 0, 2, 1 }, { 1, 0, 2 }, { 1, 2, 0 }, { 2, 0, 1 }, { 2, 1, 0 } };
+
+		TArray<FString> first;
+
+		for (const auto& order : orders)
+		{
+			auto mesh = MakeShared<Mesh>(FMath::Cos(FMath::DegreesToRadians(20.0f)));
+
+			for (int box : order)
+			{
+				for (const auto& face : box_faces)
+				{
+					TArray<FVector> poly;
+
+					for (int corner : face)
+					{
+						poly.Push(corners[corner] + offsets[box]);
+					}
+
+					Util::AddPolyToMesh(mesh, poly, box_types[box], 0);
+				}
+			}
+
+			mesh->CheckConsistent(true);
+
+			// where the sharp box met the far one, now the inside corner of the L
+			auto inside_corner = mesh->FindEdge(mesh->FindVert(FVector(1, 1, 0)), mesh->FindVert(FVector(1, 1, 1)), false);
+			check(mesh->Edges[inside_corner].SetType == PGCEdgeType::Sharp);
+
+			auto described = describe(*mesh);
+
+			if (!first.Num())
+			{
+				first = described;
+			}
+
+			check(described == first);
+		}
+	}
+
+	// the direct subdivision build must give exactly what adding the faces by position does
+	for (auto config : working_configs)
+	{
+		auto mesh = MakeShared<Mesh>(FMath::Cos(FMath::DegreesToRadians(20.0f)));
+
+		for (auto cell : config)
+		{
+			mesh->AddCube(FPGCCube(cell[0], cell[1], cell[2]));
+		}
+
+		mesh->PrepareForSharing();
+
+		auto div = mesh->Subdivide();
+
+		FlatMesh flat(*div);
+
+		div->ResolveEffectiveEdgeTypes(flat);
+
+		SubdivisionPoints points;
+
+		CalcSubdivisionPoints(flat, points, false);
+
+		if (SubdivisionPointsUnique(points))
+		{
+			Mesh direct(div->CosAutoSharpAngle);
+			Mesh direct_parallel(div->CosAutoSharpAngle);
+			Mesh by_search(div->CosAutoSharpAngle);
+
+			div->BuildSubdivisionDirect(flat, points, direct, false);
+			div->BuildSubdivisionDirect(flat, points, direct_parallel, true);
+			div->BuildSubdivisionBySearch(flat, points, by_search);
+
+			FBufferArchive direct_ar;
+			FBufferArchive direct_parallel_ar;
+			FBufferArchive by_search_ar;
+
+			direct_ar << direct;
+			direct_parallel_ar << direct_parallel;
+			by_search_ar << by_search;
+
+			check(direct_ar == by_search_ar);
+			check(direct_parallel_ar == by_search_ar);
+
+			// the direct build leaves the UVs in the faces' corners, with no map on any vert, but saved (above),
+			// snapshotted or moved into the verts they are what adding face by face gave
+			for (const auto& v : direct.Vertices)
+			{
+				check(v.UVs.Num() == 0);
+			}
+
+			FlatMesh direct_flat(direct);
+			FlatMesh by_search_flat(by_search);
+
+			check(direct_flat.FaceUVs == by_search_flat.FaceUVs);
+			check(direct_flat.VertFirstUVs == by_search_flat.VertFirstUVs);
+
+			direct.MoveCornerUVsToVerts();
+			direct.CheckConsistent(true);
+
+			FBufferArchive moved_ar;
+
+			moved_ar << direct;
+
+			check(moved_ar == by_search_ar);
+		}
+
+		// SubdivideN does the later levels in a QuadMesh, which mustn't make any difference either
+		auto div_2 = div->Subdivide();
+		auto div_3 = div_2->Subdivide();
+		auto div_n = mesh->SubdivideN(3);
+
+		FBufferArchive div_3_ar;
+		FBufferArchive div_n_ar;
+
+		div_3_ar << *div_3;
+		div_n_ar << *div_n;
+
+		check(div_3_ar == div_n_ar);
+
+		// stencils sum the same things in a different order, so only match to rounding
+		auto stencils = SubdivisionStencils::Build(*mesh, 2);
+
+		if (stencils.IsValid())
+		{
+			auto evaluated = stencils->Evaluate(*mesh, false);
+
+			check(evaluated.IsValid());
+			check(evaluated->Vertices.Num() == div_2->Vertices.Num());
+
+			for (Idx<MeshVert> vert_idx{ 0 }; vert_idx < evaluated->Vertices.Num(); vert_idx++)
+			{
+				check(evaluated->Vertices[vert_idx].Pos.Equals(div_2->Vertices[vert_idx].Pos, 1e-4f));
+			}
+		}
+
+		// these are all Rounded, so every limit normal is smooth: unit length, within about 30 degrees of the faces it is on,
+		// and, after two levels, within about 20 degrees of perpendicular to each edge out of its vert
+		auto limit_stencils = SubdivisionStencils::Build(*mesh, 2, true);
+
+		if (limit_stencils.IsValid())
+		{
+			TArray<FVector> corner_normals;
+
+			auto limit = limit_stencils->EvaluateLimit(*mesh, corner_normals, false);
+
+			check(limit.IsValid());
+			check(limit_stencils->Matches(*mesh));
+
+			FlatMesh flat(*limit);
+
+			check(corner_normals.Num() == flat.FaceVerts.Num());
+
+			for (Idx<MeshFace> face_idx{ 0 }; face_idx.AsInt() < flat.NumFaces(); face_idx++)
+			{
+				auto face_normal = flat.FaceNormal(face_idx);
+				auto verts = flat.FaceVertsOf(face_idx);
+
+				for (int j = 0; j < verts.Num(); j++)
+				{
+					const auto& normal = corner_normals[flat.FaceVertStarts[face_idx.AsInt()] + j];
+					const auto& pos = flat.Positions[verts[j].AsInt()];
+
+					check(FMath::Abs(normal.Size() - 1) < 1e-4f);
+					check(FVector::DotProduct(normal, face_normal) > 0.85f);
+
+					for (auto edge_idx : flat.VertEdgesOf(verts[j]))
+					{
+						auto other_idx = flat.EdgeStartVerts[edge_idx.AsInt()] == verts[j] ? flat.EdgeEndVerts[edge_idx.AsInt()] : flat.EdgeStartVerts[edge_idx.AsInt()];
+
+						check(FMath::Abs(FVector::DotProduct(normal, (flat.Positions[other_idx.AsInt()] - pos).GetSafeNormal())) < 0.35f);
+					}
+				}
+			}
+		}
+	}
+
+	// an Auto edge that a move flips between Sharp and Rounded changes how everything near it subdivides, so stencils mustn't
+	// be evaluated across one: here pushing the top of an all-Auto cube out sideways flattens the bottom edge on that side
+	// (Matches sees it for a base whose edges were resolved already, Evaluate for edges the stencils resolved themselves)
+	{
+		auto make = [](float top_shift, bool prepare) {
+			auto mesh = MakeShared<Mesh>(FMath::Cos(FMath::DegreesToRadians(30.0f)));
+
+			FPGCCube cube;
+
+			for (int e = 0; e < (int)PGCEdgeId::MAX; e++)
+			{
+				cube.EdgeTypes[e] = PGCEdgeType::Auto;
+			}
+
+			mesh->AddCube(cube);
+
+			for (auto& v : mesh->Vertices)
+			{
+				if (v.Pos.Z > 0 && v.Pos.X > 0)
+				{
+					v.Pos.X += top_shift;
+				}
+			}
+
+			mesh->RebuildLookups();
+
+			if (prepare)
+			{
+				mesh->PrepareForSharing();
+			}
+
+			return mesh;
+		};
+
+		auto prepared = SubdivisionStencils::Build(*make(0, true), 2);
+
+		check(prepared.IsValid());
+		check(prepared->Matches(*make(0.1f, true)));
+		check(!prepared->Matches(*make(2.5f, true)));
+
+		auto nudged = make(0.1f, true);
+		auto evaluated = prepared->Evaluate(*nudged, false);
+		auto subdivided = nudged->Subdivide()->Subdivide();
+
+		check(evaluated.IsValid());
+		check(evaluated->Vertices.Num() == subdivided->Vertices.Num());
+
+		for (Idx<MeshVert> vert_idx{ 0 }; vert_idx < evaluated->Vertices.Num(); vert_idx++)
+		{
+			check(evaluated->Vertices[vert_idx].Pos.Equals(subdivided->Vertices[vert_idx].Pos, 1e-4f));
+		}
+
+		auto unprepared = SubdivisionStencils::Build(*make(0, false), 2);
+
+		check(unprepared.IsValid());
+		check(unprepared->Matches(*make(2.5f, false)));
+		check(unprepared->Evaluate(*make(0.1f, false), false).IsValid());
+		check(!unprepared->Evaluate(*make(2.5f, false), false).IsValid());
+	}
+
+	// with the top of a cube sharp, the verts along those edges are on a crease, where each side gets one normal,
+	// perpendicular to the crease, and baking keeps the two sides' verts apart
+	{
+		auto mesh = MakeShared<Mesh>(FMath::Cos(FMath::DegreesToRadians(20.0f)));
+
+		FPGCCube cube;
+
+		for (auto edge_id : { PGCEdgeId::TopFront, PGCEdgeId::TopLeft, PGCEdgeId::TopBack, PGCEdgeId::TopRight })
+		{
+			cube.EdgeTypes[(int)edge_id] = PGCEdgeType::Sharp;
+		}
+
+		mesh->AddCube(cube);
+
+		mesh->PrepareForSharing();
+
+		auto limit_stencils = SubdivisionStencils::Build(*mesh, 2, true);
+
+		check(limit_stencils.IsValid());
+
+		TArray<FVector> corner_normals;
+
+		auto limit = limit_stencils->EvaluateLimit(*mesh, corner_normals, false);
+		auto refined = limit_stencils->Evaluate(*mesh, false);
+
+		FlatMesh flat(*limit);
+		FlatMesh refined_flat(*limit_stencils->GetMesh());
+
+		limit_stencils->GetMesh()->ResolveEffectiveEdgeTypes(refined_flat);
+
+		int num_crease_verts = 0;
+
+		for (Idx<MeshVert> vert_idx{ 0 }; vert_idx.AsInt() < flat.NumVerts(); vert_idx++)
+		{
+			TArray<Idx<MeshVert>> sharp_other_verts;
+
+			for (auto edge_idx : refined_flat.VertEdgesOf(vert_idx))
+			{
+				if (refined_flat.EdgeEffectiveTypes[edge_idx.AsInt()] == PGCEdgeType::Sharp)
+				{
+					auto start_vert_idx = refined_flat.EdgeStartVerts[edge_idx.AsInt()];
+
+					sharp_other_verts.Push(start_vert_idx == vert_idx ? refined_flat.EdgeEndVerts[edge_idx.AsInt()] : start_vert_idx);
+				}
+			}
+
+			if (sharp_other_verts.Num() != 2)
+				continue;
+
+			num_crease_verts++;
+
+			auto crease = (refined->Vertices[sharp_other_verts[0]].Pos - refined->Vertices[sharp_other_verts[1]].Pos).GetSafeNormal();
+
+			TArray<FVector> side_normals;
+
+			for (auto face_idx : flat.VertFacesOf(vert_idx))
+			{
+				const auto& normal = corner_normals[flat.FaceVertStarts[face_idx.AsInt()] + flat.Corner(face_idx, vert_idx)];
+
+				check(FMath::Abs(normal.Size() - 1) < 1e-4f);
+				check(FMath::Abs(FVector::DotProduct(normal, crease)) < 1e-4f);
+				check(FVector::DotProduct(normal, flat.FaceNormal(face_idx)) > 0.5f);
+
+				side_normals.AddUnique(normal);
+			}
+
+			// the crease is roughly a right angle (the sides bulge a little)
+			check(side_normals.Num() == 2);
+			check(FMath::Abs(FVector::DotProduct(side_normals[0], side_normals[1])) < 0.25f);
+		}
+
+		check(num_crease_verts > 0);
+
+		// every corner finds a baked vert in the same place with its normal
+		FPGCMeshResult baked;
+
+		limit->BakeAllChannelsIntoOne(baked, false, PGCDebugEdgeType::None, &corner_normals);
+
+		check(baked.Normals.Num() == baked.Verts.Num());
+
+		for (Idx<MeshFace> face_idx{ 0 }; face_idx.AsInt() < flat.NumFaces(); face_idx++)
+		{
+			auto verts = flat.FaceVertsOf(face_idx);
+
+			for (int j = 0; j < verts.Num(); j++)
+			{
+				const auto& pos = flat.Positions[verts[j].AsInt()];
+				const auto& normal = corner_normals[flat.FaceVertStarts[face_idx.AsInt()] + j];
+
+				bool found = false;
+
+				for (int k = 0; k < baked.Verts.Num(); k++)
+				{
+					found |= baked.Verts[k] == pos && baked.Normals[k] == normal;
+				}
+
+				check(found);
+			}
+		}
+	}
+
+	// once prepared, a mesh is only read by subdividing, triangularising, flattening for bakes and building stencils,
+	// so many threads can do all of those to the one mesh at once, each getting what it would alone, and the mesh is left as it was
+	// (a thread sanitizer is needed to see a race itself, this catches one that changes anything)
+	{
+		auto mesh = MakeShared<Mesh>(FMath::Cos(FMath::DegreesToRadians(20.0f)));
+
+		TArray<FPGCCube> cubes;
+
+		for (auto cell : working_configs.Last())
+		{
+			FPGCCube cube(cell[0], cell[1], cell[2]);
+
+			for (int e = 0; e < (int)PGCEdgeId::MAX; e++)
+			{
+				cube.EdgeTypes[e] = (PGCEdgeType)((cubes.Num() + e) % 3);
+			}
+
+			cubes.Push(cube);
+		}
+
+		mesh->AddCubes(cubes);
+		mesh->PrepareForSharing();
+
+		const int num_kinds = 4;
+
+		auto run = [&mesh](int kind) {
+			FBufferArchive ar;
+
+			switch (kind)
+			{
+			case 0:
+				ar << *mesh->SubdivideN(2);
+				break;
+
+			case 1:
+				ar << *mesh->Triangularise();
+				break;
+
+			case 2:
+			{
+				FPGCMeshResult baked;
+
+				Mesh::BakeAllChannelsIntoOne(mesh->MakeBakeableFlat()->View(), baked, false, PGCDebugEdgeType::None);
+
+				ar << baked.Verts << baked.UVs;
+				break;
+			}
+
+			case 3:
+			{
+				auto stencils = SubdivisionStencils::Build(*mesh, 2, true);
+
+				if (stencils.IsValid())
+				{
+					TArray<FVector> corner_normals;
+
+					ar << *stencils->EvaluateLimit(*mesh, corner_normals, false) << corner_normals;
+				}
+
+				break;
+			}
+			}
+
+			return TArray<uint8>(ar);
+		};
+
+		TArray<TArray<uint8>> alone;
+
+		for (int kind = 0; kind < num_kinds; kind++)
+		{
+			alone.Push(run(kind));
+		}
+
+		FBufferArchive before;
+		before << *mesh;
+
+		TArray<TArray<uint8>> together;
+		together.SetNum(num_kinds * 8);
+
+		ParallelFor(together.Num(), [&](int32 i)
+		{
+			together[i] = run(i % num_kinds);
+		});
+
+		for (int i = 0; i < together.Num(); i++)
+		{
+			check(together[i] == alone[i % num_kinds]);
+		}
+
+		FBufferArchive after;
+		after << *mesh;
+
+		check(after == before);
+	}
+
+	// subdividing in chunks must give the same faces as subdividing the whole set, up to rounding (as the chunks are welded by position)
+	// with chunks of one cell every contact in the configs crosses a chunk border, and the cubes get a mix of edge types
+	// so that the ones in the halo have to merge into the chunk's edges
+	auto same_faces = [](const Mesh& a, const Mesh& b) {
+		FlatMesh flat_a(a);
+		FlatMesh flat_b(b);
+
+		if (flat_a.NumVerts() != flat_b.NumVerts() || flat_a.NumEdges() != flat_b.NumEdges() || flat_a.NumFaces() != flat_b.NumFaces())
+			return false;
+
+		TMap<int, TArray<Idx<MeshFace>>> b_faces_by_group;
+
+		for (Idx<MeshFace> face_idx{ 0 }; face_idx.AsInt() < flat_b.NumFaces(); face_idx++)
+		{
+			b_faces_by_group.FindOrAdd(flat_b.FaceUVGroups[face_idx.AsInt()]).Push(face_idx);
+		}
+
+		auto same_face = [&](Idx<MeshFace> face_a, Idx<MeshFace> face_b) {
+			auto verts_a = flat_a.FaceVertsOf(face_a);
+			auto verts_b = flat_b.FaceVertsOf(face_b);
+			auto n = verts_a.Num();
+
+			if (verts_b.Num() != n || flat_a.FaceChannels[face_a.AsInt()] != flat_b.FaceChannels[face_b.AsInt()])
+				return false;
+
+			// the same corners in the same order, but not necessarily starting from the same one
+			for (int rot = 0; rot < n; rot++)
+			{
+				bool same = true;
+
+				for (int j = 0; j < n && same; j++)
+				{
+					auto k = (j + rot) % n;
+
+					same = flat_a.Positions[verts_a[j].AsInt()].Equals(flat_b.Positions[verts_b[k].AsInt()], 1e-4f)
+						&& flat_a.FaceUVsOf(face_a)[j].Equals(flat_b.FaceUVsOf(face_b)[k], 1e-4f)
+						&& flat_a.EdgeSetTypes[flat_a.FaceEdgesOf(face_a)[j].AsInt()] == flat_b.EdgeSetTypes[flat_b.FaceEdgesOf(face_b)[k].AsInt()];
+				}
+
+				if (same)
+					return true;
+			}
+
+			return false;
+		};
+
+		for (Idx<MeshFace> face_a{ 0 }; face_a.AsInt() < flat_a.NumFaces(); face_a++)
+		{
+			auto candidates = b_faces_by_group.Find(flat_a.FaceUVGroups[face_a.AsInt()]);
+
+			if (!candidates)
+				return false;
+
+			// each of b's faces can only match once
+			auto found = candidates->IndexOfByPredicate([&](Idx<MeshFace> face_b) { return same_face(face_a, face_b); });
+
+			if (found == INDEX_NONE)
+				return false;
+
+			candidates->RemoveAtSwap(found);
+		}
+
+		return true;
+	};
+
+	for (auto config : working_configs)
 	{
-		v.EdgeIdxs.Remove(edge_idx);
+		TArray<FPGCCube> cubes;
+
+		for (auto cell : config)
+		{
+			FPGCCube cube(cell[0], cell[1], cell[2]);
+
+			for (int e = 0; e < (int)PGCEdgeId::MAX; e++)
+			{
+				cube.EdgeTypes[e] = (PGCEdgeType)((cubes.Num() + e) % 3);
+			}
 
-		for (auto& idx : v.EdgeIdxs)
+			cubes.Push(cube);
+		}
+
+		for (int chunk_size = 1; chunk_size <= 2; chunk_size++)
 		{
-			if (idx > edge_idx)
+			for (int divisions = 2; divisions <= 3; divisions++)
 			{
-				idx--;
+				auto whole = MakeShared<Mesh>(FMath::Cos(FMath::DegreesToRadians(20.0f)));
+
+				whole->AddCubes(cubes);
+				whole->PrepareForSharing();
+
+				CubeChunks chunks(chunk_size);
+				Mesh chunked(FMath::Cos(FMath::DegreesToRadians(20.0f)));
+
+				chunks.Subdivide(cubes, divisions, chunked, false);
+
+				check(same_faces(*whole->SubdivideN(divisions), chunked));
+
+				// nothing changed, nothing to build
+				Mesh again(FMath::Cos(FMath::DegreesToRadians(20.0f)));
+
+				chunks.Subdivide(cubes, divisions, again, false);
+
+				check(chunks.NumRebuilt() == 0);
+				check(same_faces(chunked, again));
+
+				// after editing one cube only the chunks that have it in themselves or their halo
+				// (i.e. with it no more than a cell outside them) are built again, and the result still matches
+				auto edited_cubes = cubes;
+				auto& edited = edited_cubes[0];
+
+				edited.EdgeTypes[0] = edited.EdgeTypes[0] == PGCEdgeType::Sharp ? PGCEdgeType::Rounded : PGCEdgeType::Sharp;
+
+				TSet<FIntVector> near_chunks;
+
+				for (const auto& cube : edited_cubes)
+				{
+					// the configs have no negative cells, so division is the floor
+					FIntVector chunk(cube.X / chunk_size, cube.Y / chunk_size, cube.Z / chunk_size);
+					FIntVector origin = chunk * chunk_size;
+
+					if (edited.X >= origin.X - 1 && edited.X <= origin.X + chunk_size
+						&& edited.Y >= origin.Y - 1 && edited.Y <= origin.Y + chunk_size
+						&& edited.Z >= origin.Z - 1 && edited.Z <= origin.Z + chunk_size)
+					{
+						near_chunks.Add(chunk);
+					}
+				}
+
+				auto edited_whole = MakeShared<Mesh>(FMath::Cos(FMath::DegreesToRadians(20.0f)));
+
+				edited_whole->AddCubes(edited_cubes);
+				edited_whole->PrepareForSharing();
+
+				Mesh edited_chunked(FMath::Cos(FMath::DegreesToRadians(20.0f)));
+
+				chunks.Subdivide(edited_cubes, divisions, edited_chunked, false);
+
+				check(chunks.NumRebuilt() == near_chunks.Num());
+				check(same_faces(*edited_whole->SubdivideN(divisions), edited_chunked));
 			}
 		}
 	}
 
-	for (auto& f : Faces)
+	for(auto config : working_configs)
+	{
+		TestOne(config, 0, 1, 2, false);
+		TestOne(config, 0, 2, 1, false);
+		TestOne(config, 1, 0, 2, false);
+		TestOne(config, 1, 2, 0, false);
+		TestOne(config, 2, 0, 1, false);
+		TestOne(config, 2, 1, 0, false);
+
+		TestOne(config, 0, 2, 1, true);
+		TestOne(config, 0, 1, 2, true);
+		TestOne(config, 1, 0, 2, true);
+		TestOne(config, 1, 2, 0, true);
+		TestOne(config, 2, 0, 1, true);
+		TestOne(config, 2, 1, 0, true);
+	}
+}
+
+#endif
+
+Idx<MeshVert> Mesh::AddVert(MeshVertRaw vert, int UVGRoup)
+{
+	// finding it by UV needs the maps, and a new vert needs arrays of its own
+	MoveCornerUVsToVerts();
+	UnpackAdjacency();
+
+	auto vert_idx = FindVert(vert.Pos, UVGRoup);
+
+	// we have it with this UV already set
+	if (vert_idx.Valid())
+		return vert_idx;
+
+	// do we have it without the UV?
+	vert_idx = FindVert(vert.Pos);
+
+	if (!vert_idx.Valid())
 	{
-		check(!f.EdgeIdxs.Contains(edge_idx));
+		// no, add it
+		vert_idx = Vertices.Num();
+		MeshVert mv;
+		mv.Pos = vert.Pos;
+		Vertices.Push(MoveTemp(mv));
+		VertLookup.Add(HashPosition(vert.Pos), vert_idx);
+	}
+
+	// set the UV into it
+	Vertices[vert_idx].UVs.Add(UVGRoup) = vert.UV;
+
+	TouchVert(vert_idx);
+
+	return vert_idx;
+}
+
+Idx<MeshVert> Mesh::AddVert(FVector pos)
+{
+	UnpackAdjacency();
+
+	auto vert_idx = FindVert(pos);
+
+	// we have it with this UV already set
+	if (vert_idx.Valid())
+		return vert_idx;
+
+	MeshVert mv;
+	mv.Pos = pos;
+	Vertices.Push(MoveTemp(mv));
+	VertLookup.Add(HashPosition(pos), Vertices.LastIdx());
+
+	TouchVert(Vertices.LastIdx());
+
+	return Vertices.LastIdx();
+}
 
-		for (auto& idx : f.EdgeIdxs)
+Idx<MeshFace> Mesh::FindFaceByVertIdxs(TArrayView<const Idx<MeshVert>> vert_idxs) const
+{
+	auto bucket = FaceLookup.Find(HashIdxSequence(vert_idxs));
+
+	if (bucket)
+	{
+		for (auto face_idx : *bucket)
 		{
-			if (idx > edge_idx)
+			const auto& face_vert_idxs = Faces[face_idx].VertIdxs;
+
+			if (face_vert_idxs.Num() != vert_idxs.Num())
+				continue;
+
+			bool same = true;
+
+			for (int i = 0; i < vert_idxs.Num() && same; i++)
+			{
+				same = face_vert_idxs[i] == vert_idxs[i];
+			}
+
+			if (same)
 			{
-				idx--;
+				return face_idx;
 			}
 		}
 	}
 
-	Edges.RemoveAt(edge_idx);
+	return Idx<MeshFace>::None;
 }
 
-void Mesh::RemoveVert(Idx<MeshVert> vert_idx)
+void Mesh::RemoveFace(Idx<MeshFace> face_idx)
 {
-	auto v = Vertices[vert_idx];
+	UnpackAdjacency();
 
-	check(v.EdgeIdxs.Num() == 0);
-	check(v.FaceIdxs.Num() == 0);
+	auto& face = Faces[face_idx];
+
+	check(!face.Dead);
+
+	// only our own verts and edges can refer to us
+	for (auto vert_idx : face.VertIdxs)
+	{
+		Vertices[vert_idx].FaceIdxs.Remove(face_idx);
+		TouchVert(vert_idx);
+	}
 
-	for (auto& e : Edges)
+	for (auto edge_idx : face.EdgeIdxs)
 	{
-		check(e.StartVertIdx != vert_idx);
-		check(e.EndVertIdx != vert_idx);
+		TouchEdge(edge_idx);
 
-		if (e.StartVertIdx > vert_idx)
+		auto& e = Edges[edge_idx];
+
+		if (e.ForwardFaceIdx == face_idx)
 		{
-			e.StartVertIdx--;
+			e.ForwardFaceIdx = Idx<MeshFace>::None;
 		}
-		if (e.EndVertIdx > vert_idx)
+
+		if (e.BackwardsFaceIdx == face_idx)
 		{
-			e.EndVertIdx--;
+			e.BackwardsFaceIdx = Idx<MeshFace>::None;
 		}
 	}
 
-	for (auto& f : Faces)
+	FaceLookup.Remove(HashIdxSequence(face.VertIdxs), face_idx);
+
+	face.Dead = true;
+	NumDead++;
+
+	// copy, MergeEdges edits face edge lists
+	TArray<Idx<MeshEdge>> edge_idxs = face.EdgeIdxs;
+
+	MergePartialEdges(edge_idxs);
+
+	CleanUpRedundantEdges(edge_idxs);
+}
+
+void Mesh::RemoveEdge(Idx<MeshEdge> edge_idx)
+{
+	UnpackAdjacency();
+
+	auto& e = Edges[edge_idx];
+
+	check(!e.Dead);
+	check(!e.ForwardFaceIdx.Valid() && !e.BackwardsFaceIdx.Valid());
+
+	Vertices[e.StartVertIdx].EdgeIdxs.Remove(edge_idx);
+	Vertices[e.EndVertIdx].EdgeIdxs.Remove(edge_idx);
+
+	TouchVert(e.StartVertIdx);
+	TouchVert(e.EndVertIdx);
+
+	EdgeLookup.Remove(HashIdxPair(e.StartVertIdx, e.EndVertIdx), edge_idx);
+
+	e.Dead = true;
+	NumDead++;
+}
+
+void Mesh::RemoveVert(Idx<MeshVert> vert_idx)
+{
+	UnpackAdjacency();
+
+	auto& v = Vertices[vert_idx];
+
+	check(!v.Dead);
+	check(v.EdgeIdxs.Num() == 0);
+	check(v.FaceIdxs.Num() == 0);
+
+	VertLookup.Remove(HashPosition(v.Pos), vert_idx);
+
+	v.Dead = true;
+	NumDead++;
+}
+
+void Mesh::MergePartialEdges(const TArray<Idx<MeshEdge>>& edge_idxs)
+{
+	// everything between the same verts as the edges we were given, and in index order,
+	// which visits them in the same order as a scan of the whole mesh would
+	TArray<Idx<MeshEdge>> candidates;
+
+	for (auto edge_idx : edge_idxs)
 	{
-		check(!f.VertIdxs.Contains(vert_idx));
+		const auto& edge = Edges[edge_idx];
 
-		for (auto& idx : f.VertIdxs)
+		for (auto other_edge_idx : FindAllEdges(edge.StartVertIdx, edge.EndVertIdx))
 		{
-			if (idx > vert_idx)
-			{
-				idx--;
-			}
+			candidates.AddUnique(other_edge_idx);
 		}
 	}
 
-	Vertices.RemoveAt(vert_idx);
-}
+	candidates.Sort();
 
-void Mesh::MergePartialEdges()
-{
-	for (Idx<MeshEdge> edge_idx{ 0 }; edge_idx < Edges.Num(); edge_idx++)
+	for (auto edge_idx : candidates)
 	{
 		auto& edge = Edges[edge_idx];
 
@@ -567,6 +1784,9 @@ void Mesh::MergeEdges(Idx<MeshEdge> merge_to, Idx<MeshEdge> merge_from)
 {
 	check(merge_to != merge_from);
 
+	TouchEdge(merge_to);
+	TouchEdge(merge_from);
+
 	auto& edge1 = Edges[merge_to];
 	auto& edge2 = Edges[merge_from];
 
@@ -579,6 +1799,7 @@ void Mesh::MergeEdges(Idx<MeshEdge> merge_to, Idx<MeshEdge> merge_from)
 
 			Faces[edge2.ForwardFaceIdx].EdgeIdxs.Remove(merge_from);
 			Faces[edge2.ForwardFaceIdx].EdgeIdxs.Push(merge_to);
+			TouchFace(edge2.ForwardFaceIdx);
 			edge1.ForwardFaceIdx = edge2.ForwardFaceIdx;
 			edge2.ForwardFaceIdx = Idx<MeshFace>::None;
 		}
@@ -589,6 +1810,7 @@ void Mesh::MergeEdges(Idx<MeshEdge> merge_to, Idx<MeshEdge> merge_from)
 
 			Faces[edge2.BackwardsFaceIdx].EdgeIdxs.Remove(merge_from);
 			Faces[edge2.BackwardsFaceIdx].EdgeIdxs.Push(merge_to);
+			TouchFace(edge2.BackwardsFaceIdx);
 			edge1.BackwardsFaceIdx = edge2.BackwardsFaceIdx;
 			edge2.BackwardsFaceIdx = Idx<MeshFace>::None;
 		}
@@ -602,6 +1824,7 @@ void Mesh::MergeEdges(Idx<MeshEdge> merge_to, Idx<MeshEdge> merge_from)
 
 			Faces[edge2.ForwardFaceIdx].EdgeIdxs.Remove(merge_from);
 			Faces[edge2.ForwardFaceIdx].EdgeIdxs.Push(merge_to);
+			TouchFace(edge2.ForwardFaceIdx);
 			edge1.BackwardsFaceIdx = edge2.ForwardFaceIdx;
 			edge2.ForwardFaceIdx = Idx<MeshFace>::None;
 		}
@@ -610,84 +1833,188 @@ void Mesh::MergeEdges(Idx<MeshEdge> merge_to, Idx<MeshEdge> merge_from)
 			check(edge2.BackwardsFaceIdx.Valid());
 			check(!edge1.ForwardFaceIdx.Valid());
 
-			Faces[edge2.BackwardsFaceIdx].EdgeIdxs.Remove(merge_from);
-			Faces[edge2.BackwardsFaceIdx].EdgeIdxs.Push(merge_to);
-			edge1.ForwardFaceIdx = edge2.BackwardsFaceIdx;
-			edge2.BackwardsFaceIdx = Idx<MeshFace>::None;
+			Faces[edge2.BackwardsFaceIdx].EdgeIdxs.Remove(merge_from);
+			Faces[edge2.BackwardsFaceIdx].EdgeIdxs.Push(merge_to);
+			TouchFace(edge2.BackwardsFaceIdx);
+			edge1.ForwardFaceIdx = edge2.BackwardsFaceIdx;
+			edge2.BackwardsFaceIdx = Idx<MeshFace>::None;
+		}
+	}
+
+	// the two halves were the same edge all along, so it gets the types that went into both
+	edge1.SetType = MergeEdgeTypes(edge1.SetType, edge2.SetType);
+
+	// we follow this with a CleanUpRedundantEdges, so no need for this as we've made 
+	// merge_from redundant by unsetting its remaining face index
+	//RemoveEdge(merge_from);
+}
+
+void Mesh::CleanUpRedundantEdges(const TArray<Idx<MeshEdge>>& edge_idxs)
+{
+	TArray<Idx<MeshVert>> vert_idxs;
+
+	for (auto edge_idx : edge_idxs)
+	{
+		// MergeEdges can have emptied any of the edges between the same verts, not just these
+		for (auto other_edge_idx : FindAllEdges(Edges[edge_idx].StartVertIdx, Edges[edge_idx].EndVertIdx))
+		{
+			const auto& e = Edges[other_edge_idx];
+
+			if (!e.ForwardFaceIdx.Valid() && !e.BackwardsFaceIdx.Valid())
+			{
+				vert_idxs.AddUnique(e.StartVertIdx);
+				vert_idxs.AddUnique(e.EndVertIdx);
+
+				RemoveEdge(other_edge_idx);
+			}
+		}
+	}
+
+	if (vert_idxs.Num())
+	{
+		CleanUpRedundantVerts(vert_idxs);
+	}
+}
+
+void Mesh::CleanUpRedundantVerts(const TArray<Idx<MeshVert>>& vert_idxs)
+{
+	UnpackAdjacency();
+
+	for (auto vert_idx : vert_idxs)
+	{
+		const auto& v = Vertices[vert_idx];
+
+		if (v.EdgeIdxs.Num() == 0)
+		{
+			RemoveVert(vert_idx);
+		}
+	}
+}
+
+void Mesh::Compact()
+{
+	check(!Batch.Active);
+
+	if (!NumDead)
+		return;
+
+	UnpackAdjacency();
+
+	// old index -> new index, or None if dropped
+	TArray<Idx<MeshVert>> vert_map;
+	TArray<Idx<MeshEdge>> edge_map;
+	TArray<Idx<MeshFace>> face_map;
+
+	TArrayIdx<MeshVert> vertices;
+	TArrayIdx<MeshEdge> edges;
+	TArrayIdx<MeshFace> faces;
+
+	for (const auto& v : Vertices)
+	{
+		vert_map.Push(v.Dead ? Idx<MeshVert>::None : vertices.Num());
+
+		if (!v.Dead)
+		{
+			vertices.Push(v);
 		}
 	}
 
-	// we follow this with a CleanUpRedundantEdges, so no need for this as we've made 
-	// merge_from redundant by unsetting its remaining face index
-	//RemoveEdge(merge_from);
-}
+	for (const auto& e : Edges)
+	{
+		edge_map.Push(e.Dead ? Idx<MeshEdge>::None : edges.Num());
 
-void Mesh::CleanUpRedundantEdges()
-{
-	bool any = false;
+		if (!e.Dead)
+		{
+			edges.Push(e);
+		}
+	}
 
-	for (Idx<MeshEdge> i{ 0 }; i < Edges.Num();)
+	for (const auto& f : Faces)
 	{
-		const auto& e = Edges[i];
+		face_map.Push(f.Dead ? Idx<MeshFace>::None : faces.Num());
 
-		if (!e.ForwardFaceIdx.Valid() && !e.BackwardsFaceIdx.Valid())
+		if (!f.Dead)
 		{
-			any = true;
-			RemoveEdge(i);
+			faces.Push(f);
 		}
-		else
+	}
+
+	// live elements only refer to other live elements, so nothing below maps to None
+	// except unset face slots on partial edges
+	for (auto& v : vertices)
+	{
+		for (auto& edge_idx : v.EdgeIdxs)
+		{
+			edge_idx = edge_map[edge_idx.AsInt()];
+		}
+
+		for (auto& face_idx : v.FaceIdxs)
 		{
-			i++;
+			face_idx = face_map[face_idx.AsInt()];
 		}
 	}
 
-	if (any)
+	for (auto& e : edges)
 	{
-		CleanUpRedundantVerts();
+		e.StartVertIdx = vert_map[e.StartVertIdx.AsInt()];
+		e.EndVertIdx = vert_map[e.EndVertIdx.AsInt()];
+
+		if (e.ForwardFaceIdx.Valid())
+		{
+			e.ForwardFaceIdx = face_map[e.ForwardFaceIdx.AsInt()];
+		}
+
+		if (e.BackwardsFaceIdx.Valid())
+		{
+			e.BackwardsFaceIdx = face_map[e.BackwardsFaceIdx.AsInt()];
+		}
 	}
-}
 
-void Mesh::CleanUpRedundantVerts()
-{
-	for (Idx<MeshVert> i{ 0 }; i < Vertices.Num();)
+	for (auto& f : faces)
 	{
-		const auto& v = Vertices[i];
-
-		if (v.EdgeIdxs.Num() == 0)
+		for (auto& vert_idx : f.VertIdxs)
 		{
-			RemoveVert(i);
+			vert_idx = vert_map[vert_idx.AsInt()];
 		}
-		else
+
+		for (auto& edge_idx : f.EdgeIdxs)
 		{
-			i++;
+			edge_idx = edge_map[edge_idx.AsInt()];
 		}
 	}
+
+	Vertices = MoveTemp(vertices);
+	Edges = MoveTemp(edges);
+	Faces = MoveTemp(faces);
+
+	NumDead = 0;
+
+	RebuildLookups();
 }
 
-Idx<MeshFace> Mesh::AddFaceFromRawVerts(const TArray<MeshVertRaw>& vertices, int UVGroup, const TArray<PGCEdgeType>& edge_types, int channel)
+Idx<MeshFace> Mesh::AddFaceFromRawVerts(TArrayView<const MeshVertRaw> vertices, int UVGroup, TArrayView<const PGCEdgeType> edge_types, int channel)
 {
-	MeshFace mf(channel);
+	check(vertices.Num() == edge_types.Num());
 
-	for (auto vr : vertices)
+	TFaceArray<Idx<MeshVert>> vert_idxs;
+	TFaceArray<PGCEdgeType> edge_type_copy(edge_types.GetData(), edge_types.Num());
+
+	for (const auto& vr : vertices)
 	{
-		mf.VertIdxs.Push(AddVert(vr, UVGroup));
+		vert_idxs.Push(AddVert(vr, UVGroup));
 	}
 
-	TArray<PGCEdgeType> edge_type_copy(edge_types);
-
-	RegularizeVertIdxs(mf.VertIdxs, &edge_type_copy);
+	RegularizeVertIdxs(vert_idxs, edge_type_copy);
 
-	mf.UVGroup = UVGroup;
-
-	return AddFindFace(mf, edge_type_copy);
+	return AddFindFace(vert_idxs, edge_type_copy, UVGroup, channel);
 }
 
-bool Mesh::CancelExistingReverseFace(const TArray<Idx<MeshVert>>& face)
+bool Mesh::CancelExistingReverseFace(TArrayView<const Idx<MeshVert>> face)
 {
 	// the reverse face has the same first vert and the other's reverse
 	// (the same as reversing the whole lot and then Regularizing again)
 
-	TArray<Idx<MeshVert>> reverse_face{ face[0] };
+	TFaceArray<Idx<MeshVert>> reverse_face{ face[0] };
 
 	for (int i = face.Num() - 1; i >= 1; i--)
 	{
@@ -708,14 +2035,14 @@ bool Mesh::CancelExistingReverseFace(const TArray<Idx<MeshVert>>& face)
 
 bool Mesh::CancelExistingReverseFaceFromVects(const TArray<FVector>& vertices)
 {
-	TArray<Idx<MeshVert>> vert_idxs;
+	TFaceArray<Idx<MeshVert>> vert_idxs;
 
-	for (auto vr : vertices)
+	for (const auto& vr : vertices)
 	{
 		vert_idxs.Push(AddVert(vr));
 	}
 
-	RegularizeVertIdxs(vert_idxs, nullptr);
+	RegularizeVertIdxs(vert_idxs, {});
 
 	return CancelExistingReverseFace(vert_idxs);
 }
@@ -728,89 +2055,521 @@ Idx<MeshFace> Mesh::AddFaceFromVects(const TArray<FVector>& vertices,
 	check(vertices.Num() == edge_types.Num());
 	check(vertices.Num() == uvs.Num());
 
-	MeshFace mf(channel);
+	if (Batch.Active)
+	{
+		Batch.Positions.Append(vertices);
+		Batch.UVs.Append(uvs);
+		Batch.EdgeTypes.Append(edge_types);
+		Batch.FaceStarts.Push(Batch.Positions.Num());
+		Batch.FaceUVGroups.Push(UVGroup);
+		Batch.FaceChannels.Push(channel);
+
+		return Idx<MeshFace>::None;
+	}
+
+	TFaceArray<Idx<MeshVert>> vert_idxs;
+	TFaceArray<PGCEdgeType> edge_type_copy(edge_types);
 
 	for (int i = 0; i < vertices.Num(); i++)
 	{
-		mf.VertIdxs.Push(AddVert(MeshVertRaw(vertices[i], uvs[i]), UVGroup));
+		vert_idxs.Push(AddVert(MeshVertRaw(vertices[i], uvs[i]), UVGroup));
+	}
+
+	RegularizeVertIdxs(vert_idxs, edge_type_copy);
+
+	return AddFindFace(vert_idxs, edge_type_copy, UVGroup, channel);
+}
+
+void Mesh::BeginBatch()
+{
+	check(!Batch.Active);
+
+	Batch = FaceBatch();
+	Batch.Active = true;
+	Batch.FaceStarts.Push(0);
+}
+
+void Mesh::EndBatch()
+{
+	check(Batch.Active);
+
+	// take it, so that the survivors below go straight into the mesh
+	FaceBatch batch = MoveTemp(Batch);
+	Batch = FaceBatch();
+
+	const int num_faces = batch.NumFaces();
+	const int num_corners = batch.Positions.Num();
+	const int first_new_id = Vertices.Num().AsInt();
+
+	// weld by position, existing verts are identified by their index and new positions are numbered on from the end
+	TArray<int> corner_ids;
+	corner_ids.SetNumUninitialized(num_corners);
+
+	{
+		TArray<FVector> new_positions;
+		THashIdxLookup<FVector> new_lookup;
+
+		for (int j = 0; j < num_corners; j++)
+		{
+			const auto& pos = batch.Positions[j];
+			auto vert_idx = FindVert(pos);
+
+			if (vert_idx.Valid())
+			{
+				corner_ids[j] = vert_idx.AsInt();
+				continue;
+			}
+
+			auto hash = HashPosition(pos);
+			auto bucket = new_lookup.Find(hash);
+			int id = -1;
+
+			if (bucket)
+			{
+				for (auto i : *bucket)
+				{
+					if (new_positions[i.AsInt()] == pos)
+					{
+						id = i.AsInt();
+						break;
+					}
+				}
+			}
+
+			if (id == -1)
+			{
+				id = new_positions.Num();
+				new_positions.Push(pos);
+				new_lookup.Add(hash, Idx<FVector>(id));
+			}
+
+			corner_ids[j] = first_new_id + id;
+		}
+	}
+
+	// each face's ids rotated to put the lowest first, as RegularizeVertIdxs does to real faces
+	TArray<int> face_ids;
+	face_ids.SetNumUninitialized(num_corners);
+
+	for (int f = 0; f < num_faces; f++)
+	{
+		int start = batch.FaceStarts[f];
+		int n = batch.FaceStarts[f + 1] - start;
+		check(n > 2);
+
+		int lowest = 0;
+
+		for (int i = 1; i < n; i++)
+		{
+			if (corner_ids[start + i] < corner_ids[start + lowest])
+			{
+				lowest = i;
+			}
+		}
+
+		for (int i = 0; i < n; i++)
+		{
+			face_ids[start + i] = corner_ids[start + (i + lowest) % n];
+		}
+	}
+
+	auto face_view = [&](int f) {
+		return TArrayView<const int>(&face_ids[batch.FaceStarts[f]], batch.FaceStarts[f + 1] - batch.FaceStarts[f]);
+	};
+
+	// the reverse of a regularized face keeps its first id and reverses the rest
+	auto reverse_at = [](TArrayView<const int> ids, int i) {
+		return i == 0 ? ids[0] : ids[ids.Num() - i];
+	};
+
+	auto hash_ids = [&](TArrayView<const int> ids, bool reverse) {
+		uint32 ret = 0;
+
+		for (int i = 0; i < ids.Num(); i++)
+		{
+			ret = HashCombine(ret, GetTypeHash(reverse ? reverse_at(ids, i) : ids[i]));
+		}
+
+		return ret;
+	};
+
+	auto same_ids = [&](TArrayView<const int> a, TArrayView<const int> b, bool reverse) {
+		if (a.Num() != b.Num())
+			return false;
+
+		for (int i = 0; i < a.Num(); i++)
+		{
+			if (a[i] != (reverse ? reverse_at(b, i) : b[i]))
+				return false;
+		}
+
+		return true;
+	};
+
+	// one slot per face and its reverse, orientations are relative to the first staged face that used the slot
+	struct FacePair {
+		int Reference;
+		Idx<MeshFace> Existing;			///< a face already in the mesh on these verts
+		bool ExistingForward;
+		bool ExistingAlive;
+		int Present;					///< the staged face currently standing here, or -1
+		bool PresentForward;
+	};
+
+	TArray<FacePair> pairs;
+	TMap<uint32, TArray<int>> pair_lookup;
+
+	// the type each edge would have, replayed the way adding one face at a time does it: an edge merges the types
+	// of every face it has had since it was made, and goes when its last face is cancelled, so if made again it starts afresh
+	struct EdgeState {
+		PGCEdgeType Type;
+		int NumFaces;
+	};
+
+	TMap<uint64, EdgeState> edge_states;
+
+	auto edge_key = [](int id1, int id2) {
+		return id1 < id2 ? ((uint64)id1 << 32) | (uint32)id2 : ((uint64)id2 << 32) | (uint32)id1;
+	};
+
+	auto edge_state = [&](int id1, int id2) -> EdgeState& {
+		auto key = edge_key(id1, id2);
+
+		if (auto found = edge_states.Find(key))
+			return *found;
+
+		EdgeState state{ PGCEdgeType::Unset, 0 };
+
+		// an edge already in the mesh starts as it is there
+		if (id1 < first_new_id && id2 < first_new_id)
+		{
+			for (auto edge_idx : FindAllEdges(Idx<MeshVert>(id1), Idx<MeshVert>(id2)))
+			{
+				const auto& edge = Edges[edge_idx];
+
+				state.Type = MergeEdgeTypes(state.Type, edge.SetType);
+				state.NumFaces += (edge.ForwardFaceIdx.Valid() ? 1 : 0) + (edge.BackwardsFaceIdx.Valid() ? 1 : 0);
+			}
+		}
+
+		return edge_states.Add(key, state);
+	};
+
+	auto staged_face_added = [&](int f) {
+		int start = batch.FaceStarts[f];
+		int n = batch.FaceStarts[f + 1] - start;
+
+		for (int i = 0; i < n; i++)
+		{
+			auto& state = edge_state(corner_ids[start + i], corner_ids[start + (i + 1) % n]);
+
+			state.Type = MergeEdgeTypes(state.Type, batch.EdgeTypes[start + i]);
+			state.NumFaces++;
+		}
+	};
+
+	auto face_cancelled = [&](TArrayView<const int> ids) {
+		for (int i = 0; i < ids.Num(); i++)
+		{
+			auto& state = edge_state(ids[i], ids[(i + 1) % ids.Num()]);
+
+			if (--state.NumFaces == 0)
+			{
+				state.Type = PGCEdgeType::Unset;
+			}
+		}
+	};
+
+	for (int f = 0; f < num_faces; f++)
+	{
+		auto ids = face_view(f);
+		int pair_idx = -1;
+		bool forward = true;
+
+		if (auto bucket = pair_lookup.Find(hash_ids(ids, false)))
+		{
+			for (auto p : *bucket)
+			{
+				if (same_ids(face_view(pairs[p].Reference), ids, false))
+				{
+					pair_idx = p;
+					break;
+				}
+			}
+		}
+
+		if (pair_idx == -1)
+		{
+			if (auto bucket = pair_lookup.Find(hash_ids(ids, true)))
+			{
+				for (auto p : *bucket)
+				{
+					if (same_ids(face_view(pairs[p].Reference), ids, true))
+					{
+						pair_idx = p;
+						forward = false;
+						break;
+					}
+				}
+			}
+		}
+
+		if (pair_idx == -1)
+		{
+			FacePair pair{ f, Idx<MeshFace>::None, true, false, -1, true };
+
+			bool all_existing = true;
+
+			for (auto id : ids)
+			{
+				all_existing &= id < first_new_id;
+			}
+
+			// a face already in the mesh must be on existing verts, in one orientation or the other
+			if (all_existing)
+			{
+				TFaceArray<Idx<MeshVert>> vert_idxs;
+
+				for (int i = 0; i < ids.Num(); i++)
+				{
+					vert_idxs.Push(Idx<MeshVert>(ids[i]));
+				}
+
+				pair.Existing = FindFaceByVertIdxs(vert_idxs);
+
+				if (!pair.Existing.Valid())
+				{
+					for (int i = 0; i < ids.Num(); i++)
+					{
+						vert_idxs[i] = Idx<MeshVert>(reverse_at(ids, i));
+					}
+
+					pair.Existing = FindFaceByVertIdxs(vert_idxs);
+					pair.ExistingForward = false;
+				}
+
+				pair.ExistingAlive = pair.Existing.Valid();
+			}
+
+			pair_idx = pairs.Num();
+			pairs.Push(pair);
+			pair_lookup.FindOrAdd(hash_ids(ids, false)).Push(pair_idx);
+		}
+
+		// replay what adding this face would do to whatever stands in the slot now
+		auto& pair = pairs[pair_idx];
+
+		if (pair.ExistingAlive)
+		{
+			if (pair.ExistingForward != forward)
+			{
+				pair.ExistingAlive = false;
+
+				TFaceArray<int> existing_ids;
+
+				for (auto vert_idx : Faces[pair.Existing].VertIdxs)
+				{
+					existing_ids.Push(vert_idx.AsInt());
+				}
+
+				face_cancelled(existing_ids);
+			}
+		}
+		else if (pair.Present != -1)
+		{
+			if (pair.PresentForward != forward)
+			{
+				face_cancelled(face_view(pair.Present));
+
+				pair.Present = -1;
+			}
+		}
+		else
+		{
+			pair.Present = f;
+			pair.PresentForward = forward;
+
+			staged_face_added(f);
+		}
+	}
+
+	// only now touch the mesh: first the existing faces that something cancelled...
+	TArray<Idx<MeshFace>> removed;
+	TArray<int> survivors;
+
+	for (const auto& pair : pairs)
+	{
+		if (pair.Existing.Valid() && !pair.ExistingAlive)
+		{
+			removed.Push(pair.Existing);
+		}
+
+		if (pair.Present != -1)
+		{
+			survivors.Push(pair.Present);
+		}
+	}
+
+	removed.Sort();
+	survivors.Sort();
+
+	for (auto face_idx : removed)
+	{
+		RemoveFace(face_idx);
 	}
 
-	TArray<PGCEdgeType> edge_type_copy(edge_types);
+	// ...then the staged faces still standing, in the order they came, with nothing left for them to cancel
+	for (auto f : survivors)
+	{
+		int start = batch.FaceStarts[f];
+		int n = batch.FaceStarts[f + 1] - start;
+		int UVGroup = batch.FaceUVGroups[f];
+
+		TFaceArray<Idx<MeshVert>> corner_verts;
+		TFaceArray<PGCEdgeType> face_edge_types;
+
+		for (int i = 0; i < n; i++)
+		{
+			corner_verts.Push(AddVert(MeshVertRaw(batch.Positions[start + i], batch.UVs[start + i]), UVGroup));
+			face_edge_types.Push(batch.EdgeTypes[start + i]);
+		}
+
+		auto vert_idxs = corner_verts;
 
-	RegularizeVertIdxs(mf.VertIdxs, &edge_type_copy);
+		RegularizeVertIdxs(vert_idxs, face_edge_types);
 
-	mf.UVGroup = UVGroup;
+		auto face_idx = AddFindFace(vert_idxs, face_edge_types, UVGroup, batch.FaceChannels[f]);
+		check(face_idx.Valid());
 
-	return AddFindFace(mf, edge_type_copy);
+		// the removals above can drop an edge that one at a time would have kept, and faces cancelled
+		// within the batch never get added at all, so the replayed types are the ones to have
+		for (int i = 0; i < n; i++)
+		{
+			int next = (i + 1) % n;
+
+			Edges[FindEdge(corner_verts[i], corner_verts[next], face_idx)].SetType
+				= edge_states[edge_key(corner_ids[start + i], corner_ids[start + next])].Type;
+		}
+	}
 }
 
-Idx<MeshVertRaw> Mesh::BakeVertex(const MeshVertRaw& mvr)
+Idx<MeshVertRaw> Mesh::BakeVertex(const MeshVertRaw& mvr, const FVector* normal)
 {
-	auto baked_vert_idx = FindBakedVert(mvr);
+	auto baked_vert_idx = FindBakedVert(mvr, normal);
 
 	if (baked_vert_idx.Valid())
 		return baked_vert_idx;
 
 	BakedVerts.Push(mvr);
+	BakedNormals.Push(normal ? *normal : FVector{ 0, 0, 0 });
+	BakedVertLookup.Add(mvr.Hash(), Idx<MeshVertRaw>(BakedVerts.Num() - 1));
 
 	return Idx<MeshVertRaw>(BakedVerts.Num() - 1);
 }
 
-Idx<MeshVertRaw> Mesh::FindBakedVert(const MeshVertRaw& mvr) const
+Idx<MeshVertRaw> Mesh::FindBakedVert(const MeshVertRaw& mvr, const FVector* normal) const
 {
-	for (int i = 0; i < BakedVerts.Num(); i++)
+	auto bucket = BakedVertLookup.Find(mvr.Hash());
+
+	if (bucket)
 	{
-		if (BakedVerts[i] == mvr)
-			return Idx<MeshVertRaw>(i);
+		for (auto i : *bucket)
+		{
+			if (BakedVerts[i.AsInt()] == mvr && (!normal || BakedNormals[i.AsInt()] == *normal))
+				return i;
+		}
 	}
 
 	return Idx<MeshVertRaw>::None;
 }
 
-void Mesh::BakeChannelsIntoFaceChannel(FPGCMeshResult& mesh, bool insideOut, PGCDebugEdgeType debugEdges, int from_channel, int to_face_channel)
+void Mesh::BakeChannelsIntoFaceChannel(const FlatMeshView& flat, FPGCMeshResult& mesh, bool insideOut, PGCDebugEdgeType debugEdges, int from_channel, int to_face_channel,
+	const TArray<FVector>* corner_normals)
 {
-	check(BakedFaces.Num() == 0);
-
 	if (mesh.FaceChannels.Num() < to_face_channel + 1)
 	{
 		mesh.FaceChannels.AddDefaulted(to_face_channel + 1 - mesh.FaceChannels.Num());
 	}
 
-	for (const auto& f : Faces)
+	check(!corner_normals || corner_normals->Num() == flat.FaceVerts.Num());
+
+	// the baked vert of each corner of the faces we are taking, in the same rows as flat.FaceVerts
+	// (faces we aren't taking get empty rows)
+	TArray<int> baked_face_starts;
+	TArray<Idx<MeshVertRaw>> baked_face_verts;
+
+	baked_face_starts.Reserve(flat.NumFaces() + 1);
+
+	for (Idx<MeshFace> face_idx{ 0 }; face_idx.AsInt() < flat.NumFaces(); face_idx++)
 	{
-		if (from_channel == -1 || f.Channel == from_channel)
+		baked_face_starts.Push(baked_face_verts.Num());
+
+		if (from_channel == -1 || flat.FaceChannels[face_idx.AsInt()] == from_channel)
 		{
-			MeshFaceRaw mfr;
+			auto verts = flat.FaceVertsOf(face_idx);
+			auto uvs = flat.FaceUVsOf(face_idx);
 
-			for (auto vert_idx : f.VertIdxs)
+			for (int j = 0; j < verts.Num(); j++)
 			{
-				mfr.VertIdxs.Push(BakeVertex(Vertices[vert_idx].ToMeshVertRaw(f.UVGroup)));
-			}
+				MeshVertRaw mvr{ flat.Positions[verts[j].AsInt()], uvs[j] };
+
+				if (corner_normals)
+				{
+					auto normal = (*corner_normals)[flat.FaceVertStarts[face_idx.AsInt()] + j];
+
+					if (insideOut)
+					{
+						normal = -normal;
+					}
 
-			BakedFaces.Push(mfr);
+					baked_face_verts.Push(BakeVertex(mvr, &normal));
+				}
+				else
+				{
+					baked_face_verts.Push(BakeVertex(mvr));
+				}
+			}
 		}
 	}
 
+	baked_face_starts.Push(baked_face_verts.Num());
+
 	// we are sometimes accumulating BakedVerts over several calls to this function
 	// (and we require 1-to-1 between BakedVerts indices and mesh.Verts and mesh.UVs indices)
 	// so put over any that are new
+	if (corner_normals)
+	{
+		mesh.Normals.SetNumZeroed(mesh.Verts.Num());
+	}
+
 	for (int i = mesh.Verts.Num(); i < BakedVerts.Num(); i++)
 	{
 		const auto& v = BakedVerts[i];
 
 		mesh.Verts.Push(v.Pos);
 		mesh.UVs.Push(v.UV);
+
+		if (corner_normals)
+		{
+			mesh.Normals.Push(BakedNormals[i]);
+		}
 	}
 
-	for (auto f : BakedFaces)
+	for (int i = 0; i < flat.NumFaces(); i++)
 	{
-		check(f.VertIdxs.Num() > 2);
+		auto start = baked_face_starts[i];
+		auto n = baked_face_starts[i + 1] - start;
 
-		auto common_vert = f.VertIdxs[0];
-		auto prev_vert = f.VertIdxs[1];
-		for (int i = 2; i < f.VertIdxs.Num(); i++)
+		if (n == 0)
+			continue;
+
+		check(n > 2);
+
+		auto common_vert = baked_face_verts[start];
+		auto prev_vert = baked_face_verts[start + 1];
+		for (int j = 2; j < n; j++)
 		{
-			auto this_vert = f.VertIdxs[i];
+			auto this_vert = baked_face_verts[start + j];
 
 			if (insideOut)
 			{
@@ -828,132 +2587,137 @@ void Mesh::BakeChannelsIntoFaceChannel(FPGCMeshResult& mesh, bool insideOut, PGC
 		}
 	}
 
+	// UV group doesn't matter as we won't be using UVs on the edge drawing anyway
+	auto bake_edge_vert = [this, &flat](Idx<MeshVert> vert_idx) {
+		return BakeVertex(MeshVertRaw{ flat.Positions[vert_idx.AsInt()], flat.VertFirstUVs[vert_idx.AsInt()] }).AsInt();
+	};
+
 	if (debugEdges == PGCDebugEdgeType::Effective)
 	{
-		for (const auto& edge : Edges)
+		for (int i = 0; i < flat.NumEdges(); i++)
 		{
-			check(edge.EffectiveType == PGCEdgeType::Sharp || edge.EffectiveType == PGCEdgeType::Rounded);
+			auto type = flat.EdgeEffectiveTypes[i];
 
-			// UV group doesn't matter as we won't be using UVs on the edge drawing anyway
-			auto vs = BakeVertex(Vertices[edge.StartVertIdx].ToMeshVertRaw(-1));
-			auto ve = BakeVertex(Vertices[edge.EndVertIdx].ToMeshVertRaw(-1));
+			check(type == PGCEdgeType::Sharp || type == PGCEdgeType::Rounded);
 
-			if (edge.EffectiveType == PGCEdgeType::Rounded)
+			auto vs = bake_edge_vert(flat.EdgeStartVerts[i]);
+			auto ve = bake_edge_vert(flat.EdgeEndVerts[i]);
+
+			if (type == PGCEdgeType::Rounded)
 			{
-				mesh.RoundedEdges.Push({ vs.AsInt(), ve.AsInt() });
+				mesh.RoundedEdges.Push({ vs, ve });
 			}
 			else
 			{
-				mesh.SharpEdges.Push({ vs.AsInt(), ve.AsInt() });
+				mesh.SharpEdges.Push({ vs, ve });
 			}
 		}
 	}
 	else if (debugEdges == PGCDebugEdgeType::Set)
 	{
-		for (const auto& edge : Edges)
+		for (int i = 0; i < flat.NumEdges(); i++)
 		{
-			check(edge.SetType != PGCEdgeType::Unset);
+			auto type = flat.EdgeSetTypes[i];
+
+			check(type != PGCEdgeType::Unset);
 
-			// UV group doesn't matter as we won't be using UVs on the edge drawing anyway
-			auto vs = BakeVertex(Vertices[edge.StartVertIdx].ToMeshVertRaw(-1));
-			auto ve = BakeVertex(Vertices[edge.EndVertIdx].ToMeshVertRaw(-1));
+			auto vs = bake_edge_vert(flat.EdgeStartVerts[i]);
+			auto ve = bake_edge_vert(flat.EdgeEndVerts[i]);
 
-			if (edge.SetType == PGCEdgeType::Rounded)
+			if (type == PGCEdgeType::Rounded)
 			{
-				mesh.RoundedEdges.Push({ vs.AsInt(), ve.AsInt() });
+				mesh.RoundedEdges.Push({ vs, ve });
 			}
-			else if (edge.SetType == PGCEdgeType::Sharp)
+			else if (type == PGCEdgeType::Sharp)
 			{
-				mesh.SharpEdges.Push({ vs.AsInt(), ve.AsInt() });
+				mesh.SharpEdges.Push({ vs, ve });
 			}
 			else
 			{
-				mesh.AutoEdges.Push({ vs.AsInt(), ve.AsInt() });
+				mesh.AutoEdges.Push({ vs, ve });
 			}
 		}
 	}
-
-	BakedFaces.Empty();
 }
 
-TSharedRef<Mesh> Mesh::SplitSharedVerts()
+void Mesh::SplitSharedVerts()
 {
-	auto ret = MakeShared<Mesh>(*this);
-
-	ret->Clean = true;
-
-	for (Idx<MeshVert> i{ 0 }; i < Vertices.Num(); i++)
-	{
-		TArray<TArray<Idx<MeshFace>>> pyramids = FindPyramids(i);
-
-		if (pyramids.Num() > 1)
-		{
-			ret->SplitPyramids(pyramids, i);
-		}
-	}
-
-	return ret;
-}
+	// split verts keep the UVs of the faces that go with them, and get arrays of their own
+	MoveCornerUVsToVerts();
+	UnpackAdjacency();
 
-TArray<TArray<Idx<MeshFace>>> Mesh::FindPyramids(Idx<MeshVert> vert_idx)
-{
-	auto& v = Vertices[vert_idx];
+	// when we come back to a face we've already walked, in the pyramid of this vert
+	TArray<int> face_walked_from;
+	face_walked_from.Init(-1, Faces.Num().AsInt());
 
-	TSet<Idx<MeshFace>> all_faces{ v.FaceIdxs };
+	// the pyramids of one vert, one after the other, reused for each vert
+	TArray<Idx<MeshFace>> pyramid_faces;
+	TArray<int> pyramid_starts;
 
-	TArray<TArray<Idx<MeshFace>>> ret;
+	// the verts we split off go on the end and are only in one pyramid each
+	auto num_verts = Vertices.Num();
 
-	while (all_faces.Num())
+	for (Idx<MeshVert> vert_idx{ 0 }; vert_idx < num_verts; vert_idx++)
 	{
-		auto first_face{ *all_faces.CreateIterator() };
-		auto curr_face = first_face;
+		pyramid_faces.Reset();
+		pyramid_starts.Reset();
 
-		auto prev_edge = Idx<MeshEdge>::None;
+		// walk round from each face we haven't reached yet, taking them in the order the vert has them
+		// so that the first pyramid is the one that stays on this vert
+		for (auto first_face : Vertices[vert_idx].FaceIdxs)
+		{
+			if (face_walked_from[first_face.AsInt()] == vert_idx.AsInt())
+				continue;
 
-		ret.Push(TArray<Idx<MeshFace>>());
+			pyramid_starts.Push(pyramid_faces.Num());
 
-		do {
-			ret.Last().Push(curr_face);
+			auto curr_face = first_face;
+			auto prev_edge = Idx<MeshEdge>::None;
 
-			check(all_faces.Contains(curr_face));
-			all_faces.Remove(curr_face);
+			do {
+				check(face_walked_from[curr_face.AsInt()] != vert_idx.AsInt());
 
-			auto f = Faces[curr_face];
+				face_walked_from[curr_face.AsInt()] = vert_idx.AsInt();
+				pyramid_faces.Push(curr_face);
 
-			auto curr_edge = Idx<MeshEdge>::None;
+				auto curr_edge = Idx<MeshEdge>::None;
 
-			for (const auto& e : f.EdgeIdxs)
-			{
-				if (e != prev_edge && Edges[e].Contains(vert_idx))
+				for (auto e : Faces[curr_face].EdgeIdxs)
 				{
-					curr_edge = e;
-					break;
+					if (e != prev_edge && Edges[e].Contains(vert_idx))
+					{
+						curr_edge = e;
+						break;
+					}
 				}
-			}
 
-			check(curr_edge.Valid());
+				check(curr_edge.Valid());
 
-			prev_edge = curr_edge;
+				prev_edge = curr_edge;
+
+				curr_face = Edges[curr_edge].OtherFace(curr_face);
+			} while (curr_face != first_face);
+		}
 
-			curr_face = Edges[curr_edge].OtherFace(curr_face);
+		pyramid_starts.Push(pyramid_faces.Num());
 
-			// find the two edges 
-		} while (curr_face != first_face);
+		// leave the first pyramid on the vert we already have
+		for (int i = 1; i < pyramid_starts.Num() - 1; i++)
+		{
+			SplitPyramid(vert_idx, MakeArrayView(&pyramid_faces[pyramid_starts[i]], pyramid_starts[i + 1] - pyramid_starts[i]));
+		}
 	}
 
-	return ret;
+	Clean = true;
+
+	CheckConsistent(true);
 }
 
-void Mesh::SplitPyramids(const TArray<TArray<Idx<MeshFace>>>& pyramids, Idx<MeshVert> vert_idx)
+void Mesh::SplitPyramid(Idx<MeshVert> vert_idx, TArrayView<const Idx<MeshFace>> pyramid)
 {
 	// splitting pyramids generates duplicate vertices, which would break various vertex searches
 	// HOWEVER we only do this immediately before a subdivide and that will renders the duplicates unique again
-
-	// leave the first pyramid on the vert we already have
-	for (int i = 1; i < pyramids.Num(); i++)
 	{
-		auto& pyramid = pyramids[i];
-
 		// copy the vert
 		{
 			MeshVert temp;
@@ -961,6 +2725,10 @@ void Mesh::SplitPyramids(const TArray<TArray<Idx<MeshFace>>>& pyramids, Idx<Mesh
 			Vertices.Push(temp);
 		}
 		auto new_vert_idx = Vertices.LastIdx();
+		VertLookup.Add(HashPosition(Vertices[new_vert_idx].Pos), new_vert_idx);
+
+		TouchVert(vert_idx);
+		TouchVert(new_vert_idx);
 
 		auto& vert = Vertices[new_vert_idx];
 
@@ -970,6 +2738,8 @@ void Mesh::SplitPyramids(const TArray<TArray<Idx<MeshFace>>>& pyramids, Idx<Mesh
 		{
 			auto& face = Faces[face_idx];
 
+			FaceLookup.Remove(HashIdxSequence(face.VertIdxs), face_idx);
+
 			old_vert.FaceIdxs.Remove(face_idx);
 			vert.FaceIdxs.Push(face_idx);
 			vert.UVs.Add(face.UVGroup) = old_vert.UVs[face.UVGroup];
@@ -987,7 +2757,11 @@ void Mesh::SplitPyramids(const TArray<TArray<Idx<MeshFace>>>& pyramids, Idx<Mesh
 
 			check(found);
 
-			RegularizeVertIdxs(face.VertIdxs, nullptr);
+			RegularizeVertIdxs(face.VertIdxs, {});
+
+			FaceLookup.Add(HashIdxSequence(face.VertIdxs), face_idx);
+
+			TouchFace(face_idx);
 		}
 
 		int edges_found = 0;
@@ -1004,6 +2778,8 @@ void Mesh::SplitPyramids(const TArray<TArray<Idx<MeshFace>>>& pyramids, Idx<Mesh
 			{
 				edges_found++;
 
+				EdgeLookup.Remove(HashIdxPair(edge.StartVertIdx, edge.EndVertIdx), edge_idx);
+
 				if (edge.StartVertIdx == vert_idx)
 				{
 					old_vert.EdgeIdxs.Remove(edge_idx);
@@ -1020,6 +2796,10 @@ void Mesh::SplitPyramids(const TArray<TArray<Idx<MeshFace>>>& pyramids, Idx<Mesh
 
 					edge.EndVertIdx = new_vert_idx;
 				}
+
+				EdgeLookup.Add(HashIdxPair(edge.StartVertIdx, edge.EndVertIdx), edge_idx);
+
+				TouchEdge(edge_idx);
 			}
 			else
 			{
@@ -1029,12 +2809,10 @@ void Mesh::SplitPyramids(const TArray<TArray<Idx<MeshFace>>>& pyramids, Idx<Mesh
 
 		// we expect the same number of edges and faces in the pyramid
 		check(edges_found == pyramid.Num());
-
-		CheckConsistent(true);
 	}
 }
 
-void Mesh::RegularizeVertIdxs(TArray<Idx<MeshVert>>& vert_idxs, TArray<PGCEdgeType>* edge_types)
+void Mesh::RegularizeVertIdxs(TArrayView<Idx<MeshVert>> vert_idxs, TArrayView<PGCEdgeType> edge_types)
 {
 	// sort the array so that the lowest index is first
 	// allows us to search for faces by verts
@@ -1054,53 +2832,72 @@ void Mesh::RegularizeVertIdxs(TArray<Idx<MeshVert>>& vert_idxs, TArray<PGCEdgeTy
 	if (pos == 0)
 		return;
 
-	TArray<Idx<MeshVert>> temp;
-	TArray<PGCEdgeType> temp2;
-
-	for (int i = 0; i < vert_idxs.Num(); i++)
-	{
-		temp.Push(vert_idxs[pos]);
-		if (edge_types)
-		{
-			temp2.Push((*edge_types)[pos]);
-		}
+	// rotating left by "pos" is reversing the two parts and then the whole
+	auto rotate = [pos](auto view) {
+		Algo::Reverse(view.GetData(), pos);
+		Algo::Reverse(view.GetData() + pos, view.Num() - pos);
+		Algo::Reverse(view.GetData(), view.Num());
+	};
 
-		pos = (pos + 1) % vert_idxs.Num();
-	}
+	rotate(vert_idxs);
 
-	if (edge_types)
+	if (edge_types.Num())
 	{
-		*edge_types = std::move(temp2);
-	}
+		check(edge_types.Num() == vert_idxs.Num());
 
-	vert_idxs = std::move(temp);
+		rotate(edge_types);
+	}
 }
 
-Idx<MeshFace> Mesh::AddFindFace(MeshFace face, const TArray<PGCEdgeType>& edge_types)
+Idx<MeshFace> Mesh::AddFindFace(TArrayView<const Idx<MeshVert>> vert_idxs, TArrayView<const PGCEdgeType> edge_types, int UVGroup, int channel)
 {
+	UnpackAdjacency();
+
+	auto n = vert_idxs.Num();
+
 	// enough verts?
-	check(face.VertIdxs.Num() > 2);
-	// all verts unique?
-	check(TSet<Idx<MeshVert>>{face.VertIdxs}.Num() == face.VertIdxs.Num());
+	check(n > 2);
+	check(edge_types.Num() == n);
+
+#if DO_CHECK
+	// all verts unique, and regularized?
+	for (int i = 0; i < n; i++)
+	{
+		check(i == 0 || vert_idxs[0] < vert_idxs[i]);
+
+		for (int j = i + 1; j < n; j++)
+		{
+			check(vert_idxs[i] != vert_idxs[j]);
+		}
+	}
+#endif
 
-	if (CancelExistingReverseFace(face.VertIdxs))
+	if (CancelExistingReverseFace(vert_idxs))
 		return Idx<MeshFace>::None;
 
-	auto face_idx = FindFaceByVertIdxs(face.VertIdxs);
+	auto face_idx = FindFaceByVertIdxs(vert_idxs);
 
 	if (face_idx != Idx<MeshFace>::None)
 	{
 		return face_idx;
 	}
 
-	auto prev_vert = face.VertIdxs.Last();
+	face_idx = Faces.Num();
+
+	MeshFace face(channel);
+
+	face.UVGroup = UVGroup;
+	face.VertIdxs.Append(vert_idxs.GetData(), n);
+	face.EdgeIdxs.Reserve(n);
+
+	auto prev_vert = vert_idxs.Last();
 	auto prev_edge_type = edge_types.Last();
 
-	for (int i = 0; i < face.VertIdxs.Num(); i++)
+	for (int i = 0; i < n; i++)
 	{
-		auto vert_idx = face.VertIdxs[i];
+		auto vert_idx = vert_idxs[i];
 
-		Vertices[vert_idx].FaceIdxs.Push(Faces.Num());
+		Vertices[vert_idx].FaceIdxs.Push(face_idx);
 
 		auto edge_idx = AddFindEdge(prev_vert, vert_idx);
 
@@ -1109,15 +2906,21 @@ Idx<MeshFace> Mesh::AddFindFace(MeshFace face, const TArray<PGCEdgeType>& edge_t
 		// Have carefully arranged these edge_types into the same order as the verts.
 		// Sharp edges from either existing or incoming edges take precedence.
 		Edges[edge_idx].SetType = MergeEdgeTypes(Edges[edge_idx].SetType, prev_edge_type);
-		Edges[edge_idx].AddFace(Faces.Num(), prev_vert);
+		Edges[edge_idx].AddFace(face_idx, prev_vert);
+
+		TouchVert(vert_idx);
+		TouchEdge(edge_idx);
 
 		prev_vert = vert_idx;
 		prev_edge_type = edge_types[i];
 	}
 
-	Faces.Push(face);
+	FaceLookup.Add(HashIdxSequence(vert_idxs), face_idx);
+	Faces.Push(MoveTemp(face));
 
-	return Faces.LastIdx();
+	TouchFace(face_idx);
+
+	return face_idx;
 }
 
 
@@ -1143,7 +2946,7 @@ Idx<MeshFace> Mesh::AddFindFace(MeshFace face, const TArray<PGCEdgeType>& edge_t
 
 TSharedPtr<Mesh> Mesh::Triangularise()
 {
-	ResolveEffectiveEdgeTypes();
+	Compact();
 
 	check(Clean);
 
@@ -1155,21 +2958,24 @@ TSharedPtr<Mesh> Mesh::Triangularise()
 
 		MeshVertRaw fv;
 
-		for (auto v : f.VertIdxs)
+		for (int i = 0; i < f.VertIdxs.Num(); i++)
 		{
-			fv += Vertices[v].ToMeshVertRaw(f.UVGroup);
+			fv += CornerVertRaw(f, i);
 		}
 
 		fv = fv / f.VertIdxs.Num();
 
+		auto prev_corner = f.VertIdxs.Num() - 1;
 		auto prev_vert = f.VertIdxs.Last();
 
-		for (auto v : f.VertIdxs)
+		for (int i = 0; i < f.VertIdxs.Num(); i++)
 		{
+			auto v = f.VertIdxs[i];
+
 			check(prev_vert != v);
 
-			const MeshVertRaw& from = Vertices[prev_vert].ToMeshVertRaw(f.UVGroup);
-			const MeshVertRaw& to = Vertices[v].ToMeshVertRaw(f.UVGroup);
+			const MeshVertRaw& from = CornerVertRaw(f, prev_corner);
+			const MeshVertRaw& to = CornerVertRaw(f, i);
 
 			check(!(from == to));
 			check(!(from == fv));
@@ -1180,11 +2986,12 @@ TSharedPtr<Mesh> Mesh::Triangularise()
 			check(edge_idx.Valid());
 
 			// edges introduced in the middle of what was a single (roughly planar) face should be Rounded, I guess...
-			ret->AddFaceFromRawVerts({ from, to, fv },
-				f.UVGroup,
-				{ Edges[edge_idx].SetType, PGCEdgeType::Rounded, PGCEdgeType::Rounded },
-				f.Channel);
+			MeshVertRaw tri_verts[3]{ from, to, fv };
+			PGCEdgeType tri_edge_types[3]{ Edges[edge_idx].SetType, PGCEdgeType::Rounded, PGCEdgeType::Rounded };
+
+			ret->AddFaceFromRawVerts(MakeArrayView(tri_verts), f.UVGroup, MakeArrayView(tri_edge_types), f.Channel);
 
+			prev_corner = i;
 			prev_vert = v;
 		}
 	}
@@ -1195,123 +3002,538 @@ TSharedPtr<Mesh> Mesh::Triangularise()
 	return ret;
 }
 
-TSharedPtr<Mesh> Mesh::Subdivide()
+TSharedPtr<Mesh> Mesh::Subdivide(bool parallel)
 {
+	Compact();
+
 	CheckConsistent(true);
 
-	TSharedRef<Mesh> work_on = AsShared();
+	// if we've had any geometry added manually, we're not clean, and PrepareForSharing must fix that up first
+	// (not done here, as we can be a mesh others are reading, such as one already in the cache)
+	// if we were generated procedurally (say by SplitSharedVerts or returned from here), then we're clean already
+	check(Clean);
+
+	return SubdivideInner(parallel);
+}
+
+TSharedPtr<Mesh> Mesh::SubdivideInner(bool parallel)
+{
+	check(Clean);
+
+	auto ret = MakeShared<Mesh>(CosAutoSharpAngle);
+
+	FlatMesh flat(*this);
+
+	ResolveEffectiveEdgeTypes(flat);
+
+	// scratch for this level only, freed as soon as the new mesh is built
+	SubdivisionPoints points;
+
+	CalcSubdivisionPoints(flat, points, parallel);
+
+	// adding faces by position merges new verts that land in the same place (e.g. the corners of split pyramids)
+	// and the direct build doesn't do that, so when that can happen we take the slow way
+	if (SubdivisionPointsUnique(points))
+	{
+		BuildSubdivisionDirect(flat, points, *ret, parallel);
+	}
+	else
+	{
+		BuildSubdivisionBySearch(flat, points, *ret);
+	}
+
+	ret->CheckConsistent(true);
+
+	return ret;
+}
+
+void Mesh::CalcSubdivisionPoints(const FlatMesh& flat, SubdivisionPoints& points, bool parallel)
+{
+	points.VertPoints.SetNum(flat.NumVerts());
+	points.EdgePoints.SetNum(flat.NumEdges());
+	points.FacePoints.SetNum(flat.NumFaces());
+
+	// each of these loops only writes the element it is on, so can be split across threads,
+	// but each loop reads what the one before wrote
+	ParallelFor(flat.NumFaces(), [&flat, &points](int32 i)
+	{
+		Idx<MeshFace> face_idx{ i };
+		auto verts = flat.FaceVertsOf(face_idx);
+
+		FVector fv{ 0, 0, 0 };
+
+		for (auto v : verts)
+		{
+			fv += flat.Positions[v.AsInt()];
+		}
+
+		// UVs are worked out per-corner when the new faces are built
+		points.FacePoints[i] = fv / verts.Num();
+	}, !parallel);
+
+	ParallelFor(flat.NumEdges(), [&flat, &points](int32 i)
+	{
+		const auto& start_pos = flat.Positions[flat.EdgeStartVerts[i].AsInt()];
+		const auto& end_pos = flat.Positions[flat.EdgeEndVerts[i].AsInt()];
+
+		if (flat.EdgeEffectiveTypes[i] == PGCEdgeType::Rounded)
+		{
+			points.EdgePoints[i] = (start_pos + end_pos
+				+ points.FacePoints[flat.EdgeForwardFaces[i].AsInt()] + points.FacePoints[flat.EdgeBackwardsFaces[i].AsInt()]) / 4;
+		}
+		else
+		{
+			points.EdgePoints[i] = (start_pos + end_pos) / 2;
+		}
+	}, !parallel);
+
+	ParallelFor(flat.NumVerts(), [&flat, &points](int32 i)
+	{
+		Idx<MeshVert> vert_idx{ i };
+		const auto& pos = flat.Positions[i];
+
+		// we only need the other ends of the first two
+		int num_sharp = 0;
+		Idx<MeshVert> sharp_other_verts[2];
+
+		for (auto edge_idx : flat.VertEdgesOf(vert_idx))
+		{
+			if (flat.EdgeEffectiveTypes[edge_idx.AsInt()] == PGCEdgeType::Sharp)
+			{
+				if (num_sharp < 2)
+				{
+					auto start_vert_idx = flat.EdgeStartVerts[edge_idx.AsInt()];
+
+					sharp_other_verts[num_sharp] = start_vert_idx == vert_idx ? flat.EdgeEndVerts[edge_idx.AsInt()] : start_vert_idx;
+				}
+
+				num_sharp++;
+			}
+		}
+
+		if (num_sharp < 2)
+		{
+			auto faces = flat.VertFacesOf(vert_idx);
+			auto n = faces.Num();
+
+			FVector F{ 0, 0, 0 };
+
+			for (auto face_idx : faces)
+			{
+				F += points.FacePoints[face_idx.AsInt()];
+			}
+
+			F = F / n;
+
+			FVector R{ 0, 0, 0 };
+
+			for (auto edge_idx : flat.VertEdgesOf(vert_idx))
+			{
+				R += points.EdgePoints[edge_idx.AsInt()];
+			}
+
+			// assuming the number of faces == the number of edges, which is true for closed meshes, may need a special rule for the edges if this is ever not true...
+			R = R / n;
+
+			points.VertPoints[i] = (pos * (n - 3) + R * 2 + F) / n;
+		}
+		else if (num_sharp == 2)
+		{
+			const auto& ov0 = flat.Positions[sharp_other_verts[0].AsInt()];
+			const auto& ov1 = flat.Positions[sharp_other_verts[1].AsInt()];
+
+			points.VertPoints[i] = pos * 0.75f + ov0 * 0.125f + ov1 * 0.125f;
+		}
+		else
+		{
+			points.VertPoints[i] = pos;
+		}
+	}, !parallel);
+}
+
+bool Mesh::SubdivisionPointsUnique(const SubdivisionPoints& points)
+{
+	TArray<FVector> all_points;
+
+	all_points.Reserve(points.VertPoints.Num() + points.EdgePoints.Num() + points.FacePoints.Num());
+	all_points.Append(points.VertPoints);
+	all_points.Append(points.EdgePoints);
+	all_points.Append(points.FacePoints);
+
+	return PointsUnique(all_points);
+}
+
+bool Mesh::PointsUnique(const TArray<FVector>& points)
+{
+	THashIdxLookup<FVector> seen;
+
+	for (int i = 0; i < points.Num(); i++)
+	{
+		// NaN never compares equal, so the search would give it a new vert every time it was used
+		if (points[i].ContainsNaN())
+			return false;
+
+		auto hash = HashPosition(points[i]);
+		auto bucket = seen.Find(hash);
+
+		if (bucket)
+		{
+			for (auto j : *bucket)
+			{
+				if (points[j.AsInt()] == points[i])
+					return false;
+			}
+		}
+
+		seen.Add(hash, Idx<FVector>(i));
+	}
+
+	return true;
+}
+
+void Mesh::BuildSubdivisionDirect(const FlatMesh& flat, const SubdivisionPoints& points, Mesh& ret, bool parallel) const
+{
+	// the new vert made from each old vert, edge and face
+	TArray<Idx<MeshVert>> vert_new_vert;
+	TArray<Idx<MeshVert>> edge_new_vert;
+	TArray<Idx<MeshVert>> face_new_vert;
+
+	vert_new_vert.Init(Idx<MeshVert>::None, Vertices.Num().AsInt());
+	edge_new_vert.Init(Idx<MeshVert>::None, Edges.Num().AsInt());
+	face_new_vert.Init(Idx<MeshVert>::None, Faces.Num().AsInt());
+
+	// each old edge gives four new ones, [0] and [1] are its halves at the start and end verts,
+	// [2] and [3] join its new vert to the new verts of the forward and backwards faces
+	TArray<Idx<MeshEdge>> edge_new_edges;
+
+	edge_new_edges.Init(Idx<MeshEdge>::None, Edges.Num().AsInt() * 4);
+
+	// each old face gives one new face per corner, numbered in order
+	TArray<int> face_first_new_face;
+	int num_new_faces = 0;
+
+	for (const auto& f : Faces)
+	{
+		face_first_new_face.Push(num_new_faces);
+		num_new_faces += f.VertIdxs.Num();
+	}
+
+	// VertIdxs and EdgeIdxs of each new face, four of each
+	TArray<Idx<MeshVert>> new_face_verts;
+	TArray<Idx<MeshEdge>> new_face_edges;
+
+	new_face_verts.Reserve(num_new_faces * 4);
+	new_face_edges.Reserve(num_new_faces * 4);
+
+	int num_new_verts = 0;
+
+	// numbering, this has to be serial, and in the same order as BuildSubdivisionBySearch would meet things
+	// because indices are handed out as things are first used
+	// (the edges are complete after this, as they hold no arrays, and the merging of their types doesn't depend on order)
+	for (Idx<MeshFace> face_idx{ 0 }; face_idx < Faces.Num(); face_idx++)
+	{
+		auto verts = flat.FaceVertsOf(face_idx);
+		auto edges = flat.FaceEdgesOf(face_idx);
+		auto n = verts.Num();
+
+		auto number_vert = [&num_new_verts](Idx<MeshVert>& new_vert_idx) {
+			if (!new_vert_idx.Valid())
+			{
+				new_vert_idx = Idx<MeshVert>(num_new_verts++);
+			}
+
+			return new_vert_idx;
+		};
+
+		for (int i = 0; i < n; i++)
+		{
+			auto vert_idx = verts[i];
+
+			// flat has the edges lined up with the verts, so no need to search
+			auto prev_edge_idx = edges[(i + n - 1) % n];
+			auto next_edge_idx = edges[i];
+
+			const auto& prev_edge = Edges[prev_edge_idx];
+			const auto& next_edge = Edges[next_edge_idx];
+
+			Idx<MeshVert> quad[4];
+			quad[0] = number_vert(vert_new_vert[vert_idx.AsInt()]);
+			quad[1] = number_vert(edge_new_vert[next_edge_idx.AsInt()]);
+			quad[2] = number_vert(face_new_vert[face_idx.AsInt()]);
+			quad[3] = number_vert(edge_new_vert[prev_edge_idx.AsInt()]);
+
+			// quad_edges[k] runs from quad[k] to quad[k + 1]
+			int quad_edges[4] {
+				next_edge_idx.AsInt() * 4 + (next_edge.StartVertIdx == vert_idx ? 0 : 1),
+				next_edge_idx.AsInt() * 4 + (next_edge.ForwardFaceIdx == face_idx ? 2 : 3),
+				prev_edge_idx.AsInt() * 4 + (prev_edge.ForwardFaceIdx == face_idx ? 2 : 3),
+				prev_edge_idx.AsInt() * 4 + (prev_edge.StartVertIdx == vert_idx ? 0 : 1),
+			};
+
+			// edges introduced in the middle of what was a single (roughly planar) face should be Rounded, I guess...
+			PGCEdgeType quad_edge_types[4] {
+				next_edge.SetType,
+				PGCEdgeType::Rounded,
+				PGCEdgeType::Rounded,
+				prev_edge.SetType,
+			};
+
+			// what RegularizeVertIdxs would do
+			int first = 0;
+
+			for (int j = 1; j < 4; j++)
+			{
+				if (quad[j] < quad[first])
+				{
+					first = j;
+				}
+			}
+
+			Idx<MeshFace> new_face_idx{ face_first_new_face[face_idx.AsInt()] + i };
+
+			for (int j = 0; j < 4; j++)
+			{
+				auto k = (first + j + 3) % 4;
+				auto from_vert_idx = quad[k];
+				auto to_vert_idx = quad[(k + 1) % 4];
+
+				auto& new_edge_idx = edge_new_edges[quad_edges[k]];
+
+				if (!new_edge_idx.Valid())
+				{
+					MeshEdge ne;
+					ne.StartVertIdx = from_vert_idx;
+					ne.EndVertIdx = to_vert_idx;
+					ret.Edges.Push(ne);
+
+					new_edge_idx = ret.Edges.LastIdx();
+				}
+
+				auto& edge = ret.Edges[new_edge_idx];
+
+				edge.SetType = MergeEdgeTypes(edge.SetType, quad_edge_types[k]);
+				edge.AddFace(new_face_idx, from_vert_idx);
+
+				new_face_verts.Push(to_vert_idx);
+				new_face_edges.Push(new_edge_idx);
+			}
+		}
+	}
+
+	ret.Faces.SetNum(Idx<MeshFace>(num_new_faces));
+	ret.Vertices.SetNum(Idx<MeshVert>(num_new_verts));
+
+	// the new faces keep their UVs, the new verts get no maps
+	ret.UVsInCorners = true;
+
+	// from here on each loop only writes to new elements that belong to the old element it is on
+
+	ParallelFor(Faces.Num().AsInt(), [&](int32 i)
+	{
+		Idx<MeshFace> face_idx{ i };
+		auto verts = flat.FaceVertsOf(face_idx);
+		auto centre_uv = flat.FaceCentreUV(face_idx);
+
+		for (int j = 0; j < verts.Num(); j++)
+		{
+			auto new_face_idx = face_first_new_face[i] + j;
+			auto& face = ret.Faces[Idx<MeshFace>(new_face_idx)];
+
+			face.VertIdxs.Append(&new_face_verts[new_face_idx * 4], 4);
+			face.EdgeIdxs.Append(&new_face_edges[new_face_idx * 4], 4);
+			face.UVGroup = flat.FaceUVGroups[i];
+			face.Channel = flat.FaceChannels[i];
+
+			FVector2D quad_uvs[4];
+			SubdivisionQuadUVs(flat.FaceUVsOf(face_idx), j, centre_uv, quad_uvs);
+
+			// the verts were rotated to put the lowest first, rotate the UVs the same way
+			auto rotation = face.VertIdxs.Find(vert_new_vert[verts[j].AsInt()]);
+			check(rotation != INDEX_NONE);
+
+			face.CornerUVs.SetNum(4);
+
+			for (int k = 0; k < 4; k++)
+			{
+				face.CornerUVs[(rotation + k) % 4] = quad_uvs[k];
+			}
+		}
+	}, !parallel);
+
+	// the new verts' edges and faces go straight into packed rows, so each one's count is needed first
+	// vert points keep the old vert's, edge points always have four, face points one per corner of the old face
+	ret.AdjacencyPacked = true;
+
+	{
+		TArray<int> num_edge_idxs;
+		TArray<int> num_face_idxs;
+
+		num_edge_idxs.SetNum(num_new_verts);
+		num_face_idxs.SetNum(num_new_verts);
+
+		for (Idx<MeshVert> vert_idx{ 0 }; vert_idx < Vertices.Num(); vert_idx++)
+		{
+			auto new_vert_idx = vert_new_vert[vert_idx.AsInt()];
+
+			if (new_vert_idx.Valid())
+			{
+				num_edge_idxs[new_vert_idx.AsInt()] = flat.VertEdgesOf(vert_idx).Num();
+				num_face_idxs[new_vert_idx.AsInt()] = flat.VertFacesOf(vert_idx).Num();
+			}
+		}
+
+		for (auto new_vert_idx : edge_new_vert)
+		{
+			if (new_vert_idx.Valid())
+			{
+				num_edge_idxs[new_vert_idx.AsInt()] = 4;
+				num_face_idxs[new_vert_idx.AsInt()] = 4;
+			}
+		}
+
+		for (Idx<MeshFace> face_idx{ 0 }; face_idx < Faces.Num(); face_idx++)
+		{
+			auto new_vert_idx = face_new_vert[face_idx.AsInt()];
+
+			if (new_vert_idx.Valid())
+			{
+				num_edge_idxs[new_vert_idx.AsInt()] = flat.FaceVertsOf(face_idx).Num();
+				num_face_idxs[new_vert_idx.AsInt()] = flat.FaceVertsOf(face_idx).Num();
+			}
+		}
+
+		ret.PackedVertEdgeStarts.Reset(num_new_verts + 1);
+		ret.PackedVertFaceStarts.Reset(num_new_verts + 1);
 
-	// if we've had any geometry added manually, we're not clean
-	// if we were generated procedurally (say by SplitSharedVerts or returned from here), then we're clean and don't need any fixing-up...
-	if (!Clean)
-	{
-		work_on = SplitSharedVerts();
-	}
+		int num_edge_entries = 0;
+		int num_face_entries = 0;
 
-	return work_on->SubdivideInner();
-}
+		for (int i = 0; i < num_new_verts; i++)
+		{
+			ret.PackedVertEdgeStarts.Push(num_edge_entries);
+			ret.PackedVertFaceStarts.Push(num_face_entries);
 
-TSharedPtr<Mesh> Mesh::SubdivideInner()
-{
-	check(Clean);
+			num_edge_entries += num_edge_idxs[i];
+			num_face_entries += num_face_idxs[i];
+		}
 
-	auto ret = MakeShared<Mesh>(CosAutoSharpAngle);
+		ret.PackedVertEdgeStarts.Push(num_edge_entries);
+		ret.PackedVertFaceStarts.Push(num_face_entries);
 
-	ResolveEffectiveEdgeTypes();
+		ret.PackedVertEdges.SetNum(num_edge_entries);
+		ret.PackedVertFaces.SetNum(num_face_entries);
+	}
 
-	for (auto& f : Faces)
+	// the new verts' edges and faces are what adding them face by face would have given, e.g. sorted
+	auto fill_new_vert = [&ret](Idx<MeshVert> new_vert_idx, const FVector& pos,
+		TFaceArray<Idx<MeshEdge>>& new_edge_idxs, TFaceArray<Idx<MeshFace>>& new_face_idxs)
 	{
-		MeshVertRaw fv;
+		ret.Vertices[new_vert_idx].Pos = pos;
 
-		for (auto v : f.VertIdxs)
+		new_edge_idxs.Sort();
+		new_face_idxs.Sort();
+
+		auto edge_start = ret.PackedVertEdgeStarts[new_vert_idx.AsInt()];
+		auto face_start = ret.PackedVertFaceStarts[new_vert_idx.AsInt()];
+
+		check(ret.PackedVertEdgeStarts[new_vert_idx.AsInt() + 1] - edge_start == new_edge_idxs.Num());
+		check(ret.PackedVertFaceStarts[new_vert_idx.AsInt() + 1] - face_start == new_face_idxs.Num());
+
+		for (int i = 0; i < new_edge_idxs.Num(); i++)
 		{
-			fv += Vertices[v].ToMeshVertRaw(f.UVGroup);
+			ret.PackedVertEdges[edge_start + i] = new_edge_idxs[i];
 		}
 
-		fv = fv / f.VertIdxs.Num();
+		for (int i = 0; i < new_face_idxs.Num(); i++)
+		{
+			ret.PackedVertFaces[face_start + i] = new_face_idxs[i];
+		}
+	};
 
-		// set this up to represent our position and the UVs for _only_ this face
-		f.WorkingFaceVertex.Pos = fv.Pos;
-		f.WorkingFaceVertex.UVs.Empty();
-		f.WorkingFaceVertex.UVs.Add(f.UVGroup) = fv.UV;
-	}
+	// the new face made at the corner of old face "face_idx" which is at "vert_idx"
+	auto corner_new_face = [&flat, &face_first_new_face](Idx<MeshFace> face_idx, Idx<MeshVert> vert_idx) {
+		return Idx<MeshFace>(face_first_new_face[face_idx.AsInt()] + flat.Corner(face_idx, vert_idx));
+	};
 
-	for (auto& e : Edges)
+	ParallelFor(Vertices.Num().AsInt(), [&](int32 i)
 	{
-		if (e.EffectiveType == PGCEdgeType::Rounded)
+		Idx<MeshVert> vert_idx{ i };
+
+		if (!vert_new_vert[i].Valid())
+			return;
+
+		TFaceArray<Idx<MeshEdge>> new_edge_idxs;
+		TFaceArray<Idx<MeshFace>> new_face_idxs;
+
+		for (auto edge_idx : flat.VertEdgesOf(vert_idx))
 		{
-			e.WorkingEdgeVertex.Pos = (Vertices[e.StartVertIdx].Pos + Vertices[e.EndVertIdx].Pos
-				+ Faces[e.ForwardFaceIdx].WorkingFaceVertex.Pos + Faces[e.BackwardsFaceIdx].WorkingFaceVertex.Pos) / 4;
+			new_edge_idxs.Push(edge_new_edges[edge_idx.AsInt() * 4 + (flat.EdgeStartVerts[edge_idx.AsInt()] == vert_idx ? 0 : 1)]);
 		}
-		else
+
+		for (auto face_idx : flat.VertFacesOf(vert_idx))
 		{
-			e.WorkingEdgeVertex.Pos = (Vertices[e.StartVertIdx].Pos + Vertices[e.EndVertIdx].Pos) / 2;
+			new_face_idxs.Push(corner_new_face(face_idx, vert_idx));
 		}
 
-		e.WorkingEdgeVertex.UVs = (Vertices[e.StartVertIdx].UVs + Vertices[e.EndVertIdx].UVs) / 2;
-	}
+		fill_new_vert(vert_new_vert[i], points.VertPoints[i], new_edge_idxs, new_face_idxs);
+	}, !parallel);
 
-	for (Idx<MeshVert> vert_idx{ 0 }; vert_idx < Vertices.Num(); vert_idx++)
+	ParallelFor(Edges.Num().AsInt(), [&](int32 i)
 	{
-		auto& v = Vertices[vert_idx];
+		if (!edge_new_vert[i].Valid())
+			return;
 
-		TArray<MeshEdge> sharp_edges;
+		TFaceArray<Idx<MeshEdge>> new_edge_idxs;
+		TFaceArray<Idx<MeshFace>> new_face_idxs;
 
-		for (auto edge_idx : v.EdgeIdxs)
+		for (int j = 0; j < 4; j++)
 		{
-			const auto& edge = Edges[edge_idx];
-
-			if (edge.EffectiveType == PGCEdgeType::Sharp)
-			{
-				sharp_edges.Add(edge);
-			}
+			new_edge_idxs.Push(edge_new_edges[i * 4 + j]);
 		}
 
-		if (sharp_edges.Num() < 2)
+		for (auto face_idx : { flat.EdgeForwardFaces[i], flat.EdgeBackwardsFaces[i] })
 		{
-			auto n = v.FaceIdxs.Num();
-
-			FVector F{ 0, 0, 0 };
-
-			for (auto face_idx : v.FaceIdxs)
-			{
-				F += Faces[face_idx].WorkingFaceVertex.Pos;
-			}
+			new_face_idxs.Push(corner_new_face(face_idx, flat.EdgeStartVerts[i]));
+			new_face_idxs.Push(corner_new_face(face_idx, flat.EdgeEndVerts[i]));
+		}
 
-			F = F / n;
+		fill_new_vert(edge_new_vert[i], points.EdgePoints[i], new_edge_idxs, new_face_idxs);
+	}, !parallel);
 
-			FVector R{ 0, 0, 0 };
+	ParallelFor(Faces.Num().AsInt(), [&](int32 i)
+	{
+		Idx<MeshFace> face_idx{ i };
 
-			for (auto edge_idx : v.EdgeIdxs)
-			{
-				R += Edges[edge_idx].WorkingEdgeVertex.Pos;
-			}
+		if (!face_new_vert[i].Valid())
+			return;
 
-			// assuming the number of faces == the number of edges, which is true for closed meshes, may need a special rule for the edges if this is ever not true...
-			R = R / n;
+		TFaceArray<Idx<MeshEdge>> new_edge_idxs;
+		TFaceArray<Idx<MeshFace>> new_face_idxs;
 
-			v.WorkingNewPos.Pos = (v.Pos * (n - 3) + R * 2 + F) / n;
-		}
-		else if (sharp_edges.Num() == 2)
+		// in f.EdgeIdxs order, as fill_new_vert sorts them anyway
+		for (auto edge_idx : flat.FaceEdgesOf(face_idx))
 		{
-			const auto& ov0 = Vertices[sharp_edges[0].OtherVert(vert_idx)];
-			const auto& ov1 = Vertices[sharp_edges[1].OtherVert(vert_idx)];
-
-			v.WorkingNewPos.Pos = v.Pos * 0.75f + ov0.Pos * 0.125f + ov1.Pos * 0.125f;
+			new_edge_idxs.Push(edge_new_edges[edge_idx.AsInt() * 4 + (flat.EdgeForwardFaces[edge_idx.AsInt()] == face_idx ? 2 : 3)]);
 		}
-		else
+
+		for (int j = 0; j < flat.FaceVertsOf(face_idx).Num(); j++)
 		{
-			v.WorkingNewPos.Pos = v.Pos;
+			new_face_idxs.Push(Idx<MeshFace>(face_first_new_face[i] + j));
 		}
 
-		// on a vert we keep the UVs as they were, since the position is going to pull in but still wants to be the same point in texture-space
-		v.WorkingNewPos.UVs = v.UVs;
-	}
+		fill_new_vert(face_new_vert[i], points.FacePoints[i], new_edge_idxs, new_face_idxs);
+	}, !parallel);
+
+	ret.RebuildLookups();
+}
 
+void Mesh::BuildSubdivisionBySearch(const FlatMesh& flat, const SubdivisionPoints& points, Mesh& ret) const
+{
 	for (Idx<MeshFace> face_idx{ 0 }; face_idx < Faces.Num(); face_idx++)
 	{
 		const auto& f = Faces[face_idx];
 		auto n = f.VertIdxs.Num();
+		auto centre_uv = flat.FaceCentreUV(face_idx);
 
 		for (int i = 0; i < n; i++)
 		{
@@ -1325,102 +3547,135 @@ TSharedPtr<Mesh> Mesh::SubdivideInner()
 			auto next_edge_idx = FindEdge(vert_idx, next_vert_idx, face_idx);
 			check(next_edge_idx.Valid());
 
-			auto& v1 = Vertices[vert_idx].WorkingNewPos;
-			auto& v2 = Edges[next_edge_idx].WorkingEdgeVertex;
-			auto& v3 = f.WorkingFaceVertex;
-			auto& v4 = Edges[prev_edge_idx].WorkingEdgeVertex;
+			FVector2D quad_uvs[4];
+			SubdivisionQuadUVs(flat.FaceUVsOf(face_idx), i, centre_uv, quad_uvs);
+
+			MeshVertRaw quad_verts[4]{
+				{ points.VertPoints[vert_idx.AsInt()], quad_uvs[0] },
+				{ points.EdgePoints[next_edge_idx.AsInt()], quad_uvs[1] },
+				{ points.FacePoints[face_idx.AsInt()], quad_uvs[2] },
+				{ points.EdgePoints[prev_edge_idx.AsInt()], quad_uvs[3] }
+			};
 
 			// edges introduced in the middle of what was a single (roughly planar) face should be Rounded, I guess...
-			ret->AddFaceFromRawVerts({
-				v1.ToMeshVertRaw(f.UVGroup),
-				v2.ToMeshVertRaw(f.UVGroup),
-				v3.ToMeshVertRaw(f.UVGroup),
-				v4.ToMeshVertRaw(f.UVGroup)
-				}, f.UVGroup,
-				{
-					Edges[next_edge_idx].SetType,
-					PGCEdgeType::Rounded,
-					PGCEdgeType::Rounded,
-					Edges[prev_edge_idx].SetType,
-				},
-				f.Channel);
+			PGCEdgeType quad_edge_types[4]{
+				Edges[next_edge_idx].SetType,
+				PGCEdgeType::Rounded,
+				PGCEdgeType::Rounded,
+				Edges[prev_edge_idx].SetType,
+			};
+
+			ret.AddFaceFromRawVerts(MakeArrayView(quad_verts), f.UVGroup, MakeArrayView(quad_edge_types), f.Channel);
 		}
 	}
+}
 
-	ret->CheckConsistent(true);
+void Mesh::SubdivisionQuadUVs(TArrayView<const FVector2D> uvs, int corner, const FVector2D& centre_uv, FVector2D quad_uvs[4])
+{
+	auto n = uvs.Num();
 
-	return ret;
+	const auto& uv = uvs[corner];
+
+	// on a vert we keep the UV as it was, since the position is going to pull in but still wants to be the same point in texture-space
+	quad_uvs[0] = uv;
+	quad_uvs[1] = (uv + uvs[(corner + 1) % n]) / 2;
+	quad_uvs[2] = centre_uv;
+	quad_uvs[3] = (uvs[(corner + n - 1) % n] + uv) / 2;
 }
 
 void Mesh::ResolveEffectiveEdgeTypes()
 {
-	for (auto& e : Edges)
+	FlatMesh flat(*this);
+
+	ResolveEffectiveEdgeTypes(flat);
+
+	for (int i = 0; i < flat.NumEdges(); i++)
 	{
-		if (e.EffectiveType == PGCEdgeType::Unset)
-		{
-			if (e.SetType != PGCEdgeType::Auto)
-			{
-				e.EffectiveType = e.SetType;
-			}
-			else
-			{
-				CalcEffectiveType(e);
-			}
-		}
+		Edges[Idx<MeshEdge>(i)].EffectiveType = flat.EdgeEffectiveTypes[i];
 	}
 }
 
-void Mesh::CalcEffectiveType(MeshEdge& edge)
+void Mesh::ResolveEffectiveEdgeTypes(FlatMesh& flat) const
 {
-	// just to cover incomplete meshes seen while testing other features...
-	if (!edge.ForwardFaceIdx.Valid() || !edge.BackwardsFaceIdx.Valid())
+	// initialised?
+	check(CosAutoSharpAngle != -2);
+
+	for (int i = 0; i < flat.NumEdges(); i++)
 	{
-		edge.EffectiveType = PGCEdgeType::Sharp;
-		return;
-	}
+		auto& type = flat.EdgeEffectiveTypes[i];
 
-	FVector e1normal = CalcNonplanarFaceNormal(Faces[edge.ForwardFaceIdx]);
-	FVector e2normal = CalcNonplanarFaceNormal(Faces[edge.BackwardsFaceIdx]);
+		if (type != PGCEdgeType::Unset)
+			continue;
 
-	auto cos = FVector::DotProduct(e1normal, e2normal);
+		auto forward_face_idx = flat.EdgeForwardFaces[i];
+		auto backwards_face_idx = flat.EdgeBackwardsFaces[i];
 
-	// initialised?
-	check(CosAutoSharpAngle != -2);
+		if (flat.EdgeSetTypes[i] != PGCEdgeType::Auto)
+		{
+			type = flat.EdgeSetTypes[i];
+		}
+		// just to cover incomplete meshes seen while testing other features...
+		else if (!forward_face_idx.Valid() || !backwards_face_idx.Valid())
+		{
+			type = PGCEdgeType::Sharp;
+		}
+		else
+		{
+			auto cos = FVector::DotProduct(flat.FaceNormal(forward_face_idx), flat.FaceNormal(backwards_face_idx));
 
-	if (cos < CosAutoSharpAngle)
-	{
-		edge.EffectiveType = PGCEdgeType::Sharp;
-	}
-	else
-	{
-		edge.EffectiveType = PGCEdgeType::Rounded;
+			type = cos < CosAutoSharpAngle ? PGCEdgeType::Sharp : PGCEdgeType::Rounded;
+		}
 	}
 }
 
-FVector Mesh::CalcNonplanarFaceNormal(const MeshFace& face)
+TSharedPtr<Mesh> Mesh::SubdivideN(int count, bool parallel)
 {
-	TArray<FVector> verts;
+	if (count == 0)
+		return AsShared();
 
-	for (const auto& vert_idx : face.VertIdxs)
-	{
-		verts.Emplace(Vertices[vert_idx].Pos);
-	}
+	auto first = Subdivide(parallel);
 
-	return Util::NewellPolyNormal(verts);
-}
+	if (count == 1)
+		return first;
 
-TSharedPtr<Mesh> Mesh::SubdivideN(int count)
-{
-	auto ret = AsShared();
+	// level i lives in buffers[(i - 1) % 2], so each level overwrites the one before the one it is made from
+	// and only two are ever alive
+	QuadMesh buffers[2]{ QuadMesh(*first), QuadMesh(CosAutoSharpAngle) };
+
+	first.Reset();
 
-	for (int i = 0; i < count; i++)
+	// all the later sizes are known, so each buffer can take the biggest level it will hold up front
+	// rather than growing (and briefly holding two copies) on each pass
+	int num_verts = buffers[0].NumVerts();
+	int num_edges = buffers[0].NumEdges();
+	int num_faces = buffers[0].NumFaces();
+
+	for (int i = 1; i < count; i++)
 	{
-		auto temp = ret->Subdivide();
+		QuadMesh::NextLevelSize(num_verts, num_edges, num_faces);
 
-		ret = temp.ToSharedRef();
+		if (i >= count - 2)
+		{
+			buffers[i % 2].Reserve(num_verts, num_edges, num_faces);
+		}
 	}
 
-	return ret;
+	for (int i = 1; i < count; i++)
+	{
+		auto& from = buffers[(i - 1) % 2];
+		auto& to = buffers[i % 2];
+
+		// points landed on top of each other, only searching by position in a Mesh can merge them
+		if (!from.Subdivide(to, parallel))
+		{
+			to = QuadMesh(*from.ToMesh()->Subdivide(parallel));
+		}
+	}
+
+	// the level before last isn't needed while making the Mesh
+	buffers[count % 2].Empty();
+
+	return buffers[(count - 1) % 2].ToMesh();
 }
 
 void Mesh::AddCube(const FPGCCube& cube)
@@ -1484,29 +3739,251 @@ void Mesh::AddCube(const FPGCCube& cube)
 	CheckConsistent(true);
 }
 
-void Mesh::BakeAllChannelsIntoOne(FPGCMeshResult& mesh, bool insideOut, PGCDebugEdgeType debugEdges)
+// AddCube's six faces, in the same order and from the same first corner,
+// a corner's bits are which side of the cube it is on in x (4), y (2) and z (1), as in AddCube's VertNames
+static const int CubeFaceCorners[6][4]{
+	{ 4, 6, 2, 0 },
+	{ 4, 5, 7, 6 },
+	{ 2, 6, 7, 3 },
+	{ 1, 0, 2, 3 },
+	{ 5, 4, 0, 1 },
+	{ 5, 1, 3, 7 },
+};
+
+// a cube's edges by the axis they run along, then which side they are on in the other two axes (lower axis first)
+static const PGCEdgeId CubeEdgeIds[3][2][2]{
+	{ { PGCEdgeId::BottomFront, PGCEdgeId::TopFront }, { PGCEdgeId::BottomBack, PGCEdgeId::TopBack } },
+	{ { PGCEdgeId::BottomLeft, PGCEdgeId::TopLeft }, { PGCEdgeId::BottomRight, PGCEdgeId::TopRight } },
+	{ { PGCEdgeId::FrontLeft, PGCEdgeId::BackLeft }, { PGCEdgeId::FrontRight, PGCEdgeId::BackRight } },
+};
+
+static int CornerSide(int corner, int axis)
+{
+	return (corner >> (2 - axis)) & 1;
+}
+
+static PGCEdgeType CubeEdgeType(const FPGCCube& cube, int axis, const int sides[3])
 {
-	ResolveEffectiveEdgeTypes();
+	int other1 = axis == 0 ? 1 : 0;
+	int other2 = axis == 2 ? 1 : 2;
+
+	return cube.EdgeTypes[(int)CubeEdgeIds[axis][sides[other1]][sides[other2]]];
+}
+
+void Mesh::AddCubes(const TArray<FPGCCube>& cubes)
+{
+	check(!Batch.Active);
+
+	Clean = false;
+
+	// which cube is in each cell, the first one wins if there are duplicates
+	TMap<FIntVector, int> cells;
+	cells.Reserve(cubes.Num());
+
+	for (int i = 0; i < cubes.Num(); i++)
+	{
+		const auto& cube = cubes[i];
+		FIntVector cell(cube.X, cube.Y, cube.Z);
+
+		if (!cells.Contains(cell))
+		{
+			cells.Add(cell, i);
+		}
+	}
+
+	auto find_cube = [&](const FIntVector& cell) -> const FPGCCube* {
+		auto found = cells.Find(cell);
+
+		return found ? &cubes[*found] : nullptr;
+	};
+
+	const FVector2D uvs[4]{ { 0, 0 }, { 0, 1 }, { 1, 1 }, { 1, 0 } };
 
-	check(BakedVerts.Num() == 0);
+	for (int i = 0; i < cubes.Num(); i++)
+	{
+		const auto& cube = cubes[i];
+		FIntVector cell(cube.X, cube.Y, cube.Z);
+
+		if (cells[cell] != i)
+			continue;
+
+		for (int f = 0; f < 6; f++)
+		{
+			const auto& corners = CubeFaceCorners[f];
+
+			// the axis the face is across is the one all its corners agree on
+			int normal_axis = 0;
+
+			while (CornerSide(corners[0], normal_axis) != CornerSide(corners[2], normal_axis))
+			{
+				normal_axis++;
+			}
+
+			FIntVector out = cell;
+			out[normal_axis] += CornerSide(corners[0], normal_axis) ? 1 : -1;
+
+			// faces between two cubes are the ones AddCube cancels
+			if (cells.Contains(out))
+				continue;
+
+			// UV groups as AddCube would have allocated them, including to the faces we skip
+			int UVGroup = NextUVGroup + i * 6 + f;
+
+			TFaceArray<Idx<MeshVert>> vert_idxs;
+			TFaceArray<PGCEdgeType> edge_types;
+
+			for (int j = 0; j < 4; j++)
+			{
+				int corner = corners[j];
+				int next = corners[(j + 1) % 4];
+
+				FVector pos{
+					(float)cube.X + (CornerSide(corner, 0) ? 0.5f : -0.5f),
+					(float)cube.Y + (CornerSide(corner, 1) ? 0.5f : -0.5f),
+					(float)cube.Z + (CornerSide(corner, 2) ? 0.5f : -0.5f)
+				};
+
+				vert_idxs.Push(AddVert(MeshVertRaw(pos, uvs[j]), UVGroup));
+
+				// the edge to the next corner is shared by whichever of the cubes around it connect to us through faces,
+				// that is the neighbour beside the edge, and the one diagonally across it if the neighbour is there
+				// (if only the diagonal one is there they touch only along the edge and each keep their own)
+				int along = 0;
+
+				while (CornerSide(corner, along) == CornerSide(next, along))
+				{
+					along++;
+				}
+
+				int beside_axis = 3 - normal_axis - along;
+
+				int sides[3]{ CornerSide(corner, 0), CornerSide(corner, 1), CornerSide(corner, 2) };
+
+				auto edge_type = CubeEdgeType(cube, along, sides);
+
+				FIntVector beside_cell = cell;
+				beside_cell[beside_axis] += sides[beside_axis] ? 1 : -1;
+
+				if (auto beside = find_cube(beside_cell))
+				{
+					sides[beside_axis] ^= 1;
+					edge_type = MergeEdgeTypes(edge_type, CubeEdgeType(*beside, along, sides));
+
+					FIntVector diagonal_cell = beside_cell;
+					diagonal_cell[normal_axis] = out[normal_axis];
+
+					if (auto diagonal = find_cube(diagonal_cell))
+					{
+						sides[normal_axis] ^= 1;
+						edge_type = MergeEdgeTypes(edge_type, CubeEdgeType(*diagonal, along, sides));
+					}
+				}
+
+				edge_types.Push(edge_type);
+			}
+
+			RegularizeVertIdxs(vert_idxs, edge_types);
+
+			AddFindFace(vert_idxs, edge_types, UVGroup, 0);
+		}
+	}
+
+	NextUVGroup += cubes.Num() * 6;
+
+	CheckConsistent(true);
+}
+
+void Mesh::BakeAllChannelsIntoOne(FPGCMeshResult& mesh, bool insideOut, PGCDebugEdgeType debugEdges,
+	const TArray<FVector>* corner_normals)
+{
+	auto flat = MakeBakeableFlat();
+
+	BakeAllChannelsIntoOne(flat->View(), mesh, insideOut, debugEdges, corner_normals);
+}
+
+void Mesh::BakeChannels(FPGCMeshResult& mesh, bool insideOut, PGCDebugEdgeType debugEdges, int start_channel, int end_channel,
+	const TArray<FVector>* corner_normals)
+{
+	auto flat = MakeBakeableFlat();
+
+	BakeChannels(flat->View(), mesh, insideOut, debugEdges, start_channel, end_channel, corner_normals);
+}
+
+TSharedRef<FlatMesh> Mesh::MakeBakeableFlat()
+{
+	Compact();
+
+	auto flat = MakeShared<FlatMesh>(*this);
 
-	BakeChannelsIntoFaceChannel(mesh, insideOut, debugEdges, -1, 0);
+	ResolveEffectiveEdgeTypes(*flat);
 
-	BakedVerts.Empty();
+	return flat;
 }
 
-void Mesh::BakeChannels(FPGCMeshResult& mesh, bool insideOut, PGCDebugEdgeType debugEdges, int start_channel, int end_channel)
+void Mesh::PrepareForSharing()
 {
+	Compact();
+
+	if (!Clean)
+	{
+		SplitSharedVerts();
+	}
+
 	ResolveEffectiveEdgeTypes();
 
-	check(BakedVerts.Num() == 0);
+	// we're finished, so the verts' edges and faces can go into the packed rows
+	PackAdjacency();
 
-	for(int i = start_channel; i <= end_channel; i++)
+	// and nothing is left touched, so that closed checks from here on only read us
+	CheckConsistent(true);
+}
+
+SIZE_T Mesh::GetAllocatedSize() const
+{
+	auto ret = Vertices.GetAllocatedSize() + Edges.GetAllocatedSize() + Faces.GetAllocatedSize();
+
+	for (const auto& v : Vertices)
+	{
+		ret += v.UVs.GetAllocatedSize() + v.EdgeIdxs.GetAllocatedSize() + v.FaceIdxs.GetAllocatedSize();
+	}
+
+	for (const auto& f : Faces)
 	{
-		BakeChannelsIntoFaceChannel(mesh, insideOut, debugEdges, i, i);
+		ret += f.VertIdxs.GetAllocatedSize() + f.EdgeIdxs.GetAllocatedSize() + f.CornerUVs.GetAllocatedSize();
 	}
 
-	BakedVerts.Empty();
+	ret += PackedVertEdgeStarts.GetAllocatedSize() + PackedVertEdges.GetAllocatedSize()
+		+ PackedVertFaceStarts.GetAllocatedSize() + PackedVertFaces.GetAllocatedSize();
+
+	ret += BakedVerts.GetAllocatedSize() + BakedNormals.GetAllocatedSize() + BakedVertLookup.GetAllocatedSize();
+	ret += VertLookup.GetAllocatedSize() + EdgeLookup.GetAllocatedSize() + FaceLookup.GetAllocatedSize();
+
+	ret += Batch.Positions.GetAllocatedSize() + Batch.UVs.GetAllocatedSize() + Batch.EdgeTypes.GetAllocatedSize()
+		+ Batch.FaceStarts.GetAllocatedSize() + Batch.FaceUVGroups.GetAllocatedSize() + Batch.FaceChannels.GetAllocatedSize();
+
+	ret += TouchedVerts.GetAllocatedSize() + TouchedEdges.GetAllocatedSize() + TouchedFaces.GetAllocatedSize();
+
+	return ret;
+}
+
+void Mesh::BakeAllChannelsIntoOne(const FlatMeshView& flat, FPGCMeshResult& mesh, bool insideOut, PGCDebugEdgeType debugEdges,
+	const TArray<FVector>* corner_normals)
+{
+	// only to hold the baked verts while we work
+	Mesh baker;
+
+	baker.BakeChannelsIntoFaceChannel(flat, mesh, insideOut, debugEdges, -1, 0, corner_normals);
+}
+
+void Mesh::BakeChannels(const FlatMeshView& flat, FPGCMeshResult& mesh, bool insideOut, PGCDebugEdgeType debugEdges,
+	int start_channel, int end_channel, const TArray<FVector>* corner_normals)
+{
+	Mesh baker;
+
+	for(int i = start_channel; i <= end_channel; i++)
+	{
+		baker.BakeChannelsIntoFaceChannel(flat, mesh, insideOut, debugEdges, i, i, corner_normals);
+	}
 }
 
 //bool MeshVertRaw::ToleranceCompare(const MeshVertRaw& other, float tolerance) const
@@ -1516,8 +3993,46 @@ void Mesh::BakeChannels(FPGCMeshResult& mesh, bool insideOut, PGCDebugEdgeType d
 //		&& FVector2D::DistSquared(UV, other.UV) < tolerance * tolerance;
 //}
 
+// as Ar << an array writes it, for a row we only have a view of
+template <typename T>
+static void SaveRow(FArchive& Ar, TArrayView<const T> row)
+{
+	int32 num = row.Num();
+
+	Ar << num;
+
+	for (auto item : row)
+	{
+		Ar << item;
+	}
+}
+
+// and reads one back onto the end of "rows"
+template <typename T>
+static void LoadRow(FArchive& Ar, TArray<T>& rows)
+{
+	int32 num;
+
+	Ar << num;
+
+	for (int i = 0; i < num; i++)
+	{
+		T item;
+
+		Ar << item;
+
+		rows.Push(item);
+	}
+}
+
 FArchive& operator<<(FArchive& Ar, Mesh& mesh)
 {
+	// dead elements aren't worth saving
+	if (Ar.IsSaving())
+	{
+		mesh.Compact();
+	}
+
 	Ar << mesh.NextUVGroup;
 	Ar << mesh.CosAutoSharpAngle;
 
@@ -1531,9 +4046,54 @@ FArchive& operator<<(FArchive& Ar, Mesh& mesh)
 			mesh.Vertices.Push(MeshVert{});
 		}
 
-		for (auto& v : mesh.Vertices)
+		if (Ar.IsLoading())
+		{
+			// a loaded mesh is finished, so its verts' edges and faces go straight into packed rows
+			mesh.AdjacencyPacked = true;
+			mesh.PackedVertEdgeStarts.Reset(num.AsInt() + 1);
+			mesh.PackedVertEdges.Reset();
+			mesh.PackedVertFaceStarts.Reset(num.AsInt() + 1);
+			mesh.PackedVertFaces.Reset();
+		}
+
+		// each vert written as it would be with its own map and arrays, wherever we keep them, so the format doesn't change
+		for (Idx<MeshVert> vert_idx{ 0 }; vert_idx < mesh.Vertices.Num(); vert_idx++)
+		{
+			auto& v = mesh.Vertices[vert_idx];
+
+			if (Ar.IsSaving())
+			{
+				Ar << v.Pos;
+
+				if (mesh.UVsInCorners)
+				{
+					auto uvs = mesh.CornerUVsOf(vert_idx);
+
+					Ar << uvs;
+				}
+				else
+				{
+					Ar << v.UVs;
+				}
+
+				SaveRow(Ar, mesh.VertEdgesOf(vert_idx));
+				SaveRow(Ar, mesh.VertFacesOf(vert_idx));
+			}
+			else
+			{
+				Ar << static_cast<MeshVertMultiUV&>(v);
+
+				mesh.PackedVertEdgeStarts.Push(mesh.PackedVertEdges.Num());
+				LoadRow(Ar, mesh.PackedVertEdges);
+				mesh.PackedVertFaceStarts.Push(mesh.PackedVertFaces.Num());
+				LoadRow(Ar, mesh.PackedVertFaces);
+			}
+		}
+
+		if (Ar.IsLoading())
 		{
-			Ar << v;
+			mesh.PackedVertEdgeStarts.Push(mesh.PackedVertEdges.Num());
+			mesh.PackedVertFaceStarts.Push(mesh.PackedVertFaces.Num());
 		}
 	}
 
@@ -1569,6 +4129,14 @@ FArchive& operator<<(FArchive& Ar, Mesh& mesh)
 		}
 	}
 
+	if (Ar.IsLoading())
+	{
+		// the UVs came in the verts' maps
+		mesh.UVsInCorners = false;
+
+		mesh.RebuildLookups();
+	}
+
 	return Ar;
 }
 
@@ -7,6 +7,7 @@
 #include "GameFramework/Actor.h"
 #include "Runtime/Core/Public/Math/Vector.h"
 #include "Runtime/Core/Public/Containers/Array.h"
+#include "Runtime/Core/Public/Containers/ArrayView.h"
 #include "Runtime/Core/Public/Templates/UnrealTemplate.h"
 #include "Runtime/Core/Public/Templates/SharedPointer.h"
 #include "Runtime/Core/Public/Misc/AssertionMacros.h"
@@ -116,9 +117,14 @@ public:
 	Idx<Element> LastIdx() const { return Idx<Element>(TArray::Num() - 1); }
 
 	void Empty() { TArray::Empty(); }
+	void Reset() { TArray::Reset(); }
+	void Reserve(Idx<Element> Num) { TArray::Reserve((int)Num); }
+	void SetNum(Idx<Element> Num) { TArray::SetNum((int)Num); }
+
+	SIZE_T GetAllocatedSize() const { return TArray::GetAllocatedSize(); }
 
 	void Push(const Element& elem) { TArray::Push(elem); }
-	void Push(Element&& elem) { TArray::Push(elem); }
+	void Push(Element&& elem) { TArray::Push(MoveTemp(elem)); }
 
 	bool Contains(const Element& value) const { return TArray::Contains(value); }
 
@@ -131,138 +137,165 @@ private:
 	FORCEINLINE friend RangedForConstIteratorType end(const TArrayIdx& Array) { return RangedForConstIteratorType(Array.ArrayNum, Array.GetData() + static_cast<const TArray&>(Array).Num()); }
 };
 
-struct MeshFaceRaw {
-	TArray<Idx<MeshVertRaw>> VertIdxs;
-};
+// -0 and +0 compare equal, so they must also hash equal
+// (done on the bits, as fast floating-point is allowed to fold away arithmetic tricks for this)
+inline uint32 HashFloat(float f)
+{
+	uint32 bits;
+	FMemory::Memcpy(&bits, &f, sizeof(bits));
 
-// just the data required for output
-struct MeshVertRaw {
-	MeshVertRaw() : Pos{ 0, 0, 0 }, UV{ 0, 0 } {}
-	MeshVertRaw(FVector pos, FVector2D uv) : Pos{ pos }, UV{ uv } {}
+	return (bits << 1) == 0 ? 0 : bits;
+}
 
-	const MeshVertRaw& operator+=(const MeshVertRaw& rhs)
-	{
-		Pos += rhs.Pos;
-		UV += rhs.UV;
+inline uint32 HashPosition(const FVector& pos)
+{
+	return HashCombine(HashCombine(HashFloat(pos.X), HashFloat(pos.Y)), HashFloat(pos.Z));
+}
 
-		return *this;
-	}
+// order-independent, so an edge is found whichever way around it runs
+template <typename T>
+inline uint32 HashIdxPair(Idx<T> idx1, Idx<T> idx2)
+{
+	return idx1 < idx2 ? HashCombine(GetTypeHash(idx1), GetTypeHash(idx2)) : HashCombine(GetTypeHash(idx2), GetTypeHash(idx1));
+}
 
-	MeshVertRaw operator/(float rhs) {
-		return MeshVertRaw{ Pos / rhs, UV / rhs };
-	}
+// order-dependent, faces are hashed after RegularizeVertIdxs so a given face has only one form
+template <typename T>
+inline uint32 HashIdxSequence(TArrayView<const Idx<T>> idxs)
+{
+	uint32 ret = 0;
 
-	bool operator==(const MeshVertRaw& rhs) const {
-		return Pos == rhs.Pos && UV == rhs.UV;
+	for (auto idx : idxs)
+	{
+		ret = HashCombine(ret, GetTypeHash(idx));
 	}
 
-//	bool ToleranceCompare(const MeshVertRaw& other, float tolerance) const;
-
-	FVector Pos;
-	FVector2D UV;
-};
+	return ret;
+}
 
-struct MeshMultiUV : public TMap<int, FVector2D>
+template <typename T, typename Allocator>
+inline uint32 HashIdxSequence(const TArray<Idx<T>, Allocator>& idxs)
 {
-	const MeshMultiUV& operator+=(const MeshMultiUV& rhs) {
-		// there is a theory that we only need to keep UVs that are in both parents
-		// but that is awkward if we want to construct an "empty" value and accumulate into it
-		// and the extra values should be harmless as nobody should want them...
+	return HashIdxSequence(TArrayView<const Idx<T>>(idxs));
+}
 
-		for (auto p : rhs)
-		{
-			if (Contains(p.Key))
-			{
-				(*this)[p.Key] += p.Value;
-			}
-			else
-			{
-				Add(p.Key) = p.Value;
-			}
-		}
+// faces are almost always 3-8 verts, so per-face temporaries can live on the stack
+template <typename T>
+using TFaceArray = TArray<T, TInlineAllocator<8>>;
 
-		return *this;
-	}
+// what a face keeps of its own, one per corner: triangles and quads (and everything subdivided) need no heap allocation
+template <typename T>
+using TFaceCornerArray = TArray<T, TInlineAllocator<4>>;
 
-	MeshMultiUV operator+(const MeshMultiUV& rhs) const
+// maps a hash onto the indices of all the elements which produce it
+// callers must still test the candidates for real equality
+// each bucket is kept in ascending index order, so a search finds the same element a linear scan would
+template <typename Element>
+class THashIdxLookup {
+public:
+	using Bucket = TArray<Idx<Element>, TInlineAllocator<1>>;
+
+	const Bucket* Find(uint32 hash) const { return Buckets.Find(hash); }
+
+	void Add(uint32 hash, Idx<Element> idx)
 	{
-		MeshMultiUV ret{ *this };
+		auto& bucket = Buckets.FindOrAdd(hash);
 
-		ret += rhs;
+		int pos = bucket.Num();
 
-		return ret;
+		while (pos > 0 && bucket[pos - 1] > idx)
+		{
+			pos--;
+		}
+
+		bucket.Insert(idx, pos);
 	}
 
-	MeshMultiUV operator/(float rhs) {
-		MeshMultiUV ret;
+	void Remove(uint32 hash, Idx<Element> idx)
+	{
+		auto bucket = Buckets.Find(hash);
+		check(bucket);
+
+		verify(bucket->Remove(idx) == 1);
 
-		for (auto p : *this)
+		if (bucket->Num() == 0)
 		{
-			ret.Add(p.Key) = p.Value / rhs;
+			Buckets.Remove(hash);
 		}
-
-		return ret;
 	}
 
-	MeshMultiUV operator*(float rhs) {
-		MeshMultiUV ret;
+	void Empty() { Buckets.Empty(); }
 
-		for (auto p : *this)
+	SIZE_T GetAllocatedSize() const
+	{
+		auto ret = Buckets.GetAllocatedSize();
+
+		// buckets only allocate once they outgrow their inline element
+		for (const auto& p : Buckets)
 		{
-			ret.Add(p.Key) = p.Value * rhs;
+			ret += p.Value.GetAllocatedSize();
 		}
 
 		return ret;
 	}
+
+private:
+	TMap<uint32, Bucket> Buckets;
 };
 
-struct MeshVertMultiUV {
-	MeshVertMultiUV() : Pos{ 0, 0, 0 }{}
+// just the data required for output
+struct MeshVertRaw {
+	MeshVertRaw() : Pos{ 0, 0, 0 }, UV{ 0, 0 } {}
+	MeshVertRaw(FVector pos, FVector2D uv) : Pos{ pos }, UV{ uv } {}
 
-	FVector Pos;
-	MeshMultiUV UVs;
+	const MeshVertRaw& operator+=(const MeshVertRaw& rhs)
+	{
+		Pos += rhs.Pos;
+		UV += rhs.UV;
 
-	MeshVertRaw ToMeshVertRaw(int UVGroup) const {
-		// -1 means just use any UVGroup we have...
-		// (used for debug line drawing, where we don't have any UVs...)
-		if (UVGroup == -1)
-			UVGroup = UVs.CreateConstIterator()->Key;
+		return *this;
+	}
 
-		return MeshVertRaw{ Pos, UVs[UVGroup] };
+	MeshVertRaw operator/(float rhs) {
+		return MeshVertRaw{ Pos / rhs, UV / rhs };
 	}
 
-	const MeshVertMultiUV& operator+=(const MeshVertMultiUV& rhs)
-	{
-		Pos += rhs.Pos;
+	bool operator==(const MeshVertRaw& rhs) const {
+		return Pos == rhs.Pos && UV == rhs.UV;
+	}
 
-		UVs += rhs.UVs;
+//	bool ToleranceCompare(const MeshVertRaw& other, float tolerance) const;
 
-		return *this;
+	uint32 Hash() const {
+		return HashCombine(HashCombine(HashPosition(Pos), HashFloat(UV.X)), HashFloat(UV.Y));
 	}
 
-	MeshVertMultiUV operator+(const MeshVertMultiUV& rhs)
-	{
-		MeshVertMultiUV ret{ *this };
+	FVector Pos;
+	FVector2D UV;
+};
 
-		ret += rhs;
+// UVGroup -> UV, a vert has one of these for each UVGroup of the faces using it
+typedef TMap<int, FVector2D> MeshMultiUV;
 
-		return ret;
-	}
+struct MeshVertMultiUV {
+	MeshVertMultiUV() : Pos{ 0, 0, 0 }{}
 
-	MeshVertMultiUV operator/(float rhs) {
-		MeshVertMultiUV ret;
-		ret.Pos = Pos / rhs;
-		ret.UVs = UVs / rhs;
+	FVector Pos;
+	MeshMultiUV UVs;
 
-		return ret;
-	}
+	MeshVertRaw ToMeshVertRaw(int UVGroup) const {
+		// -1 means just use any UVGroup we have...
+		// (used for debug line drawing, where we don't have any UVs...)
+		// and a vert added without any (AddVert(FVector)) has none to use
+		if (UVGroup == -1)
+		{
+			if (UVs.Num() == 0)
+				return MeshVertRaw{ Pos, FVector2D::ZeroVector };
 
-	MeshVertMultiUV operator*(float rhs) {
-		MeshVertMultiUV ret;
-		ret.Pos = Pos * rhs;
-		ret.UVs = UVs * rhs;
+			UVGroup = UVs.CreateConstIterator()->Key;
+		}
 
-		return ret;
+		return MeshVertRaw{ Pos, UVs[UVGroup] };
 	}
 };
 
@@ -277,10 +310,11 @@ struct MeshEdge;
 struct MeshFace;
 
 struct MeshVert : public MeshVertMultiUV {
+	// both empty when the Mesh has its adjacency packed (see Mesh::AdjacencyPacked), Mesh::VertEdgesOf/VertFacesOf read either
 	TArray<Idx<MeshEdge>> EdgeIdxs;
 	TArray<Idx<MeshFace>> FaceIdxs;
 
-	MeshVertMultiUV WorkingNewPos;
+	bool Dead = false;				///< removed, but left in place until Mesh::Compact
 };
 
 inline FArchive& operator<<(FArchive& Ar, MeshVert& mv) {
@@ -302,6 +336,8 @@ struct MeshEdge {
 	PGCEdgeType SetType = PGCEdgeType::Unset;					///< we need to start unset here, because we make edges with a default value and then merge-in the real one
 	PGCEdgeType EffectiveType = PGCEdgeType::Unset;				///< same as SetType except that "Auto" has been resolved into one of Rounded or Sharp
 
+	bool Dead = false;											///< as MeshVert::Dead
+
 	void AddFace(Idx<MeshFace> face_idx, Idx<MeshVert> start_vert_idx)
 	{
 		if (start_vert_idx == StartVertIdx)
@@ -339,8 +375,6 @@ struct MeshEdge {
 
 		return vert_idx == StartVertIdx ? EndVertIdx : StartVertIdx;
 	}
-
-	MeshVertMultiUV WorkingEdgeVertex;
 };
 
 inline FArchive& operator<<(FArchive& Ar, MeshEdge& me) {
@@ -355,14 +389,15 @@ inline FArchive& operator<<(FArchive& Ar, MeshEdge& me) {
 }
 
 struct MeshFace {
-	TArray<Idx<MeshVert>> VertIdxs;
-	TArray<Idx<MeshEdge>> EdgeIdxs;
+	TFaceCornerArray<Idx<MeshVert>> VertIdxs;
+	TFaceCornerArray<Idx<MeshEdge>> EdgeIdxs;
+	// lined up with VertIdxs, only for faces subdivision made, whose verts' UV maps are left empty (see Mesh::UVsInCorners)
+	TFaceCornerArray<FVector2D> CornerUVs;
 
 	int UVGroup = -1;		///< allow us to respect different UVs at shared vertices
 	int Channel;
 
-	// transient...
-	MeshVertMultiUV WorkingFaceVertex;
+	bool Dead = false;		///< as MeshVert::Dead
 
 	bool VertsAreRegular() const {
 		for (int i = 1; i < VertIdxs.Num(); i++)
@@ -443,6 +478,10 @@ struct FPGCMeshResult {
 	
 	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "PGC Mesh")
 	TArray<FVector2D> UVs;
+
+	// one per Verts, only filled in when baked with normals (e.g. from the limit surface)
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "PGC Mesh")
+	TArray<FVector> Normals;
 	
 	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "PGC Mesh")
 	TArray<FPGCTriangleSet> FaceChannels;
@@ -467,23 +506,159 @@ enum class PGCDebugEdgeType : uint8 {
 	Set
 };
 
+class FlatMesh;
+class FlatMeshView;
+class QuadMesh;
+
+// the new vert made from each old vert, edge and face during one level of subdivision,
+// indexed the same as the old mesh's Vertices, Edges and Faces, and only kept while that level is built
+struct SubdivisionPoints {
+	TArray<FVector> VertPoints;
+	TArray<FVector> EdgePoints;
+	TArray<FVector> FacePoints;
+};
+
+// faces given to a Mesh between BeginBatch and EndBatch, in the order they came,
+// laid out as in FlatMesh: face i's corners are [FaceStarts[i], FaceStarts[i + 1]) of the per-corner arrays
+struct FaceBatch {
+	bool Active = false;
+
+	TArray<FVector> Positions;
+	TArray<FVector2D> UVs;
+	TArray<PGCEdgeType> EdgeTypes;				///< EdgeTypes[j] is the edge from corner j to the next corner of the same face
+
+	TArray<int> FaceStarts;
+	TArray<int> FaceUVGroups;
+	TArray<int> FaceChannels;
+
+	int NumFaces() const { return FMath::Max(FaceStarts.Num() - 1, 0); }
+};
+
+// how much of its own bookkeeping a Mesh re-verifies in CheckConsistent, which when it checks everything every time
+// is most of the time a development build spends generating
+enum class MeshValidation {
+	Off,				///< CheckConsistent compiles away to nothing
+	Cheap,				///< each element on its own: indices in range, nothing referring to dead elements, closed meshes have no open edges
+	Incremental,		///< everything, but only on the elements edited since the last closed check
+	Full				///< everything, everywhere, every time
+};
+
+// pick with e.g. -DPGC_MESH_VALIDATION=Full
+#ifndef PGC_MESH_VALIDATION
+#if DO_CHECK
+#define PGC_MESH_VALIDATION Incremental
+#else
+#define PGC_MESH_VALIDATION Off
+#endif
+#endif
+
+constexpr MeshValidation MeshValidationLevel = MeshValidation::PGC_MESH_VALIDATION;
+
 class Mesh : public TSharedFromThis<Mesh>
 {
 	friend FArchive& operator<<(FArchive&, Mesh&);
+	friend class FlatMesh;
+	friend class QuadMesh;
+	friend class SubdivisionStencils;
+	friend class CubeChunks;
 
 	TArrayIdx<MeshVert> Vertices;
 	TArrayIdx<MeshEdge> Edges;
 	TArrayIdx<MeshFace> Faces;
 
 	TArray<MeshVertRaw> BakedVerts;
-	TArray<MeshFaceRaw> BakedFaces;
+	// lines up with BakedVerts, zero for verts baked without a normal
+	TArray<FVector> BakedNormals;
+	// pos + UV -> BakedVerts, lives exactly as long as BakedVerts does
+	THashIdxLookup<MeshVertRaw> BakedVertLookup;
+
+	// position -> vertices, saves a scan of all the vertices for every corner of every face added
+	THashIdxLookup<MeshVert> VertLookup;
+	// unordered vert pair -> edges, can be more than one (edge-edge overlap of cubes)
+	THashIdxLookup<MeshEdge> EdgeLookup;
+	// regularized vert sequence -> faces
+	THashIdxLookup<MeshFace> FaceLookup;
 
 	int NextUVGroup = 0;
 	float CosAutoSharpAngle;
 
+	bool UVsInCorners = false;		// subdivision leaves the UVs in the faces' CornerUVs, rather than giving every new vert a map,
+									// the maps are only built (MoveCornerUVsToVerts) when a vert has to be found or added by UV
+
+	// a finished mesh (subdivided, or loaded) keeps its verts' edges and faces as compressed sparse rows, rather than two
+	// small arrays per vert: vert i's are PackedVertEdges[PackedVertEdgeStarts[i], PackedVertEdgeStarts[i + 1]), in the order
+	// the vert's own array would have them, and the same for faces, anything that edits the mesh unpacks them first
+	bool AdjacencyPacked = false;
+	TArray<int> PackedVertEdgeStarts;
+	TArray<Idx<MeshEdge>> PackedVertEdges;
+	TArray<int> PackedVertFaceStarts;
+	TArray<Idx<MeshFace>> PackedVertFaces;
+
+	int NumDead = 0;				// removals only mark elements Dead, so that cancelling faces doesn't renumber
+									// the whole mesh every time, Compact then sweeps them all out in one go
+
 	bool Clean = true;				// when we add geometry, we may generate inappropriately shared verts
 									// this signals to clean that up
 
+	FaceBatch Batch;
+
+	// only with MeshValidation::Incremental, what has been edited since the last closed CheckConsistent
+	TSet<Idx<MeshVert>> TouchedVerts;
+	TSet<Idx<MeshEdge>> TouchedEdges;
+	TSet<Idx<MeshFace>> TouchedFaces;
+	bool TouchedAll = false;
+
+	void TouchVert(Idx<MeshVert> vert_idx)
+	{
+		if (MeshValidationLevel == MeshValidation::Incremental)
+		{
+			TouchedVerts.Add(vert_idx);
+		}
+	}
+
+	void TouchEdge(Idx<MeshEdge> edge_idx)
+	{
+		if (MeshValidationLevel == MeshValidation::Incremental)
+		{
+			TouchedEdges.Add(edge_idx);
+		}
+	}
+
+	void TouchFace(Idx<MeshFace> face_idx)
+	{
+		if (MeshValidationLevel == MeshValidation::Incremental)
+		{
+			TouchedFaces.Add(face_idx);
+		}
+	}
+
+	void ResetTouched()
+	{
+		if (MeshValidationLevel == MeshValidation::Incremental)
+		{
+			TouchedVerts.Reset();
+			TouchedEdges.Reset();
+			TouchedFaces.Reset();
+			TouchedAll = false;
+		}
+	}
+
+	// after anything that rewrites the mesh wholesale
+	void TouchAll()
+	{
+		if (MeshValidationLevel == MeshValidation::Incremental)
+		{
+			ResetTouched();
+			TouchedAll = true;
+		}
+	}
+
+	void CheckConsistentInner(bool closed);
+	// "full" adds the checks that each reference is returned and that the lookups can find the element
+	void CheckVert(Idx<MeshVert> vert_idx, bool closed, bool full) const;
+	void CheckEdge(Idx<MeshEdge> edge_idx, bool closed, bool full) const;
+	void CheckFace(Idx<MeshFace> face_idx, bool full) const;
+
 	// "face_idx" allows disambiguation when there's more than one edge between the same two verts
 	// (happens in edge-edge overlap of cubes)
 	Idx<MeshEdge> FindEdge(Idx<MeshVert> vert_idx1, Idx<MeshVert> vert_idx2, Idx<MeshFace> face_idx) const;
@@ -495,46 +670,109 @@ class Mesh : public TSharedFromThis<Mesh>
 	Idx<MeshVert> FindVert(const FVector& pos) const;
 	Idx<MeshVert> FindVert(const FVector& pos, int UVGroup) const;
 
-	Idx<MeshFace> AddFindFace(MeshFace face, const TArray<PGCEdgeType>& edge_types);
+	// a vert's edges and faces, from wherever we keep them
+	TArrayView<const Idx<MeshEdge>> VertEdgesOf(Idx<MeshVert> vert_idx) const {
+		if (!AdjacencyPacked)
+			return Vertices[vert_idx].EdgeIdxs;
+
+		auto vert = vert_idx.AsInt();
+
+		return MakeArrayView(PackedVertEdges.GetData() + PackedVertEdgeStarts[vert], PackedVertEdgeStarts[vert + 1] - PackedVertEdgeStarts[vert]);
+	}
+
+	TArrayView<const Idx<MeshFace>> VertFacesOf(Idx<MeshVert> vert_idx) const {
+		if (!AdjacencyPacked)
+			return Vertices[vert_idx].FaceIdxs;
+
+		auto vert = vert_idx.AsInt();
+
+		return MakeArrayView(PackedVertFaces.GetData() + PackedVertFaceStarts[vert], PackedVertFaceStarts[vert + 1] - PackedVertFaceStarts[vert]);
+	}
+
+
+	// moves the packed rows back into the verts' own arrays, for editing
+	void UnpackAdjacency();
+	// the other way, for a mesh that is finished
+	void PackAdjacency();
+
+	// the UV at a corner of a face, from wherever we keep it
+	FVector2D CornerUV(const MeshFace& face, int corner) const;
+	MeshVertRaw CornerVertRaw(const MeshFace& face, int corner) const {
+		return MeshVertRaw{ Vertices[face.VertIdxs[corner]].Pos, CornerUV(face, corner) };
+	}
+	// as MeshVertMultiUV::ToMeshVertRaw(-1)
+	FVector2D AnyUV(Idx<MeshVert> vert_idx) const;
+	// the map the vert would have, taken from its faces' CornerUVs in the order of its FaceIdxs
+	MeshMultiUV CornerUVsOf(Idx<MeshVert> vert_idx) const;
+	void MoveCornerUVsToVerts();
+
+	// "vert_idxs" must already be regularized, with "edge_types" in the same order (edge_types[i] being the edge from vert i to vert i + 1)
+	// nothing is allocated for the face unless it is really added
+	Idx<MeshFace> AddFindFace(TArrayView<const Idx<MeshVert>> vert_idxs, TArrayView<const PGCEdgeType> edge_types, int UVGroup, int channel);
 	Idx<MeshVert> AddVert(MeshVertRaw vert, int UVGroup);
 	Idx<MeshVert> AddVert(FVector pos);
-	Idx<MeshFace> FindFaceByVertIdxs(const TArray<Idx<MeshVert>>& vert_idxs) const;
+	Idx<MeshFace> FindFaceByVertIdxs(TArrayView<const Idx<MeshVert>> vert_idxs) const;
 	void RemoveFace(Idx<MeshFace> face_idx);
 	void RemoveEdge(Idx<MeshEdge> edge_idx);		///< it must not be in use by any faces
 	void RemoveVert(Idx<MeshVert> vert_idx);					///< it must not be in use by any edges (or faces)
-	void MergePartialEdges();
+	// removing a face can only affect its own edges (and any others between the same verts) and their verts,
+	// so these only look at those
+	void MergePartialEdges(const TArray<Idx<MeshEdge>>& edge_idxs);
 	void MergeEdges(Idx<MeshEdge> edge_idx1, Idx<MeshEdge> edge_idx2);
-	void CleanUpRedundantEdges();
-	void CleanUpRedundantVerts();
+	void CleanUpRedundantEdges(const TArray<Idx<MeshEdge>>& edge_idxs);
+	void CleanUpRedundantVerts(const TArray<Idx<MeshVert>>& vert_idxs);
+
+	// drop all Dead elements and renumber the survivors (keeping their order, so faces stay regular)
+	// anything which walks the whole mesh should do this first
+	void Compact();
+
+	// after anything which rewrites indices wholesale (e.g. loading)
+	void RebuildLookups();
 
-	Idx<MeshFace> AddFaceFromRawVerts(const TArray<MeshVertRaw>& vertices, int UVGroup, const TArray<PGCEdgeType>& edge_types, int channel);
+	Idx<MeshFace> AddFaceFromRawVerts(TArrayView<const MeshVertRaw> vertices, int UVGroup, TArrayView<const PGCEdgeType> edge_types, int channel);
 
 	// the function of these was driven by the AddFace requirement of finding and canceling an existing face
 	// which is the reverse of these, so the arguments here take a face winding the opposite wat to the one we are removing
 	// if we need a "forward" version of either of these it would be trivial to write...
-	bool CancelExistingReverseFace(const TArray<Idx<MeshVert>>& face);
+	bool CancelExistingReverseFace(TArrayView<const Idx<MeshVert>> face);
 	bool CancelExistingReverseFaceFromVects(const TArray<FVector>& vertices);
 
-	Idx<MeshVertRaw> BakeVertex(const MeshVertRaw& mvr);
-	Idx<MeshVertRaw> FindBakedVert(const MeshVertRaw& mvr) const;
+	// with a "normal" only a vert with the same one will do, without one any vert at the same pos + UV will
+	Idx<MeshVertRaw> BakeVertex(const MeshVertRaw& mvr, const FVector* normal = nullptr);
+	Idx<MeshVertRaw> FindBakedVert(const MeshVertRaw& mvr, const FVector* normal = nullptr) const;
 	// take the faces tagged "from_channel" and bake them into the FaceChannel "to_face_channel" in the array
 	// *SPECIAL* to put all channels into one, supply -1 as "from_channel"
-	void BakeChannelsIntoFaceChannel(FPGCMeshResult& mesh, bool insideOut, PGCDebugEdgeType debugEdges, int from_channel, int to_face_channel);
+	// "corner_normals", if given, has a normal per face corner in flat.FaceVerts order and fills in mesh.Normals
+	void BakeChannelsIntoFaceChannel(const FlatMeshView& flat, FPGCMeshResult& mesh, bool insideOut, PGCDebugEdgeType debugEdges, int from_channel, int to_face_channel,
+		const TArray<FVector>* corner_normals);
 
-	TSharedRef<Mesh> SplitSharedVerts();		///< edges and faces should only share a vert if they form a single "pyramid" with that vert as the point, when two 
-									            ///< pyramids share a vert we split the vert
-	TArray<TArray<Idx<MeshFace>>> FindPyramids(Idx<MeshVert> vert_idx);
-	void SplitPyramids(const TArray<TArray<Idx<MeshFace>>>& pyramids, Idx<MeshVert> vert_idx);
+	void SplitSharedVerts();					///< edges and faces should only share a vert if they form a single "pyramid" with that vert as the point, when two 
+									            ///< pyramids share a vert we split the vert, in place, in one walk round each vert
+	void SplitPyramid(Idx<MeshVert> vert_idx, TArrayView<const Idx<MeshFace>> pyramid);
 
 	// if we cyclically re-order the edges, then we can need to reorder the edge_types because during construction
 	// we find the edges from the verts
-	static void RegularizeVertIdxs(TArray<Idx<MeshVert>>& vert_idxs, TArray<PGCEdgeType>* edge_types);
-
-	TSharedPtr<Mesh> SubdivideInner();
-
+	// (rotates in place, "edge_types" can be empty)
+	static void RegularizeVertIdxs(TArrayView<Idx<MeshVert>> vert_idxs, TArrayView<PGCEdgeType> edge_types);
+
+	TSharedPtr<Mesh> SubdivideInner(bool parallel);
+	static void CalcSubdivisionPoints(const FlatMesh& flat, SubdivisionPoints& points, bool parallel);
+	static bool SubdivisionPointsUnique(const SubdivisionPoints& points);
+	// no two the same, and no NaNs
+	static bool PointsUnique(const TArray<FVector>& points);
+	// both of these make the new faces from "points" and give identical meshes (as long as the points are unique)
+	// "Direct" works all the new indices out from the old ones, "BySearch" adds each face by position
+	// (only "Direct" can use threads, the result is the same either way)
+	void BuildSubdivisionDirect(const FlatMesh& flat, const SubdivisionPoints& points, Mesh& ret, bool parallel) const;
+	void BuildSubdivisionBySearch(const FlatMesh& flat, const SubdivisionPoints& points, Mesh& ret) const;
+	// UVs for the new face at corner "corner" of an old face with corner UVs "uvs", in the same order as its verts are made
+	// (old vert, next edge, face, previous edge)
+	static void SubdivisionQuadUVs(TArrayView<const FVector2D> uvs, int corner, const FVector2D& centre_uv, FVector2D quad_uvs[4]);
+
+	// resolves into our own edges
 	void ResolveEffectiveEdgeTypes();
-	void CalcEffectiveType(MeshEdge& edge);
-	FVector CalcNonplanarFaceNormal(const MeshFace& face);
+	// resolves only into "flat", which must be a snapshot of us, so that meshes being shared are only read
+	void ResolveEffectiveEdgeTypes(FlatMesh& flat) const;
 
 public:	
 	// Sets default values for this actor's properties
@@ -548,32 +786,94 @@ public:
 	// so can do a pass of this, but on a divided mesh all faces should be smaller and flatter and that not matter...
 	TSharedPtr<Mesh> Triangularise();
 
-	TSharedPtr<Mesh> Subdivide();
+	// "parallel" spreads the work over threads, without changing the result
+	// a mesh built by adding geometry must have had PrepareForSharing first
+	TSharedPtr<Mesh> Subdivide(bool parallel = false);
 
-	TSharedPtr<Mesh> SubdivideN(int count);
+	// after the first level all faces are quads, and the rest are done in a QuadMesh, which is lighter
+	TSharedPtr<Mesh> SubdivideN(int count, bool parallel = false);
 
 	// where existing edges are duplicated with incoming ones
 	// the result is a sharp edge if either edge is sharp
 	// (this is poor, but only in the same way that building by cubes is poor in the first instance)
 	void AddCube(const FPGCCube& cube);
 
+	// the same as AddCube on each in turn, but works out from the cells which faces are on the outside
+	// and adds only those, with each edge's type merged from every cube along it, in time linear in the number of cubes
+	// a repeated cell is only used the first time
+	void AddCubes(const TArray<FPGCCube>& cubes);
+
+	// returns None if the face cancelled an existing reverse face, or while batching
 	Idx<MeshFace> AddFaceFromVects(const TArray<FVector>& vertices, const TArray<FVector2D>& uvs,
 		int UVGroup, const TArray<PGCEdgeType>& edge_types, int channel);
 
-	void BakeAllChannelsIntoOne(FPGCMeshResult& mesh, bool insideOut, PGCDebugEdgeType debugEdges);
-	void BakeChannels(FPGCMeshResult& mesh, bool insideOut, PGCDebugEdgeType debugEdges, int start_channel, int end_channel);
+	// between these AddFaceFromVects only records each face, EndBatch then works out in one hashed pass which faces
+	// duplicate or cancel which (including ones already in the mesh), and only adds the survivors
+	// so the removals, partial edge merges and clean-ups of cancelling never happen
+	// the result has the same faces and edges as adding each face as it came, although verts and edges can be numbered differently
+	// and an edge type is merged from every face that was added over that pair of verts, even if the edge itself was
+	// removed in between
+	void BeginBatch();
+	void EndBatch();
+
+	// "corner_normals" as from SubdivisionStencils::EvaluateLimit, corners with the same pos and UV
+	// but different normals (e.g. either side of a crease) bake to separate verts
+	void BakeAllChannelsIntoOne(FPGCMeshResult& mesh, bool insideOut, PGCDebugEdgeType debugEdges,
+		const TArray<FVector>* corner_normals = nullptr);
+	void BakeChannels(FPGCMeshResult& mesh, bool insideOut, PGCDebugEdgeType debugEdges, int start_channel, int end_channel,
+		const TArray<FVector>* corner_normals = nullptr);
+
+	// compacts us and returns everything baking needs, effective edge types included
+	TSharedRef<FlatMesh> MakeBakeableFlat();
+
+	// does the in-place fix-ups (compacting, splitting shared verts) that a mesh built by adding geometry needs before it is subdivided,
+	// and resolves our effective edge types, after which subdividing and baking only read us,
+	// and we can be shared between threads that do those
+	void PrepareForSharing();
+
+	// the heap we hold, not counting sizeof(Mesh), for memory budgets, walks every element so don't call it per frame
+	SIZE_T GetAllocatedSize() const;
+
+	// the same bakes from what MakeBakeableFlat gave, with no Mesh needed (e.g. straight from a cache file mapped into memory)
+	static void BakeAllChannelsIntoOne(const FlatMeshView& flat, FPGCMeshResult& mesh, bool insideOut, PGCDebugEdgeType debugEdges,
+		const TArray<FVector>* corner_normals = nullptr);
+	static void BakeChannels(const FlatMeshView& flat, FPGCMeshResult& mesh, bool insideOut, PGCDebugEdgeType debugEdges,
+		int start_channel, int end_channel, const TArray<FVector>* corner_normals = nullptr);
 
 	// C++ only
-	void CheckConsistent(bool closed);
+	// a closed mesh has no holes, an unclosed one may have faces not added yet
+	// checks as much as MeshValidationLevel says
+	void CheckConsistent(bool closed)
+	{
+		if (MeshValidationLevel != MeshValidation::Off)
+		{
+			CheckConsistentInner(closed);
+		}
+	}
 
 	void Clear() {
 		Vertices.Empty();
 		Edges.Empty();
 		Faces.Empty();
 
+		VertLookup.Empty();
+		EdgeLookup.Empty();
+		FaceLookup.Empty();
+
 		NextUVGroup = 0;
+		NumDead = 0;
+
+		UVsInCorners = false;
+
+		AdjacencyPacked = false;
+		PackedVertEdgeStarts.Empty();
+		PackedVertEdges.Empty();
+		PackedVertFaceStarts.Empty();
+		PackedVertFaces.Empty();
 
 		Clean = true;
+
+		ResetTouched();
 	}
 
 #ifndef UE_BUILD_RELEASE
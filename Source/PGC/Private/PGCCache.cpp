@@ -4,6 +4,12 @@
 #include "Runtime/Core/Public/Misc/Paths.h"
 #include "Runtime/Core/Public/Misc/FileHelper.h"
 #include "Runtime/Core/Public/Serialization/MemoryReader.h"
+#include "Runtime/Core/Public/HAL/FileManager.h"
+#include "Runtime/Core/Public/Async/Async.h"
+#include "Runtime/Core/Public/HAL/PlatformFilemanager.h"
+#include "Runtime/Core/Public/HAL/ThreadSafeBool.h"
+#include "Runtime/Core/Public/HAL/Event.h"
+#include "Runtime/Core/Public/Misc/ScopeRWLock.h"
 
 namespace Cache {
 
@@ -11,10 +17,10 @@ namespace Cache {
 
 struct MeshKey {
 	FString GeneratorName;
-	uint32 GeneratorHash;
-	int NumDivisions;
-	bool Triangularise;
-	PGCDebugMode DM;
+	uint32 GeneratorHash = 0;
+	int NumDivisions = 0;
+	bool Triangularise = false;
+	PGCDebugMode DM = PGCDebugMode::Normal;
 
 	bool operator==(const MeshKey& rhs) const {
 		return GeneratorName == rhs.GeneratorName
@@ -48,6 +54,9 @@ FArchive& operator<<(FArchive& Ar, MeshKey& mk) {
 struct MeshVal {
 	TSharedPtr<Mesh> Geom;
 	TSharedPtr<TArray<FPGCNodePosition>> Nodes;
+
+	int64 Bytes = 0;			///< what it has allocated, which is what it counts against the memory budget
+	volatile int64 LastUse = 0;	///< set under only a read lock, so atomically
 };
 
 FArchive& operator<<(FArchive& Ar, MeshVal& mv) {
@@ -72,6 +81,9 @@ FArchive& operator<<(FArchive& Ar, MeshVal& mv) {
 // I define one they can't find it
 struct IGraphVal {
 	TSharedPtr<IGraph> IGraph;
+
+	int64 Bytes = 0;
+	volatile int64 LastUse = 0;
 };
 
 FArchive& operator<<(FArchive& Ar, IGraphVal& igv)
@@ -86,70 +98,914 @@ FArchive& operator<<(FArchive& Ar, IGraphVal& igv)
 	return Ar;
 }
 
-// --
+// on disk the cache is two append-only files, "CacheData.dat" holds the serialized entries one after another
+// and "CacheIndex.dat" has a record for each saying where in the data it is, so storing an entry costs that entry
+// and not the whole cache
+//
+// an entry stored again leaves its old bytes dead in the data file, when there get to be more dead bytes than live ones
+// we compact, copying just the live entries to new files, on a background thread
+//
+// nothing else ever goes dead: an entry for a generator hash that is no longer used, e.g. from before an edit, stays
+// for good, as we can't tell that nothing will ask for it again (it could be undone, or be another generator's with the
+// same name), and as EnsureMesh and GetOrMakeIGraph only store what they couldn't find, in practice only a store after
+// a failed read leaves anything dead, so the files only grow, and deleting them is how to clear the cache
+
+enum class EntryKind : uint8 {
+	IGraph,
+	Mesh,
+	BakeableMesh		///< a FlatMesh layout, then the nodes, starting on FlatMeshView::LayoutAlignment so it can be used where it's mapped
+};
+
+struct EntryLocation {
+	int64 Offset = 0;
+	int64 Length = 0;
+};
+
+static const uint32 IndexMagic = 0x49434750;		///< "PGCI"
+static const uint32 DataMagic = 0x44434750;			///< "PGCD"
+static const uint32 FileVersion = 1;
+
+// the headers are magic, version and generation, the generation goes up each compaction,
+// and if the two files disagree on it we crashed part way through swapping them in
+static const int64 HeaderSize = 12;
+
+// not worth rewriting the files for less than this
+static const int64 MinDeadBytesToCompact = 64 * 1024 * 1024;
+
+// a read from disk, or a make, of one key, which other threads wanting the same key wait on rather than doing it again
+struct InFlight {
+	FEvent* Done;
+
+	InFlight() : Done(FPlatformProcess::GetSynchEventFromPool(true)) {}
+	~InFlight() { FPlatformProcess::ReturnSynchEventToPool(Done); }
+};
 
-static TMap<uint32, IGraphVal> IGraphCache;
-static TMap<MeshKey, MeshVal> MeshCache;
-// the idea is we load once, automatically, on first use an a session
-static bool IsLoaded = false;
+// the entries in memory are split over shards by key, each with its own reader/writer lock,
+// so that lookups of different keys don't contend and lookups of the same key only share a read lock
+struct Shard {
+	FRWLock Lock;
+	TMap<uint32, IGraphVal> IGraphs;
+	TMap<MeshKey, MeshVal> Meshes;
+	TMap<uint32, TSharedPtr<InFlight>> IGraphsInFlight;
+	TMap<MeshKey, TSharedPtr<InFlight>> MeshesInFlight;
+};
+
+static const int NumShards = 16;
+static Shard Shards[NumShards];
+
+// the idea is we load the index once, automatically, on first use an a session
+static FThreadSafeBool IsLoaded = false;
+
+// entries in memory are let go, least recently used first, once they add up to more than this
+static volatile int64 MemoryBudget = 512 * 1024 * 1024;
+static volatile int64 ResidentBytes = 0;
+static volatile int64 UseClock = 0;
+// one eviction at a time
+static FCriticalSection EvictLock;
+
+// everything below is only touched with FileLock held, because compaction works on it from another thread
+// (never take a shard's lock while holding this, or the other way round)
+static FCriticalSection FileLock;
+static TMap<uint32, EntryLocation> IGraphLocations;
+static TMap<MeshKey, EntryLocation> MeshLocations;
+static TMap<MeshKey, EntryLocation> BakeableLocations;
+static uint32 Generation = 0;
+static int64 LiveBytes = 0;
+static int64 DeadBytes = 0;
+static bool Compacting = false;
 
 // local methods
 
-static void SaveLoad(FArchive& Ar)
+static FString CacheDir() {
+	return FPaths::ConvertRelativePathToFull(FPaths::RootDir()) + "\\PGC\\Data\\";
+}
+
+static FString IndexPath() {
+	return CacheDir() + "CacheIndex.dat";
+}
+
+static FString DataPath() {
+	return CacheDir() + "CacheData.dat";
+}
+
+static void WriteHeaders(FArchive& index, FArchive& data, uint32 generation)
 {
-	Ar << IGraphCache;
-	Ar << MeshCache;
+	uint32 index_magic = IndexMagic;
+	uint32 data_magic = DataMagic;
+	uint32 version = FileVersion;
+
+	index << index_magic << version << generation;
+	data << data_magic << version << generation;
 }
 
-static FString SavePath() {
-	return FPaths::ConvertRelativePathToFull(FPaths::RootDir()) + "\\PGC\\Data\\Cache.dat";
+// creates empty files if we don't have any
+static bool EnsureFiles()
+{
+	auto& fm = IFileManager::Get();
+
+	if (fm.FileSize(*IndexPath()) >= HeaderSize && fm.FileSize(*DataPath()) >= HeaderSize)
+		return true;
+
+	TUniquePtr<FArchive> index(fm.CreateFileWriter(*IndexPath()));
+	TUniquePtr<FArchive> data(fm.CreateFileWriter(*DataPath()));
+
+	if (!index || !data)
+		return false;
+
+	Generation = 0;
+	WriteHeaders(*index, *data, Generation);
+
+	IGraphLocations.Reset();
+	MeshLocations.Reset();
+	BakeableLocations.Reset();
+	LiveBytes = 0;
+	DeadBytes = 0;
+
+	// both must close cleanly, so evaluate both
+	bool index_ok = index->Close();
+	bool data_ok = data->Close();
+
+	return index_ok && data_ok;
 }
 
-static void Save() {
-	FBufferArchive Ar;
+static void SerializeIndexRecord(FArchive& Ar, EntryKind& kind, uint32& hash, MeshKey& mesh_key, EntryLocation& loc)
+{
+	Ar << kind;
+
+	if (kind == EntryKind::IGraph)
+	{
+		Ar << hash;
+	}
+	else
+	{
+		Ar << mesh_key;
+	}
 
-	SaveLoad(Ar);
+	Ar << loc.Offset;
+	Ar << loc.Length;
+}
 
-	FFileHelper::SaveArrayToFile(Ar, *SavePath());
+template <typename Key>
+static void NoteLocation(TMap<Key, EntryLocation>& locations, const Key& key, const EntryLocation& loc)
+{
+	if (auto old = locations.Find(key))
+	{
+		LiveBytes -= old->Length;
+		DeadBytes += old->Length;
+	}
+
+	locations.Add(key, loc);
+	LiveBytes += loc.Length;
+}
+
+// reads the index into the locations, returns false if it needs rewriting
+// (it has a torn record on the end, from a crash during a store, or it's missing or not ours)
+static bool ReadIndex()
+{
+	IGraphLocations.Reset();
+	MeshLocations.Reset();
+	BakeableLocations.Reset();
+	LiveBytes = 0;
+	DeadBytes = 0;
+
+	TArray<uint8> index_data;
+
+	if (!FFileHelper::LoadFileToArray(index_data, *IndexPath()))
+		return false;
+
+	auto data_size = IFileManager::Get().FileSize(*DataPath());
+
+	TUniquePtr<FArchive> data(IFileManager::Get().CreateFileReader(*DataPath()));
+
+	if (!data)
+		return false;
+
+	uint32 index_magic = 0, data_magic = 0, index_version = 0, data_version = 0, index_generation = 0, data_generation = 0;
+
+	FMemoryReader index(index_data);
+	index << index_magic << index_version << index_generation;
+	*data << data_magic << data_version << data_generation;
+
+	if (index.IsError() || data->IsError()
+		|| index_magic != IndexMagic || data_magic != DataMagic
+		|| index_version != FileVersion || data_version != FileVersion
+		|| index_generation != data_generation)
+		return false;
+
+	Generation = index_generation;
+
+	while (index.Tell() < index.TotalSize())
+	{
+		EntryKind kind;
+		uint32 hash = 0;
+		MeshKey mesh_key;
+		EntryLocation loc;
+
+		SerializeIndexRecord(index, kind, hash, mesh_key, loc);
+
+		// a record cut short, or pointing at data that never got written
+		if (index.IsError() || loc.Offset < HeaderSize || loc.Length < 0 || loc.Offset + loc.Length > data_size)
+			return false;
+
+		if (kind == EntryKind::IGraph)
+		{
+			NoteLocation(IGraphLocations, hash, loc);
+		}
+		else if (kind == EntryKind::Mesh)
+		{
+			NoteLocation(MeshLocations, mesh_key, loc);
+		}
+		else if (kind == EntryKind::BakeableMesh)
+		{
+			NoteLocation(BakeableLocations, mesh_key, loc);
+		}
+		else
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static int64 AlignmentOf(EntryKind kind)
+{
+	return kind == EntryKind::BakeableMesh ? FlatMeshView::LayoutAlignment : 1;
+}
+
+// zeros up to where an entry of "kind" can start
+static void PadFor(FArchive& data, EntryKind kind)
+{
+	static const uint8 zeros[FlatMeshView::LayoutAlignment] = {};
+
+	auto alignment = AlignmentOf(kind);
+	auto pos = data.Tell();
+	auto padding = (alignment - pos % alignment) % alignment;
+
+	data.Serialize(const_cast<uint8*>(zeros), padding);
+}
+
+static bool ReadPayload(FArchive& data, const EntryLocation& loc, TArray<uint8>& payload)
+{
+	payload.SetNumUninitialized(loc.Length);
+
+	data.Seek(loc.Offset);
+	data.Serialize(payload.GetData(), loc.Length);
+
+	return !data.IsError();
+}
+
+// for compaction, copies each entry "locations" has, that "done" doesn't have at the same place, with "copy",
+// and notes where it went in "new_locations", counting anything this replaces there into "dead"
+template <typename Key, typename Copy>
+static void CopyEntries(const TMap<Key, EntryLocation>& locations, const TMap<Key, EntryLocation>& done,
+	TMap<Key, EntryLocation>& new_locations, int64& dead, Copy copy)
+{
+	for (const auto& pair : locations)
+	{
+		auto already = done.Find(pair.Key);
+
+		if (already && already->Offset == pair.Value.Offset)
+			continue;
+
+		if (auto replaced = new_locations.Find(pair.Key))
+		{
+			dead += replaced->Length;
+		}
+
+		new_locations.Add(pair.Key, copy(pair.Key, pair.Value));
+	}
+}
+
+template <typename Key>
+static int64 TotalLength(const TMap<Key, EntryLocation>& locations)
+{
+	int64 ret = 0;
+
+	for (const auto& pair : locations)
+	{
+		ret += pair.Value.Length;
+	}
+
+	return ret;
+}
+
+// copies the live entries into new files and swaps them in, on a background thread
+//
+// the data file is only ever appended to, so nothing a snapshot of the locations points at can change under us,
+// and we copy what the snapshot has without FileLock, then take it only to copy what was stored meanwhile
+// and swap the files, which is all that stores have to wait for
+// (some platforms won't replace a file while a BakeableMesh still has it mapped, then we leave things as they were
+// and a later store tries again)
+static void Compact()
+{
+	auto& fm = IFileManager::Get();
+
+	auto index_tmp = IndexPath() + ".tmp";
+	auto data_tmp = DataPath() + ".tmp";
+
+	TMap<uint32, EntryLocation> igraph_snapshot;
+	TMap<MeshKey, EntryLocation> mesh_snapshot;
+	TMap<MeshKey, EntryLocation> bakeable_snapshot;
+	uint32 new_generation = 0;
+
+	{
+		FScopeLock lock(&FileLock);
+
+		igraph_snapshot = IGraphLocations;
+		mesh_snapshot = MeshLocations;
+		bakeable_snapshot = BakeableLocations;
+		new_generation = Generation + 1;
+	}
+
+	TMap<uint32, EntryLocation> new_igraph_locations;
+	TMap<MeshKey, EntryLocation> new_mesh_locations;
+	TMap<MeshKey, EntryLocation> new_bakeable_locations;
+	// entries stored again while we were copying leave their first copy dead in the new files
+	int64 new_dead_bytes = 0;
+
+	TUniquePtr<FArchive> index(fm.CreateFileWriter(*index_tmp));
+	TUniquePtr<FArchive> data(fm.CreateFileWriter(*data_tmp));
+
+	TUniquePtr<FArchive> from;
+	TArray<uint8> payload;
+	bool ok = index && data;
+
+	auto copy = [&](EntryKind kind, uint32 hash, MeshKey mesh_key, const EntryLocation& loc) {
+		if (!ok || !ReadPayload(*from, loc, payload))
+		{
+			ok = false;
+			return EntryLocation();
+		}
+
+		PadFor(*data, kind);
+
+		EntryLocation new_loc{ data->Tell(), loc.Length };
+		data->Serialize(payload.GetData(), payload.Num());
+
+		SerializeIndexRecord(*index, kind, hash, mesh_key, new_loc);
+
+		return new_loc;
+	};
+
+	// copies what the first three have that the last three don't have at the same place
+	auto copy_all = [&](const TMap<uint32, EntryLocation>& igraphs, const TMap<MeshKey, EntryLocation>& meshes,
+		const TMap<MeshKey, EntryLocation>& bakeables, const TMap<uint32, EntryLocation>& done_igraphs,
+		const TMap<MeshKey, EntryLocation>& done_meshes, const TMap<MeshKey, EntryLocation>& done_bakeables) {
+		CopyEntries(igraphs, done_igraphs, new_igraph_locations, new_dead_bytes,
+			[&](uint32 hash, const EntryLocation& loc) { return copy(EntryKind::IGraph, hash, MeshKey(), loc); });
+		CopyEntries(meshes, done_meshes, new_mesh_locations, new_dead_bytes,
+			[&](const MeshKey& key, const EntryLocation& loc) { return copy(EntryKind::Mesh, 0, key, loc); });
+		CopyEntries(bakeables, done_bakeables, new_bakeable_locations, new_dead_bytes,
+			[&](const MeshKey& key, const EntryLocation& loc) { return copy(EntryKind::BakeableMesh, 0, key, loc); });
+	};
+
+	if (ok)
+	{
+		WriteHeaders(*index, *data, new_generation);
+
+		// stores go on appending to the data file while we read it
+		from.Reset(fm.CreateFileReader(*DataPath(), FILEREAD_AllowWrite));
+		ok = from.IsValid();
+
+		copy_all(igraph_snapshot, mesh_snapshot, bakeable_snapshot, {}, {}, {});
+	}
+
+	FScopeLock lock(&FileLock);
+
+	// whatever was stored, or stored again, since the snapshot, from a fresh reader, which sees all of the file
+	from.Reset(ok ? fm.CreateFileReader(*DataPath()) : nullptr);
+	ok = ok && from.IsValid();
+
+	copy_all(IGraphLocations, MeshLocations, BakeableLocations, igraph_snapshot, mesh_snapshot, bakeable_snapshot);
+
+	from.Reset();
+
+	if (index && data)
+	{
+		bool index_ok = index->Close();
+		bool data_ok = data->Close();
+
+		ok = ok && index_ok && data_ok;
+	}
+
+	index.Reset();
+	data.Reset();
+
+	// data first, a crash between the two moves leaves the generations disagreeing and the cache is dropped
+	if (ok
+		&& fm.Move(*DataPath(), *data_tmp, true)
+		&& fm.Move(*IndexPath(), *index_tmp, true))
+	{
+		IGraphLocations = MoveTemp(new_igraph_locations);
+		MeshLocations = MoveTemp(new_mesh_locations);
+		BakeableLocations = MoveTemp(new_bakeable_locations);
+		Generation = new_generation;
+		LiveBytes = TotalLength(IGraphLocations) + TotalLength(MeshLocations) + TotalLength(BakeableLocations);
+		DeadBytes = new_dead_bytes;
+	}
+	else
+	{
+		fm.Delete(*index_tmp);
+		fm.Delete(*data_tmp);
+	}
+
+	Compacting = false;
+}
+
+static void CompactIfWorthIt()
+{
+	if (!Compacting && DeadBytes > MinDeadBytesToCompact && DeadBytes > LiveBytes)
+	{
+		Compacting = true;
+
+		AsyncTask(ENamedThreads::AnyBackgroundThreadNormalTask, [] { Compact(); });
+	}
+}
+
+// writes the entry on the end of the data file and then its record on the end of the index,
+// so the index never refers to data that isn't there yet
+template <typename Key>
+static void Append(EntryKind kind, uint32 hash, MeshKey mesh_key, const TArray<uint8>& payload,
+	TMap<Key, EntryLocation>& locations, const Key& key)
+{
+	FScopeLock lock(&FileLock);
+
+	if (!EnsureFiles())
+		return;
+
+	auto& fm = IFileManager::Get();
+
+	EntryLocation loc;
+
+	{
+		// compaction can be reading it meanwhile
+		TUniquePtr<FArchive> data(fm.CreateFileWriter(*DataPath(), FILEWRITE_Append | FILEWRITE_AllowRead));
+
+		if (!data)
+			return;
+
+		PadFor(*data, kind);
+
+		loc = EntryLocation{ data->Tell(), payload.Num() };
+		data->Serialize(const_cast<uint8*>(payload.GetData()), payload.Num());
+
+		if (!data->Close())
+			return;
+	}
+
+	{
+		// one write for the whole record, so that a crash can only cut it short
+		FBufferArchive record;
+		SerializeIndexRecord(record, kind, hash, mesh_key, loc);
+
+		TUniquePtr<FArchive> index(fm.CreateFileWriter(*IndexPath(), FILEWRITE_Append));
+
+		if (!index)
+			return;
+
+		index->Serialize(record.GetData(), record.Num());
+
+		if (!index->Close())
+			return;
+	}
+
+	NoteLocation(locations, key, loc);
+
+	CompactIfWorthIt();
 }
 
 static void Load() {
 	if (IsLoaded)
 		return;
 
+	// only the index, entries are read when first asked for
+	FScopeLock lock(&FileLock);
+
+	// someone else got here first
+	if (IsLoaded)
+		return;
+
 	// do this even if we fail, because we don't want to try over and over
 	IsLoaded = true;
 
-	TArray<uint8> data;
+	// the old single-file cache, rewritten in full on every store, is no use to us
+	IFileManager::Get().Delete(*(CacheDir() + "Cache.dat"), false, false, true);
+
+	if (!ReadIndex())
+	{
+		// keep what we could read, and rewrite the files without the damage
+		if (IGraphLocations.Num() || MeshLocations.Num() || BakeableLocations.Num())
+		{
+			Compacting = true;
+			Compact();
+		}
+
+		if (!ReadIndex())
+		{
+			IFileManager::Get().Delete(*IndexPath(), false, false, true);
+			IFileManager::Get().Delete(*DataPath(), false, false, true);
+			EnsureFiles();
+		}
+	}
+}
+
+static Shard& ShardOf(uint32 hash)
+{
+	return Shards[hash % NumShards];
+}
+
+static Shard& ShardOf(const MeshKey& key)
+{
+	return Shards[GetTypeHash(key) % NumShards];
+}
+
+static TMap<uint32, IGraphVal>& EntriesOf(Shard& shard, uint32)
+{
+	return shard.IGraphs;
+}
+
+static TMap<MeshKey, MeshVal>& EntriesOf(Shard& shard, const MeshKey&)
+{
+	return shard.Meshes;
+}
+
+static TMap<uint32, TSharedPtr<InFlight>>& InFlightOf(Shard& shard, uint32)
+{
+	return shard.IGraphsInFlight;
+}
+
+static TMap<MeshKey, TSharedPtr<InFlight>>& InFlightOf(Shard& shard, const MeshKey&)
+{
+	return shard.MeshesInFlight;
+}
+
+static const TMap<uint32, EntryLocation>& LocationsOf(uint32)
+{
+	return IGraphLocations;
+}
+
+static const TMap<MeshKey, EntryLocation>& LocationsOf(const MeshKey&)
+{
+	return MeshLocations;
+}
+
+template <typename Val>
+static void Touch(Val& val)
+{
+	FPlatformAtomics::InterlockedExchange(&val.LastUse, FPlatformAtomics::InterlockedIncrement(&UseClock));
+}
+
+// what an entry has allocated, for the memory budget
+static int64 AllocatedSize(const MeshVal& val)
+{
+	return sizeof(Mesh) + val.Geom->GetAllocatedSize() + val.Nodes->GetAllocatedSize();
+}
+
+static int64 AllocatedSize(const IGraphVal& val)
+{
+	return sizeof(IGraph) + val.IGraph->GetAllocatedSize();
+}
+
+template <typename Val>
+static void NoteResident(Val& val, int64 bytes)
+{
+	val.Bytes = bytes;
+	FPlatformAtomics::InterlockedAdd(&ResidentBytes, bytes);
+
+	Touch(val);
+}
+
+// lets go of "key" if it hasn't been used since "last_use"
+template <typename Key>
+static void EvictEntry(const Key& key, int64 last_use)
+{
+	auto& shard = ShardOf(key);
+
+	FWriteScopeLock lock(shard.Lock);
+
+	auto& entries = EntriesOf(shard, key);
+	auto found = entries.Find(key);
+
+	if (!found || found->LastUse != last_use)
+		return;
+
+	FPlatformAtomics::InterlockedAdd(&ResidentBytes, -found->Bytes);
+	entries.Remove(key);
+}
+
+// lets go of the least recently used entries until we're within MemoryBudget, they stay in the files to be read back if wanted
+// only entries the index has can go, anything whose store failed would be lost, and never the most recently used one
+static void EvictToBudget()
+{
+	if (ResidentBytes <= MemoryBudget)
+		return;
+
+	FScopeLock evict_lock(&EvictLock);
+
+	struct Candidate {
+		int64 LastUse;
+		EntryKind Kind;
+		uint32 Hash;
+		MeshKey Key;
+	};
+
+	TArray<Candidate> candidates;
+
+	for (auto& shard : Shards)
+	{
+		FReadScopeLock lock(shard.Lock);
+
+		for (const auto& pair : shard.IGraphs)
+		{
+			candidates.Push({ pair.Value.LastUse, EntryKind::IGraph, pair.Key, MeshKey() });
+		}
+
+		for (const auto& pair : shard.Meshes)
+		{
+			candidates.Push({ pair.Value.LastUse, EntryKind::Mesh, 0, pair.Key });
+		}
+	}
+
+	candidates.Sort([](const Candidate& a, const Candidate& b) { return a.LastUse < b.LastUse; });
+
+	if (candidates.Num())
+	{
+		candidates.Pop();
+	}
+
+	{
+		FScopeLock lock(&FileLock);
+
+		candidates.RemoveAll([](const Candidate& c) {
+			return c.Kind == EntryKind::IGraph ? !IGraphLocations.Contains(c.Hash) : !MeshLocations.Contains(c.Key);
+		});
+	}
+
+	for (const auto& c : candidates)
+	{
+		if (ResidentBytes <= MemoryBudget)
+			break;
+
+		if (c.Kind == EntryKind::IGraph)
+		{
+			EvictEntry(c.Hash, c.LastUse);
+		}
+		else
+		{
+			EvictEntry(c.Key, c.LastUse);
+		}
+	}
+}
+
+enum class Claim {
+	Present,		///< someone else has put it in memory meanwhile
+	Ours,			///< we are to read it or make it, and must ReleaseClaim after
+	Waited			///< someone else was reading or making it, and has finished, with or without success
+};
+
+template <typename Key>
+static Claim ClaimEntry(const Key& key, TSharedPtr<InFlight>& in_flight)
+{
+	auto& shard = ShardOf(key);
+
+	{
+		FWriteScopeLock lock(shard.Lock);
+
+		if (EntriesOf(shard, key).Contains(key))
+			return Claim::Present;
+
+		if (auto existing = InFlightOf(shard, key).Find(key))
+		{
+			in_flight = *existing;
+		}
+		else
+		{
+			in_flight = MakeShared<InFlight>();
+			InFlightOf(shard, key).Add(key, in_flight);
+
+			return Claim::Ours;
+		}
+	}
+
+	in_flight->Done->Wait();
+
+	return Claim::Waited;
+}
+
+template <typename Key>
+static void ReleaseClaim(const Key& key, const TSharedPtr<InFlight>& in_flight)
+{
+	auto& shard = ShardOf(key);
 
-	if (FFileHelper::LoadFileToArray(data, *SavePath()))
 	{
-		FMemoryReader FromBinary = FMemoryReader(data, true); //true, free data after done
-		FromBinary.Seek(0);
+		FWriteScopeLock lock(shard.Lock);
 
-		SaveLoad(FromBinary);
+		InFlightOf(shard, key).Remove(key);
 	}
+
+	in_flight->Done->Trigger();
 }
 
+// reads "key" from the data file, FileLock is only held for the read, not while deserializing
+template <typename Key, typename Val>
+static bool ReadEntry(const Key& key, Val& out)
+{
+	TArray<uint8> payload;
+
+	{
+		FScopeLock lock(&FileLock);
+
+		auto loc = LocationsOf(key).Find(key);
+
+		if (!loc)
+			return false;
+
+		TUniquePtr<FArchive> data(IFileManager::Get().CreateFileReader(*DataPath()));
+
+		if (!data || !ReadPayload(*data, *loc, payload))
+			return false;
+	}
+
+	FMemoryReader from_binary(payload);
+
+	from_binary << out;
+
+	out.Bytes = AllocatedSize(out);
+
+	return !from_binary.IsError();
+}
+
+// the entry for "key", read in from the data file the first time it's asked for (or the first time since we let it go)
+// so that starting up costs the size of the index and not of everything in the cache
+// only one thread reads in any one key, any others asking for it meanwhile wait for that
+template <typename Key, typename Val>
+static bool FindEntry(const Key& key, Val& out)
+{
+	auto& shard = ShardOf(key);
+
+	for (;;)
+	{
+		{
+			FReadScopeLock lock(shard.Lock);
+
+			if (auto found = EntriesOf(shard, key).Find(key))
+			{
+				Touch(*found);
+				out = *found;
+
+				return true;
+			}
+		}
+
+		TSharedPtr<InFlight> in_flight;
+
+		// either way, look again
+		if (ClaimEntry(key, in_flight) != Claim::Ours)
+			continue;
+
+		bool ok = ReadEntry(key, out);
+
+		if (ok)
+		{
+			FWriteScopeLock lock(shard.Lock);
+
+			auto& added = EntriesOf(shard, key).Add(key, out);
+
+			NoteResident(added, out.Bytes);
+			out = added;
+		}
+
+		ReleaseClaim(key, in_flight);
+
+		if (ok)
+		{
+			EvictToBudget();
+		}
+
+		return ok;
+	}
+}
+
+template <typename Val>
+static TArray<uint8> SavePayload(Val& val)
+{
+	FBufferArchive Ar;
+
+	Ar << val;
+
+	return MoveTemp(Ar);
+}
+
+// holds the bytes a BakeableMesh's view points into, either the mapped region of the data file, or a copy
+// where we can't map
+//
+// a copy counts against the memory budget while it lives, though it can't be evicted, a mapped region is the OS's
+class MappedBakeableMesh : public BakeableMesh {
+public:
+	~MappedBakeableMesh()
+	{
+		FPlatformAtomics::InterlockedAdd(&ResidentBytes, -ChargedBytes);
+	}
+
+	// the region must go before the file it's mapped from
+	TUniquePtr<IMappedFileHandle> Handle;
+	TUniquePtr<IMappedFileRegion> Region;
+	TArray<uint8> Bytes;
+
+	bool SetFrom(const uint8* data, int64 size)
+	{
+		auto flat_size = Flat.ReadLayout(data, size);
+
+		if (flat_size < 0)
+			return false;
+
+		// the nodes are few, so they are just serialized after the flat arrays
+		TArray<uint8> node_data(data + flat_size, size - flat_size);
+		FMemoryReader from_binary(node_data);
+
+		from_binary << Nodes;
+
+		return !from_binary.IsError();
+	}
+
+	// call once Bytes holds the copy
+	void ChargeBytes()
+	{
+		check(!ChargedBytes);
+
+		ChargedBytes = Bytes.GetAllocatedSize();
+		FPlatformAtomics::InterlockedAdd(&ResidentBytes, ChargedBytes);
+	}
+
+private:
+	int64 ChargedBytes = 0;
+};
+
 // --
 
 TSharedPtr<IGraph> PGCCache::GetIGraph(uint32 hash)
 {
 	Load();
 
-	if (IGraphCache.Contains(hash))
-		return IGraphCache[hash].IGraph;
+	IGraphVal found;
+
+	if (FindEntry(hash, found))
+		return found.IGraph;
 
 	return TSharedPtr<IGraph>();
 }
 
 void PGCCache::StoreIGraph(uint32 hash, const TSharedPtr<IGraph>& i_graph)
 {
-	check(!IGraphCache.Contains(hash));
+	Load();
+
+	IGraphVal val{ i_graph };
+	auto payload = SavePayload(val);
+	auto bytes = AllocatedSize(val);
+
+	{
+		auto& shard = ShardOf(hash);
+
+		FWriteScopeLock lock(shard.Lock);
+
+		check(!shard.IGraphs.Contains(hash));
+
+		NoteResident(shard.IGraphs.Add(hash, val), bytes);
+	}
+
+	Append(EntryKind::IGraph, hash, MeshKey(), payload, IGraphLocations, hash);
+
+	EvictToBudget();
+}
+
+TSharedPtr<IGraph> PGCCache::GetOrMakeIGraph(uint32 hash, TFunctionRef<TSharedPtr<IGraph>()> make)
+{
+	Load();
+
+	for (;;)
+	{
+		IGraphVal found;
+
+		if (FindEntry(hash, found))
+			return found.IGraph;
+
+		TSharedPtr<InFlight> in_flight;
+
+		if (ClaimEntry(hash, in_flight) != Claim::Ours)
+			continue;
 
-	IGraphCache.Add(hash, IGraphVal{ i_graph });
+		auto made = make();
 
-	Save();
+		if (made.IsValid())
+		{
+			StoreIGraph(hash, made);
+		}
+
+		ReleaseClaim(hash, in_flight);
+
+		return made;
+	}
 }
 
 TSharedPtr<Mesh> PGCCache::GetMesh(const FString& generator_name, uint32 generator_hash,
@@ -157,10 +1013,10 @@ TSharedPtr<Mesh> PGCCache::GetMesh(const FString& generator_name, uint32 generat
 {
 	Load();
 
-	auto key = MeshKey{ generator_name, generator_hash, num_divisions, triangularise, dm };
+	MeshVal found;
 
-	if (MeshCache.Contains(key))
-		return MeshCache[key].Geom;
+	if (FindEntry(MeshKey{ generator_name, generator_hash, num_divisions, triangularise, dm }, found))
+		return found.Geom;
 
 	return TSharedPtr<Mesh>();
 }
@@ -170,10 +1026,10 @@ TSharedPtr<TArray<FPGCNodePosition>> PGCCache::GetMeshNodes(const FString& gener
 {
 	Load();
 
-	auto key = MeshKey{ generator_name, generator_hash, num_divisions, triangularise, dm };
+	MeshVal found;
 
-	if (MeshCache.Contains(key))
-		return MeshCache[key].Nodes;
+	if (FindEntry(MeshKey{ generator_name, generator_hash, num_divisions, triangularise, dm }, found))
+		return found.Nodes;
 
 	return TSharedPtr<TArray<FPGCNodePosition>>();
 }
@@ -182,13 +1038,147 @@ void PGCCache::StoreMesh(const FString& generator_name, uint32 generator_hash,
 	int num_divisions, bool triangularise, PGCDebugMode dm,
 	const TSharedPtr<Mesh>& mesh, const TSharedPtr<TArray<FPGCNodePosition>>& nodes)
 {
+	Load();
+
+	auto key = MeshKey{ generator_name, generator_hash, num_divisions, triangularise, dm };
+
+	// once it's in the cache, other threads can be subdividing or baking it at the same time
+	mesh->PrepareForSharing();
+
+	MeshVal val{ mesh, nodes };
+	auto payload = SavePayload(val);
+	auto bytes = AllocatedSize(val);
+
+	{
+		auto& shard = ShardOf(key);
+
+		FWriteScopeLock lock(shard.Lock);
+
+		check(!shard.Meshes.Contains(key));
+
+		NoteResident(shard.Meshes.Add(key, val), bytes);
+	}
+
+	Append(EntryKind::Mesh, 0, key, payload, MeshLocations, key);
+
+	EvictToBudget();
+}
+
+void PGCCache::EnsureMesh(const FString& generator_name, uint32 generator_hash,
+	int num_divisions, bool triangularise, PGCDebugMode dm, TFunctionRef<void()> make)
+{
+	Load();
+
+	auto key = MeshKey{ generator_name, generator_hash, num_divisions, triangularise, dm };
+
+	for (;;)
+	{
+		MeshVal found;
+
+		if (FindEntry(key, found))
+			return;
+
+		TSharedPtr<InFlight> in_flight;
+
+		if (ClaimEntry(key, in_flight) != Claim::Ours)
+			continue;
+
+		make();
+
+		ReleaseClaim(key, in_flight);
+
+		return;
+	}
+}
+
+TSharedPtr<const BakeableMesh> PGCCache::GetBakeableMesh(const FString& generator_name, uint32 generator_hash,
+	int num_divisions, bool triangularise, PGCDebugMode dm)
+{
+	Load();
+
 	auto key = MeshKey{ generator_name, generator_hash, num_divisions, triangularise, dm };
 
-	check(!MeshCache.Contains(key));
+	FScopeLock lock(&FileLock);
+
+	auto loc = BakeableLocations.Find(key);
+
+	if (!loc)
+		return TSharedPtr<const BakeableMesh>();
+
+	auto ret = MakeShared<MappedBakeableMesh>();
+	const uint8* data = nullptr;
+
+	ret->Handle.Reset(FPlatformFileManager::Get().GetPlatformFile().OpenMapped(*DataPath()));
 
-	MeshCache.Add(key, {mesh, nodes});
+	if (ret->Handle)
+	{
+		ret->Region.Reset(ret->Handle->MapRegion(loc->Offset, loc->Length));
+	}
+
+	if (ret->Region)
+	{
+		data = ret->Region->GetMappedPtr();
+	}
+	else
+	{
+		TUniquePtr<FArchive> from(IFileManager::Get().CreateFileReader(*DataPath()));
+
+		if (!from || !ReadPayload(*from, *loc, ret->Bytes))
+			return TSharedPtr<const BakeableMesh>();
 
-	Save();
+		// not evicting for it here, under FileLock, the next store or read will
+		ret->ChargeBytes();
+		data = ret->Bytes.GetData();
+	}
+
+	if (!ret->SetFrom(data, loc->Length))
+		return TSharedPtr<const BakeableMesh>();
+
+	return ret;
 }
 
-}
\ No newline at end of file
+TSharedPtr<const BakeableMesh> PGCCache::StoreBakeableMesh(const FString& generator_name, uint32 generator_hash,
+	int num_divisions, bool triangularise, PGCDebugMode dm,
+	const FlatMesh& flat, const TArray<FPGCNodePosition>& nodes)
+{
+	Load();
+
+	auto key = MeshKey{ generator_name, generator_hash, num_divisions, triangularise, dm };
+
+	auto ret = MakeShared<MappedBakeableMesh>();
+
+	flat.WriteLayout(ret->Bytes);
+
+	{
+		FBufferArchive Ar;
+		auto temp = nodes;
+
+		Ar << temp;
+
+		ret->Bytes.Append(Ar);
+	}
+
+	Append(EntryKind::BakeableMesh, 0, key, ret->Bytes, BakeableLocations, key);
+
+	// the caller bakes from our own copy, next time it comes from the file
+	verify(ret->SetFrom(ret->Bytes.GetData(), ret->Bytes.Num()));
+	ret->ChargeBytes();
+
+	EvictToBudget();
+
+	return ret;
+}
+
+void PGCCache::SetMemoryBudget(int64 bytes)
+{
+	FPlatformAtomics::InterlockedExchange(&MemoryBudget, bytes);
+
+	EvictToBudget();
+}
+
+int64 PGCCache::GetResidentBytes()
+{
+	return ResidentBytes;
+}
+
+}
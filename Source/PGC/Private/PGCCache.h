@@ -2,10 +2,26 @@
 
 #include "StructuralGraph.h"
 #include "PGCGenerator.h"
+#include "FlatMesh.h"
+
+#include "Runtime/Core/Public/Templates/Function.h"
 
 namespace Cache {
 using IGraph = StructuralGraph::IGraph;
 
+// a cached mesh as Mesh::MakeBakeableFlat left it, ready for the static Mesh bakes, "Flat" points into the cache file
+// mapped into memory, which stays mapped as long as this lives, so don't hang on to one
+class BakeableMesh
+{
+public:
+	virtual ~BakeableMesh() {}
+
+	FlatMeshView Flat;
+	TArray<FPGCNodePosition> Nodes;
+};
+
+// all of these can be called from any thread, at the same time
+// what is handed out is shared with other callers, so treat it as read-only
 class PGCCache
 {
 public:
@@ -14,6 +30,9 @@ public:
 
 	static TSharedPtr<IGraph> GetIGraph(uint32 hash);
 	static void StoreIGraph(uint32 hash, const TSharedPtr<IGraph>& i_graph);
+	// if we don't have it, "make" makes it and we store it, and anyone else asking for the same hash meanwhile
+	// waits for that rather than making it again
+	static TSharedPtr<IGraph> GetOrMakeIGraph(uint32 hash, TFunctionRef<TSharedPtr<IGraph>()> make);
 
 	static TSharedPtr<Mesh> GetMesh(const FString& generator_name, uint32 generator_hash,
 		int num_divisions, bool triangularise, PGCDebugMode dm);
@@ -22,6 +41,24 @@ public:
 	static void StoreMesh(const FString& generator_name, uint32 generator_hash,
 		int num_divisions, bool triangularise, PGCDebugMode dm,
 		const TSharedPtr<Mesh>& mesh, const TSharedPtr<TArray<FPGCNodePosition>>& s_nodes);
+	// if we don't have this mesh, calls "make", which should StoreMesh it, and anyone else asking for it meanwhile
+	// waits for that rather than making it again, "make" can ask for other meshes, but not this one
+	static void EnsureMesh(const FString& generator_name, uint32 generator_hash,
+		int num_divisions, bool triangularise, PGCDebugMode dm, TFunctionRef<void()> make);
+
+	// another form of the same levels, which baking can use without deserializing anything
+	static TSharedPtr<const BakeableMesh> GetBakeableMesh(const FString& generator_name, uint32 generator_hash,
+		int num_divisions, bool triangularise, PGCDebugMode dm);
+	// returns the stored entry, for baking from straight away
+	static TSharedPtr<const BakeableMesh> StoreBakeableMesh(const FString& generator_name, uint32 generator_hash,
+		int num_divisions, bool triangularise, PGCDebugMode dm,
+		const FlatMesh& flat, const TArray<FPGCNodePosition>& nodes);
+
+	// entries held in memory past this many bytes (counting what each has allocated, plus any BakeableMesh copies
+	// still alive) are let go, least recently used first, to be read back from disk if asked for again,
+	// anything not yet safely on disk is kept whatever the budget
+	static void SetMemoryBudget(int64 bytes);
+	static int64 GetResidentBytes();
 };
 
 }
\ No newline at end of file
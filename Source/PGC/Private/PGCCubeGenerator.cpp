@@ -3,6 +3,8 @@
 #include "PGCCubeGenerator.h"
 
 #include "Mesh.h"
+#include "CubeChunks.h"
+#include "Runtime/Core/Public/Misc/ScopeLock.h"
 #include "Runtime/Engine/Classes/Engine/World.h"
 
 PRAGMA_DISABLE_OPTIMIZATION
@@ -34,10 +36,32 @@ void APGCCubeGenerator::MakeMesh(TSharedPtr<Mesh> mesh, const TSharedPtr<TArray<
 	for (auto& cube : Cubes)
 	{
 		Nodes->Emplace(FVector{(float)cube.X, (float)cube.Y, (float)cube.Z}, FVector{0.0f, 0.0f, 1.0f});
-		mesh->AddCube(cube);
 	}
 
-	mesh->CheckConsistent(true);
+	mesh->AddCubes(Cubes);
+}
+
+bool APGCCubeGenerator::MakeSubdividedMesh(TSharedPtr<Mesh> mesh, int NumDivisions, bool parallel,
+	PGCDebugMode /*dm*/) const
+{
+	// CubeChunks can only do one Subdivide at a time, and Chunks itself gets replaced
+	FScopeLock lock(&ChunksLock);
+
+	if (ChunkSize <= 0)
+	{
+		Chunks.Reset();
+
+		return false;
+	}
+
+	if (!Chunks.IsValid() || Chunks->GetChunkSize() != ChunkSize)
+	{
+		Chunks = MakeShared<CubeChunks>(ChunkSize);
+	}
+
+	Chunks->Subdivide(Cubes, NumDivisions, *mesh, parallel);
+
+	return true;
 }
 
 uint32 APGCCubeGenerator::SettingsHash() const
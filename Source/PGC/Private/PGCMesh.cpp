@@ -46,12 +46,9 @@ void UPGCMesh::Generate(int NumDivisions, bool Triangularise, PGCDebugMode dm)
 	auto checksum = Generator->SettingsHash();
 	auto gname = Generator->GetName();
 
-	auto mesh = Cache::PGCCache::GetMesh(gname, checksum, NumDivisions, Triangularise, dm);
-
-	if (!mesh.IsValid())
-	{
+	Cache::PGCCache::EnsureMesh(gname, checksum, NumDivisions, Triangularise, dm, [&] {
 		RealGenerate(gname, checksum, NumDivisions, Triangularise, dm);
-	}
+	});
 
 	CurrentMesh = Cache::PGCCache::GetMesh(gname, checksum, NumDivisions, Triangularise, dm);
 	CurrentNodes = Cache::PGCCache::GetMeshNodes(gname, checksum, NumDivisions, Triangularise, dm);
@@ -60,7 +57,8 @@ void UPGCMesh::Generate(int NumDivisions, bool Triangularise, PGCDebugMode dm)
 void UPGCMesh::RealGenerate(const FString& generator_name, uint32 generator_hash,
 	int NumDivisions, bool Triangularise, PGCDebugMode dm)
 {
-	bool need_another_divide = false;
+	// the cached level we work up from
+	int from_divisions = NumDivisions;
 
 	if (Triangularise)
 	{
@@ -68,8 +66,36 @@ void UPGCMesh::RealGenerate(const FString& generator_name, uint32 generator_hash
 	}
 	else if (NumDivisions > 0)
 	{
-		Generate(NumDivisions - 1, false, dm);
-		need_another_divide = true;
+		auto made_mesh = MakeShared<Mesh>(FMath::Cos(FMath::DegreesToRadians(20.0f)));
+
+		if (Generator->MakeSubdividedMesh(made_mesh, NumDivisions, ParallelSubdivision, dm))
+		{
+			// the nodes come with the undivided mesh
+			Generate(0, false, dm);
+
+			auto made_nodes = Cache::PGCCache::GetMeshNodes(generator_name, generator_hash, 0, false, dm);
+
+			Cache::PGCCache::StoreMesh(generator_name, generator_hash, NumDivisions, false, dm, made_mesh, made_nodes);
+
+			// the generator does this level itself, stencils would only be slower
+			SubdivStencilsDivisions = -1;
+
+			return;
+		}
+
+		from_divisions = NumDivisions - 1;
+
+		if (!CacheIntermediateLevels)
+		{
+			// start from the nearest level we already have, without filling in the ones between
+			while (from_divisions > 0
+				&& !Cache::PGCCache::GetMesh(generator_name, generator_hash, from_divisions, false, dm).IsValid())
+			{
+				from_divisions--;
+			}
+		}
+
+		Generate(from_divisions, false, dm);
 	}
 	else
 	{
@@ -82,16 +108,24 @@ void UPGCMesh::RealGenerate(const FString& generator_name, uint32 generator_hash
 		return;
 	}
 
-	auto out_mesh = Cache::PGCCache::GetMesh(generator_name, generator_hash, NumDivisions - 1, false, dm);
+	auto out_mesh = Cache::PGCCache::GetMesh(generator_name, generator_hash, from_divisions, false, dm);
 	check(out_mesh.IsValid());
 
 	// surfaces with normals differing by more than 20 degrees to be set sharp when
 	// using PGCEdgeType::Auto
-	auto out_nodes = Cache::PGCCache::GetMeshNodes(generator_name, generator_hash, NumDivisions - 1, false, dm);
+	auto out_nodes = Cache::PGCCache::GetMeshNodes(generator_name, generator_hash, from_divisions, false, dm);
 
-	if (need_another_divide)
+	if (from_divisions < NumDivisions)
 	{
-		out_mesh = out_mesh->Subdivide();
+		// SubdivideN only keeps two levels alive at a time
+		out_mesh = out_mesh->SubdivideN(NumDivisions - from_divisions, ParallelSubdivision);
+	}
+
+	// set after making the levels below, which come through here too, so it ends up as the one asked for
+	if (!Triangularise && NumDivisions > 0)
+	{
+		SubdivStencils.Reset();
+		SubdivStencilsDivisions = NumDivisions;
 	}
 
 	if (Triangularise)
@@ -104,16 +138,82 @@ void UPGCMesh::RealGenerate(const FString& generator_name, uint32 generator_hash
 	Cache::PGCCache::StoreMesh(generator_name, generator_hash, NumDivisions, Triangularise, dm, out_mesh, out_nodes);
 }
 
+TSharedPtr<const Cache::BakeableMesh> UPGCMesh::GenerateBakeable(int NumDivisions, bool Triangularise, PGCDebugMode dm)
+{
+	auto checksum = Generator->SettingsHash();
+	auto gname = Generator->GetName();
+
+	auto ret = Cache::PGCCache::GetBakeableMesh(gname, checksum, NumDivisions, Triangularise, dm);
+
+	if (!ret.IsValid())
+	{
+		ret = BakeableFromStencils(NumDivisions, Triangularise, dm);
+	}
+
+	if (!ret.IsValid())
+	{
+		Generate(NumDivisions, Triangularise, dm);
+
+		ret = Cache::PGCCache::StoreBakeableMesh(gname, checksum, NumDivisions, Triangularise, dm,
+			*CurrentMesh->MakeBakeableFlat(), *CurrentNodes);
+	}
+
+	return ret;
+}
+
+TSharedPtr<const Cache::BakeableMesh> UPGCMesh::BakeableFromStencils(int NumDivisions, bool Triangularise, PGCDebugMode dm)
+{
+	if (Triangularise || NumDivisions == 0 || SubdivStencilsDivisions != NumDivisions)
+		return nullptr;
+
+	Generate(0, false, dm);
+
+	bool evaluated = false;
+
+	if (SubdivStencils.IsValid() && SubdivStencils->Matches(*CurrentMesh))
+	{
+		SubdivStencils->BaseToPositions(*CurrentMesh, SubdivStencilsBase);
+
+		// false when an Auto edge on one of the levels went the other way since they were built
+		evaluated = SubdivStencils->Evaluate(SubdivStencilsBase, SubdivStencilsFlat->Positions, ParallelSubdivision);
+	}
+
+	if (!evaluated)
+	{
+		// the result comes with the positions it was built from
+		SubdivStencils = SubdivisionStencils::Build(*CurrentMesh, NumDivisions);
+
+		// points landed on top of each other somewhere, and only the full subdivision can deal with that
+		if (!SubdivStencils.IsValid())
+		{
+			SubdivStencilsFlat.Reset();
+
+			return nullptr;
+		}
+
+		SubdivStencilsFlat = SubdivStencils->MakeBakeableFlat();
+	}
+
+	// neither the Mesh nor the levels between are made, anything asking for them later makes them the usual way;
+	// this points into SubdivStencilsFlat, which the next evaluation overwrites
+	auto ret = MakeShared<Cache::BakeableMesh>();
+
+	ret->Flat = SubdivStencilsFlat->View();
+	ret->Nodes = *CurrentNodes;
+
+	return ret;
+}
+
 FPGCMeshResult UPGCMesh::GenerateMergeChannels(int NumDivisions, bool InsideOut, bool Triangularise, PGCDebugEdgeType DebugEdges,
 	PGCDebugMode dm)
 {
-	Generate(NumDivisions, Triangularise, dm);
+	auto bakeable = GenerateBakeable(NumDivisions, Triangularise, dm);
 
 	FPGCMeshResult ret;
 
-	CurrentMesh->BakeAllChannelsIntoOne(ret, InsideOut, DebugEdges);
+	Mesh::BakeAllChannelsIntoOne(bakeable->Flat, ret, InsideOut, DebugEdges);
 
-	ret.Nodes = *CurrentNodes;
+	ret.Nodes = bakeable->Nodes;
 
 	return ret;
 }
@@ -123,11 +223,62 @@ FPGCMeshResult UPGCMesh::GenerateChannels(int NumDivisions, bool InsideOut, bool
 	PGCDebugMode dm,
 	int StartChannel, int EndChannel)
 {
-	Generate(NumDivisions, Triangularise, dm);
+	auto bakeable = GenerateBakeable(NumDivisions, Triangularise, dm);
+
+	FPGCMeshResult ret;
+
+	Mesh::BakeChannels(bakeable->Flat, ret, InsideOut, DebugEdges, StartChannel, EndChannel);
+
+	ret.Nodes = bakeable->Nodes;
+
+	return ret;
+}
+
+FPGCMeshResult UPGCMesh::GenerateLimitSurface(int NumDivisions, bool InsideOut, PGCDebugEdgeType DebugEdges,
+	PGCDebugMode dm)
+{
+	// the limit needs all quads, so at least one level
+	NumDivisions = FMath::Max(NumDivisions, 1);
+
+	Generate(0, false, dm);
+
+	if (!LimitStencils.IsValid() || LimitStencilsDivisions != NumDivisions || !LimitStencils->Matches(*CurrentMesh))
+	{
+		LimitStencils = SubdivisionStencils::Build(*CurrentMesh, NumDivisions, true);
+		LimitStencilsDivisions = NumDivisions;
+	}
+
+	// points landed on top of each other somewhere, only the full subdivision can deal with that
+	if (!LimitStencils.IsValid())
+	{
+		LimitStencilsDivisions = -1;
+
+		return GenerateMergeChannels(NumDivisions, InsideOut, false, DebugEdges, dm);
+	}
+
+	TArray<FVector> corner_normals;
+
+	auto limit = LimitStencils->EvaluateLimit(*CurrentMesh, corner_normals, ParallelSubdivision);
+
+	// an Auto edge on one of the levels went the other way since they were built
+	if (!limit.IsValid())
+	{
+		LimitStencils = SubdivisionStencils::Build(*CurrentMesh, NumDivisions, true);
+
+		if (!LimitStencils.IsValid())
+		{
+			LimitStencilsDivisions = -1;
+
+			return GenerateMergeChannels(NumDivisions, InsideOut, false, DebugEdges, dm);
+		}
+
+		limit = LimitStencils->EvaluateLimit(*CurrentMesh, corner_normals, ParallelSubdivision);
+		check(limit.IsValid());
+	}
 
 	FPGCMeshResult ret;
 
-	CurrentMesh->BakeChannels(ret, InsideOut, DebugEdges, StartChannel, EndChannel);
+	limit->BakeAllChannelsIntoOne(ret, InsideOut, DebugEdges, &corner_normals);
 
 	ret.Nodes = *CurrentNodes;
 
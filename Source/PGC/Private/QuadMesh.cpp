@@ -0,0 +1,549 @@
+#include "QuadMesh.h"
+
+#include "FlatMesh.h"
+#include "Util.h"
+
+#include "Runtime/Core/Public/Async/ParallelFor.h"
+
+PRAGMA_DISABLE_OPTIMIZATION
+
+QuadMesh::QuadMesh(const Mesh& mesh) : CosAutoSharpAngle(mesh.CosAutoSharpAngle)
+{
+	FlatMesh flat(mesh);
+
+	Positions = MoveTemp(flat.Positions);
+	VertEdgeStarts = MoveTemp(flat.VertEdgeStarts);
+	VertEdges = MoveTemp(flat.VertEdges);
+	VertFaceStarts = MoveTemp(flat.VertFaceStarts);
+	VertFaces = MoveTemp(flat.VertFaces);
+
+	Edges = mesh.Edges;
+
+	Faces.SetNum(flat.NumFaces());
+
+	for (Idx<MeshFace> face_idx{ 0 }; face_idx.AsInt() < flat.NumFaces(); face_idx++)
+	{
+		auto verts = flat.FaceVertsOf(face_idx);
+		auto edges = flat.FaceEdgesOf(face_idx);
+		auto uvs = flat.FaceUVsOf(face_idx);
+
+		check(verts.Num() == 4);
+
+		auto& f = Faces[face_idx.AsInt()];
+
+		for (int i = 0; i < 4; i++)
+		{
+			f.VertIdxs[i] = verts[i];
+			f.EdgeIdxs[i] = edges[i];
+			f.UVs[i] = uvs[i];
+		}
+
+		f.UVGroup = flat.FaceUVGroups[face_idx.AsInt()];
+		f.Channel = flat.FaceChannels[face_idx.AsInt()];
+	}
+}
+
+int QuadMesh::Corner(Idx<MeshFace> face_idx, Idx<MeshVert> vert_idx) const
+{
+	const auto& f = Faces[face_idx.AsInt()];
+
+	for (int i = 0; i < 4; i++)
+	{
+		if (f.VertIdxs[i] == vert_idx)
+			return i;
+	}
+
+	check(false);
+
+	return INDEX_NONE;
+}
+
+FVector QuadMesh::FaceNormal(Idx<MeshFace> face_idx) const
+{
+	const auto& f = Faces[face_idx.AsInt()];
+
+	FVector positions[4];
+
+	for (int i = 0; i < 4; i++)
+	{
+		positions[i] = Positions[f.VertIdxs[i].AsInt()];
+	}
+
+	return Util::NewellPolyNormal(MakeArrayView(positions, 4));
+}
+
+void QuadMesh::ResolveEffectiveEdgeTypes()
+{
+	// initialised?
+	check(CosAutoSharpAngle != -2);
+
+	for (auto& e : Edges)
+	{
+		if (e.EffectiveType != PGCEdgeType::Unset)
+			continue;
+
+		if (e.SetType != PGCEdgeType::Auto)
+		{
+			e.EffectiveType = e.SetType;
+		}
+		else if (!e.ForwardFaceIdx.Valid() || !e.BackwardsFaceIdx.Valid())
+		{
+			e.EffectiveType = PGCEdgeType::Sharp;
+		}
+		else
+		{
+			auto cos = FVector::DotProduct(FaceNormal(e.ForwardFaceIdx), FaceNormal(e.BackwardsFaceIdx));
+
+			e.EffectiveType = cos < CosAutoSharpAngle ? PGCEdgeType::Sharp : PGCEdgeType::Rounded;
+		}
+	}
+}
+
+void QuadMesh::NextLevelSize(int& num_verts, int& num_edges, int& num_faces)
+{
+	// each old vert, edge and face makes one new vert, each old edge two new edges and each face
+	// four more, and each face four new faces
+	num_verts = num_verts + num_edges + num_faces;
+	num_edges = num_edges * 2 + num_faces * 4;
+	num_faces = num_faces * 4;
+}
+
+void QuadMesh::Reserve(int num_verts, int num_edges, int num_faces)
+{
+	Positions.Reserve(num_verts);
+	VertEdgeStarts.Reserve(num_verts + 1);
+	VertEdges.Reserve(num_edges * 2);
+	VertFaceStarts.Reserve(num_verts + 1);
+	VertFaces.Reserve(num_faces * 4);
+
+	Edges.Reserve(Idx<MeshEdge>(num_edges));
+	Faces.Reserve(num_faces);
+}
+
+void QuadMesh::Empty()
+{
+	Positions.Empty();
+	VertEdgeStarts.Empty();
+	VertEdges.Empty();
+	VertFaceStarts.Empty();
+	VertFaces.Empty();
+
+	Edges.Empty();
+	Faces.Empty();
+}
+
+bool QuadMesh::Subdivide(QuadMesh& into, bool parallel)
+{
+	check(&into != this);
+
+	ResolveEffectiveEdgeTypes();
+
+	auto num_verts = NumVerts();
+	auto num_edges = NumEdges();
+	auto num_faces = NumFaces();
+
+	// the new points, with the same arithmetic as Mesh::CalcSubdivisionPoints
+	SubdivisionPoints points;
+
+	auto& vert_points = points.VertPoints;
+	auto& edge_points = points.EdgePoints;
+	auto& face_points = points.FacePoints;
+
+	vert_points.SetNum(num_verts);
+	edge_points.SetNum(num_edges);
+	face_points.SetNum(num_faces);
+
+	ParallelFor(num_faces, [&](int32 i)
+	{
+		FVector fv{ 0, 0, 0 };
+
+		for (auto vert_idx : Faces[i].VertIdxs)
+		{
+			fv += Positions[vert_idx.AsInt()];
+		}
+
+		face_points[i] = fv / 4;
+	}, !parallel);
+
+	ParallelFor(num_edges, [&](int32 i)
+	{
+		const auto& e = Edges[Idx<MeshEdge>(i)];
+		const auto& start_pos = Positions[e.StartVertIdx.AsInt()];
+		const auto& end_pos = Positions[e.EndVertIdx.AsInt()];
+
+		if (e.EffectiveType == PGCEdgeType::Rounded)
+		{
+			edge_points[i] = (start_pos + end_pos
+				+ face_points[e.ForwardFaceIdx.AsInt()] + face_points[e.BackwardsFaceIdx.AsInt()]) / 4;
+		}
+		else
+		{
+			edge_points[i] = (start_pos + end_pos) / 2;
+		}
+	}, !parallel);
+
+	ParallelFor(num_verts, [&](int32 i)
+	{
+		Idx<MeshVert> vert_idx{ i };
+		const auto& pos = Positions[i];
+
+		int num_sharp = 0;
+		Idx<MeshVert> sharp_other_verts[2];
+
+		for (auto edge_idx : VertEdgesOf(i))
+		{
+			const auto& e = Edges[edge_idx];
+
+			if (e.EffectiveType == PGCEdgeType::Sharp)
+			{
+				if (num_sharp < 2)
+				{
+					sharp_other_verts[num_sharp] = e.OtherVert(vert_idx);
+				}
+
+				num_sharp++;
+			}
+		}
+
+		if (num_sharp < 2)
+		{
+			auto faces = VertFacesOf(i);
+			auto n = faces.Num();
+
+			FVector F{ 0, 0, 0 };
+
+			for (auto face_idx : faces)
+			{
+				F += face_points[face_idx.AsInt()];
+			}
+
+			F = F / n;
+
+			FVector R{ 0, 0, 0 };
+
+			for (auto edge_idx : VertEdgesOf(i))
+			{
+				R += edge_points[edge_idx.AsInt()];
+			}
+
+			R = R / n;
+
+			vert_points[i] = (pos * (n - 3) + R * 2 + F) / n;
+		}
+		else if (num_sharp == 2)
+		{
+			const auto& ov0 = Positions[sharp_other_verts[0].AsInt()];
+			const auto& ov1 = Positions[sharp_other_verts[1].AsInt()];
+
+			vert_points[i] = pos * 0.75f + ov0 * 0.125f + ov1 * 0.125f;
+		}
+		else
+		{
+			vert_points[i] = pos;
+		}
+	}, !parallel);
+
+	if (!Mesh::SubdivisionPointsUnique(points))
+		return false;
+
+	// "into" may hold an old level, drop its contents but keep its memory
+	into.CosAutoSharpAngle = CosAutoSharpAngle;
+	into.Edges.Reset();
+	into.Faces.Reset();
+
+	// from here on this is Mesh::BuildSubdivisionDirect, with the new face at corner i of old face f being f * 4 + i
+
+	TArray<Idx<MeshVert>> vert_new_vert;
+	TArray<Idx<MeshVert>> edge_new_vert;
+	TArray<Idx<MeshVert>> face_new_vert;
+
+	vert_new_vert.Init(Idx<MeshVert>::None, num_verts);
+	edge_new_vert.Init(Idx<MeshVert>::None, num_edges);
+	face_new_vert.Init(Idx<MeshVert>::None, num_faces);
+
+	TArray<Idx<MeshEdge>> edge_new_edges;
+
+	edge_new_edges.Init(Idx<MeshEdge>::None, num_edges * 4);
+
+	into.Faces.SetNum(num_faces * 4, false);
+
+	// how many edges and faces each new vert will have, so we can lay out its rows before filling them
+	TArray<int> new_vert_num_edges;
+	TArray<int> new_vert_num_faces;
+
+	auto number_vert = [&](Idx<MeshVert>& new_vert_idx, int edge_count, int face_count) {
+		if (!new_vert_idx.Valid())
+		{
+			new_vert_idx = Idx<MeshVert>(new_vert_num_edges.Num());
+
+			new_vert_num_edges.Push(edge_count);
+			new_vert_num_faces.Push(face_count);
+		}
+
+		return new_vert_idx;
+	};
+
+	for (int i = 0; i < num_faces; i++)
+	{
+		Idx<MeshFace> face_idx{ i };
+		const auto& f = Faces[i];
+
+		FVector2D centre_uv{ 0, 0 };
+
+		for (const auto& uv : f.UVs)
+		{
+			centre_uv += uv;
+		}
+
+		centre_uv = centre_uv / 4;
+
+		for (int j = 0; j < 4; j++)
+		{
+			auto vert_idx = f.VertIdxs[j];
+			auto prev_edge_idx = f.EdgeIdxs[(j + 3) % 4];
+			auto next_edge_idx = f.EdgeIdxs[j];
+
+			const auto& prev_edge = Edges[prev_edge_idx];
+			const auto& next_edge = Edges[next_edge_idx];
+
+			Idx<MeshVert> quad[4];
+			quad[0] = number_vert(vert_new_vert[vert_idx.AsInt()], VertEdgesOf(vert_idx.AsInt()).Num(), VertFacesOf(vert_idx.AsInt()).Num());
+			quad[1] = number_vert(edge_new_vert[next_edge_idx.AsInt()], 4, 4);
+			quad[2] = number_vert(face_new_vert[i], 4, 4);
+			quad[3] = number_vert(edge_new_vert[prev_edge_idx.AsInt()], 4, 4);
+
+			int quad_edges[4] {
+				next_edge_idx.AsInt() * 4 + (next_edge.StartVertIdx == vert_idx ? 0 : 1),
+				next_edge_idx.AsInt() * 4 + (next_edge.ForwardFaceIdx == face_idx ? 2 : 3),
+				prev_edge_idx.AsInt() * 4 + (prev_edge.ForwardFaceIdx == face_idx ? 2 : 3),
+				prev_edge_idx.AsInt() * 4 + (prev_edge.StartVertIdx == vert_idx ? 0 : 1),
+			};
+
+			PGCEdgeType quad_edge_types[4] {
+				next_edge.SetType,
+				PGCEdgeType::Rounded,
+				PGCEdgeType::Rounded,
+				prev_edge.SetType,
+			};
+
+			FVector2D quad_uvs[4];
+			Mesh::SubdivisionQuadUVs(MakeArrayView(f.UVs, 4), j, centre_uv, quad_uvs);
+
+			int first = 0;
+
+			for (int k = 1; k < 4; k++)
+			{
+				if (quad[k] < quad[first])
+				{
+					first = k;
+				}
+			}
+
+			Idx<MeshFace> new_face_idx{ i * 4 + j };
+			auto& nf = into.Faces[new_face_idx.AsInt()];
+
+			nf.UVGroup = f.UVGroup;
+			nf.Channel = f.Channel;
+
+			// edges have to be made in the same order as Mesh does it, starting with the one into the lowest vert
+			for (int k = 0; k < 4; k++)
+			{
+				auto q = (first + k + 3) % 4;
+				auto from_vert_idx = quad[q];
+				auto to_vert_idx = quad[(q + 1) % 4];
+
+				auto& new_edge_idx = edge_new_edges[quad_edges[q]];
+
+				if (!new_edge_idx.Valid())
+				{
+					MeshEdge ne;
+					ne.StartVertIdx = from_vert_idx;
+					ne.EndVertIdx = to_vert_idx;
+					into.Edges.Push(ne);
+
+					new_edge_idx = into.Edges.LastIdx();
+				}
+
+				auto& edge = into.Edges[new_edge_idx];
+
+				edge.SetType = MergeEdgeTypes(edge.SetType, quad_edge_types[q]);
+				edge.AddFace(new_face_idx, from_vert_idx);
+
+				nf.VertIdxs[k] = to_vert_idx;
+				nf.EdgeIdxs[(k + 3) % 4] = new_edge_idx;
+				nf.UVs[k] = quad_uvs[(q + 1) % 4];
+			}
+		}
+	}
+
+	auto num_new_verts = new_vert_num_edges.Num();
+
+	into.Positions.SetNum(num_new_verts, false);
+	into.VertEdgeStarts.SetNum(num_new_verts + 1, false);
+	into.VertFaceStarts.SetNum(num_new_verts + 1, false);
+
+	into.VertEdgeStarts[0] = 0;
+	into.VertFaceStarts[0] = 0;
+
+	for (int i = 0; i < num_new_verts; i++)
+	{
+		into.VertEdgeStarts[i + 1] = into.VertEdgeStarts[i] + new_vert_num_edges[i];
+		into.VertFaceStarts[i + 1] = into.VertFaceStarts[i] + new_vert_num_faces[i];
+	}
+
+	into.VertEdges.SetNum(into.VertEdgeStarts[num_new_verts], false);
+	into.VertFaces.SetNum(into.VertFaceStarts[num_new_verts], false);
+
+	// each loop writes the rows of the new verts made from its old elements,
+	// sorted at the end, as Mesh would have them
+	auto new_vert_edges = [&into](Idx<MeshVert> new_vert_idx) {
+		return into.VertEdges.GetData() + into.VertEdgeStarts[new_vert_idx.AsInt()];
+	};
+
+	auto new_vert_faces = [&into](Idx<MeshVert> new_vert_idx) {
+		return into.VertFaces.GetData() + into.VertFaceStarts[new_vert_idx.AsInt()];
+	};
+
+	auto sort_new_vert = [&into](Idx<MeshVert> new_vert_idx) {
+		auto i = new_vert_idx.AsInt();
+
+		Sort(into.VertEdges.GetData() + into.VertEdgeStarts[i], into.VertEdgeStarts[i + 1] - into.VertEdgeStarts[i]);
+		Sort(into.VertFaces.GetData() + into.VertFaceStarts[i], into.VertFaceStarts[i + 1] - into.VertFaceStarts[i]);
+	};
+
+	auto corner_new_face = [this](Idx<MeshFace> face_idx, Idx<MeshVert> vert_idx) {
+		return Idx<MeshFace>(face_idx.AsInt() * 4 + Corner(face_idx, vert_idx));
+	};
+
+	ParallelFor(num_verts, [&](int32 i)
+	{
+		Idx<MeshVert> vert_idx{ i };
+		auto new_vert_idx = vert_new_vert[i];
+
+		if (!new_vert_idx.Valid())
+			return;
+
+		into.Positions[new_vert_idx.AsInt()] = vert_points[i];
+
+		auto edges = new_vert_edges(new_vert_idx);
+		auto faces = new_vert_faces(new_vert_idx);
+
+		for (auto edge_idx : VertEdgesOf(i))
+		{
+			*edges++ = edge_new_edges[edge_idx.AsInt() * 4 + (Edges[edge_idx].StartVertIdx == vert_idx ? 0 : 1)];
+		}
+
+		for (auto face_idx : VertFacesOf(i))
+		{
+			*faces++ = corner_new_face(face_idx, vert_idx);
+		}
+
+		sort_new_vert(new_vert_idx);
+	}, !parallel);
+
+	ParallelFor(num_edges, [&](int32 i)
+	{
+		const auto& e = Edges[Idx<MeshEdge>(i)];
+		auto new_vert_idx = edge_new_vert[i];
+
+		if (!new_vert_idx.Valid())
+			return;
+
+		into.Positions[new_vert_idx.AsInt()] = edge_points[i];
+
+		auto edges = new_vert_edges(new_vert_idx);
+		auto faces = new_vert_faces(new_vert_idx);
+
+		for (int j = 0; j < 4; j++)
+		{
+			*edges++ = edge_new_edges[i * 4 + j];
+		}
+
+		for (auto face_idx : { e.ForwardFaceIdx, e.BackwardsFaceIdx })
+		{
+			*faces++ = corner_new_face(face_idx, e.StartVertIdx);
+			*faces++ = corner_new_face(face_idx, e.EndVertIdx);
+		}
+
+		sort_new_vert(new_vert_idx);
+	}, !parallel);
+
+	ParallelFor(num_faces, [&](int32 i)
+	{
+		Idx<MeshFace> face_idx{ i };
+		auto new_vert_idx = face_new_vert[i];
+
+		if (!new_vert_idx.Valid())
+			return;
+
+		into.Positions[new_vert_idx.AsInt()] = face_points[i];
+
+		auto edges = new_vert_edges(new_vert_idx);
+		auto faces = new_vert_faces(new_vert_idx);
+
+		for (auto edge_idx : Faces[i].EdgeIdxs)
+		{
+			*edges++ = edge_new_edges[edge_idx.AsInt() * 4 + (Edges[edge_idx].ForwardFaceIdx == face_idx ? 2 : 3)];
+		}
+
+		for (int j = 0; j < 4; j++)
+		{
+			*faces++ = Idx<MeshFace>(i * 4 + j);
+		}
+
+		sort_new_vert(new_vert_idx);
+	}, !parallel);
+
+	return true;
+}
+
+TSharedRef<Mesh> QuadMesh::ToMesh() const
+{
+	auto ret = MakeShared<Mesh>(CosAutoSharpAngle);
+
+	ret->Edges = Edges;
+
+	ret->Faces.SetNum(Idx<MeshFace>(NumFaces()));
+
+	for (int i = 0; i < NumFaces(); i++)
+	{
+		const auto& f = Faces[i];
+		auto& mf = ret->Faces[Idx<MeshFace>(i)];
+
+		// Mesh's faces list the edge into each vert, rather than the one out of it
+		for (int j = 0; j < 4; j++)
+		{
+			mf.VertIdxs.Push(f.VertIdxs[j]);
+			mf.EdgeIdxs.Push(f.EdgeIdxs[(j + 3) % 4]);
+		}
+
+		mf.CornerUVs.Append(f.UVs, 4);
+		mf.UVGroup = f.UVGroup;
+		mf.Channel = f.Channel;
+	}
+
+	// as Mesh's own subdivision, the verts get no UV maps
+	ret->UVsInCorners = true;
+
+	ret->Vertices.SetNum(Idx<MeshVert>(NumVerts()));
+
+	for (int i = 0; i < NumVerts(); i++)
+	{
+		ret->Vertices[Idx<MeshVert>(i)].Pos = Positions[i];
+	}
+
+	// our rows are already what Mesh packs
+	ret->AdjacencyPacked = true;
+	ret->PackedVertEdgeStarts = VertEdgeStarts;
+	ret->PackedVertEdges = VertEdges;
+	ret->PackedVertFaceStarts = VertFaceStarts;
+	ret->PackedVertFaces = VertFaces;
+
+	ret->RebuildLookups();
+
+	ret->CheckConsistent(true);
+
+	return ret;
+}
+
+PRAGMA_ENABLE_OPTIMIZATION
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "Mesh.h"
+
+PRAGMA_DISABLE_OPTIMIZATION
+
+// after one level of subdivision every face is a quad, so later levels don't need Mesh's general faces,
+// nor its lookups, which are only there for building
+//
+// this holds a closed all-quad mesh in fixed-size faces and flat arrays, and subdivides into another one,
+// giving exactly what Mesh::Subdivide would have (once converted back with ToMesh)
+class QuadMesh {
+public:
+	struct Face {
+		Idx<MeshVert> VertIdxs[4];
+		Idx<MeshEdge> EdgeIdxs[4];		///< EdgeIdxs[i] runs from VertIdxs[i] to VertIdxs[(i + 1) % 4]
+		FVector2D UVs[4];				///< per corner, as FlatMesh::FaceUVs
+		int UVGroup = -1;
+		int Channel = -1;
+	};
+
+	explicit QuadMesh(float cosAutoSharpAngle) : CosAutoSharpAngle(cosAutoSharpAngle) {}
+	// "mesh" must be compacted and all quads
+	explicit QuadMesh(const Mesh& mesh);
+
+	// writes the next level into "into", reusing whatever memory it already has, so that two QuadMeshes
+	// can be ping-ponged through any number of levels
+	// false (leaving "into" alone) if any of the new points land on top of each other,
+	// which only Mesh::Subdivide can deal with
+	bool Subdivide(QuadMesh& into, bool parallel);
+
+	// sizes of the level after one of the given sizes (exact for a closed all-quad mesh with unique points)
+	static void NextLevelSize(int& num_verts, int& num_edges, int& num_faces);
+	void Reserve(int num_verts, int num_edges, int num_faces);
+	void Empty();
+
+	TSharedRef<Mesh> ToMesh() const;
+
+	int NumVerts() const { return Positions.Num(); }
+	int NumEdges() const { return Edges.Num().AsInt(); }
+	int NumFaces() const { return Faces.Num(); }
+
+private:
+	float CosAutoSharpAngle;
+
+	TArray<FVector> Positions;
+	// same layout as FlatMesh, and in the same order as a Mesh would have them
+	TArray<int> VertEdgeStarts;
+	TArray<Idx<MeshEdge>> VertEdges;
+	TArray<int> VertFaceStarts;
+	TArray<Idx<MeshFace>> VertFaces;
+
+	TArrayIdx<MeshEdge> Edges;
+	TArray<Face> Faces;
+
+	TArrayView<const Idx<MeshEdge>> VertEdgesOf(int vert) const {
+		return MakeArrayView(VertEdges.GetData() + VertEdgeStarts[vert], VertEdgeStarts[vert + 1] - VertEdgeStarts[vert]);
+	}
+
+	TArrayView<const Idx<MeshFace>> VertFacesOf(int vert) const {
+		return MakeArrayView(VertFaces.GetData() + VertFaceStarts[vert], VertFaceStarts[vert + 1] - VertFaceStarts[vert]);
+	}
+
+	int Corner(Idx<MeshFace> face_idx, Idx<MeshVert> vert_idx) const;
+
+	// as FlatMesh::FaceNormal
+	FVector FaceNormal(Idx<MeshFace> face_idx) const;
+
+	// as Mesh::ResolveEffectiveEdgeTypes
+	void ResolveEffectiveEdgeTypes();
+};
+
+PRAGMA_ENABLE_OPTIMIZATION
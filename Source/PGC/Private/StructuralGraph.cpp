@@ -703,13 +703,12 @@ TSharedPtr<IGraph> SGraph::IntermediateOptimize(TSharedPtr<LayoutGraph::Graph> i
 
 	auto hash = HashCombine(input->GetTypeHash(), ::GetTypeHash(here_stream.GetCurrentSeed()));
 
-	auto cached = PGCCache::GetIGraph(hash);
-
-	if (cached.IsValid())
-	{
-		return cached;
-	}
+	// if another thread is already optimizing this one, we wait for its result
+	return PGCCache::GetOrMakeIGraph(hash, [&] { return IntermediateOptimizeUncached(input, here_stream); });
+}
 
+TSharedPtr<IGraph> SGraph::IntermediateOptimizeUncached(TSharedPtr<LayoutGraph::Graph> input, FRandomStream& here_stream)
+{
 	auto i_graph = MakeShared<IGraph>();
 
 #if 0
@@ -989,8 +988,6 @@ TSharedPtr<IGraph> SGraph::IntermediateOptimize(TSharedPtr<LayoutGraph::Graph> i
 
 	auto energy = OptimizeIGraph(temp[0], 0.00001, true);
 
-	PGCCache::StoreIGraph(hash, temp[0]);
-
 	return temp[0];
 }
 
@@ -1136,6 +1133,9 @@ void SGraph::MakeMesh(TSharedPtr<Mesh> mesh, PGCDebugMode dm) const
 
 	RefreshTransforms();
 
+	// nodes and their connections add plenty of faces that cancel each other, cheaper to resolve those all in one go
+	mesh->BeginBatch();
+
 	if (dm != PGCDebugMode::Normal)
 	{
 		MakeMeshSkeleton(mesh);
@@ -1144,6 +1144,8 @@ void SGraph::MakeMesh(TSharedPtr<Mesh> mesh, PGCDebugMode dm) const
 	{
 		MakeMeshReal(mesh);
 	}
+
+	mesh->EndBatch();
 }
 
 SEdge::SEdge(TWeakPtr<SNode> fromNode, TWeakPtr<SNode> toNode, double d0)
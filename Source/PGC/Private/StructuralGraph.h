@@ -145,6 +145,9 @@ namespace StructuralGraph {
 
 		TArray<ConnCurve> IntermediatePoints;
 		double Energy;
+
+		// the Edges are the LayoutGraph's, so not ours to count
+		SIZE_T GetAllocatedSize() const { return IntermediatePoints.GetAllocatedSize(); }
 	};
 
 	using IEdge = IntermediateGraph::IEdge<INodeMetaData>;
@@ -173,6 +176,7 @@ namespace StructuralGraph {
 			const TSharedPtr<SNode>& from_n, const TSharedPtr<SNode>& to_n, float length, FVector& out1, FVector& out2);
 
 		static double OptimizeIGraph(TSharedPtr<IGraph> graph, double precision, bool final);
+		TSharedPtr<IGraph> IntermediateOptimizeUncached(TSharedPtr<LayoutGraph::Graph> input, FRandomStream& here_stream);
 
 	public:
 		SGraph(TSharedPtr<LayoutGraph::Graph> input,
@@ -0,0 +1,653 @@
+#include "SubdivisionStencils.h"
+
+#include "FlatMesh.h"
+#include "Util.h"
+
+#include "Runtime/Core/Public/Async/ParallelFor.h"
+
+PRAGMA_DISABLE_OPTIMIZATION
+
+// base vert -> weight, only used while building
+typedef TMap<int, float> Stencil;
+
+static void AddScaled(Stencil& into, const Stencil& from, float scale)
+{
+	for (const auto& p : from)
+	{
+		into.FindOrAdd(p.Key) += p.Value * scale;
+	}
+}
+
+void SubdivisionStencils::SparseRows::Push(Stencil& row)
+{
+	if (Starts.Num() == 0)
+	{
+		Starts.Push(0);
+	}
+
+	// in base vert order, so each row reads the positions front to back
+	row.KeySort(TLess<int>());
+
+	for (const auto& p : row)
+	{
+		BaseVerts.Push(p.Key);
+		Weights.Push(p.Value);
+	}
+
+	Starts.Push(BaseVerts.Num());
+}
+
+uint32 SubdivisionStencils::HashTopology(const Mesh& base)
+{
+	uint32 ret = GetTypeHash(base.Vertices.Num().AsInt());
+
+	for (const auto& f : base.Faces)
+	{
+		ret = HashCombine(ret, HashIdxSequence(f.VertIdxs));
+	}
+
+	for (const auto& e : base.Edges)
+	{
+		ret = HashCombine(ret, HashCombine(HashIdxPair(e.StartVertIdx, e.EndVertIdx), GetTypeHash((int)e.SetType)));
+		ret = HashCombine(ret, GetTypeHash((int)e.EffectiveType));
+	}
+
+	return ret;
+}
+
+TSharedPtr<SubdivisionStencils> SubdivisionStencils::Build(const Mesh& base, int count, bool limit)
+{
+	check(!limit || count > 0);
+
+	check(base.NumDead == 0);
+
+	auto ret = MakeShared<SubdivisionStencils>();
+	ret->NumBase = base.Vertices.Num().AsInt();
+	ret->TopologyHash = HashTopology(base);
+
+	// as Mesh::Subdivide, but on a copy, since we need "base" as it was to find the base verts
+	TSharedRef<const Mesh> level = base.AsShared();
+
+	if (!base.Clean)
+	{
+		auto split = MakeShared<Mesh>(base);
+		split->SplitSharedVerts();
+
+		level = split;
+	}
+
+	// the stencils of the verts of "level", the verts split off above are copies of the base vert in the same place
+	TArray<Stencil> stencils;
+
+	for (const auto& v : level->Vertices)
+	{
+		auto base_vert_idx = base.FindVert(v.Pos);
+		check(base_vert_idx.Valid());
+
+		stencils.AddDefaulted();
+		stencils.Last().Add(base_vert_idx.AsInt(), 1.0f);
+	}
+
+	for (int i = 0; i < count; i++)
+	{
+		FlatMesh flat(*level);
+
+		ret->ResolveAutoEdges(*level, flat, stencils);
+
+		SubdivisionPoints points;
+
+		Mesh::CalcSubdivisionPoints(flat, points, false);
+
+		if (!Mesh::SubdivisionPointsUnique(points))
+			return TSharedPtr<SubdivisionStencils>();
+
+		auto next = MakeShared<Mesh>(level->CosAutoSharpAngle);
+
+		level->BuildSubdivisionDirect(flat, points, *next, false);
+
+		// the same sums as Mesh::CalcSubdivisionPoints, on stencils instead of positions
+		TArray<Stencil> face_stencils;
+		TArray<Stencil> edge_stencils;
+
+		face_stencils.SetNum(flat.NumFaces());
+		edge_stencils.SetNum(flat.NumEdges());
+
+		for (Idx<MeshFace> face_idx{ 0 }; face_idx.AsInt() < flat.NumFaces(); face_idx++)
+		{
+			auto verts = flat.FaceVertsOf(face_idx);
+
+			for (auto vert_idx : verts)
+			{
+				AddScaled(face_stencils[face_idx.AsInt()], stencils[vert_idx.AsInt()], 1.0f / verts.Num());
+			}
+		}
+
+		for (int j = 0; j < flat.NumEdges(); j++)
+		{
+			auto& es = edge_stencils[j];
+			const auto& start = stencils[flat.EdgeStartVerts[j].AsInt()];
+			const auto& end = stencils[flat.EdgeEndVerts[j].AsInt()];
+
+			if (flat.EdgeEffectiveTypes[j] == PGCEdgeType::Rounded)
+			{
+				AddScaled(es, start, 0.25f);
+				AddScaled(es, end, 0.25f);
+				AddScaled(es, face_stencils[flat.EdgeForwardFaces[j].AsInt()], 0.25f);
+				AddScaled(es, face_stencils[flat.EdgeBackwardsFaces[j].AsInt()], 0.25f);
+			}
+			else
+			{
+				AddScaled(es, start, 0.5f);
+				AddScaled(es, end, 0.5f);
+			}
+		}
+
+		TArray<Stencil> next_stencils;
+
+		next_stencils.SetNum(next->Vertices.Num().AsInt());
+
+		// the new points are unique, so each one is exactly one new vert
+		auto next_stencil = [&next, &next_stencils](const FVector& pos) -> Stencil& {
+			auto new_vert_idx = next->FindVert(pos);
+			check(new_vert_idx.Valid());
+
+			return next_stencils[new_vert_idx.AsInt()];
+		};
+
+		for (Idx<MeshVert> vert_idx{ 0 }; vert_idx.AsInt() < flat.NumVerts(); vert_idx++)
+		{
+			auto& vs = next_stencil(points.VertPoints[vert_idx.AsInt()]);
+			const auto& old = stencils[vert_idx.AsInt()];
+
+			int num_sharp = 0;
+			Idx<MeshVert> sharp_other_verts[2];
+
+			for (auto edge_idx : flat.VertEdgesOf(vert_idx))
+			{
+				if (flat.EdgeEffectiveTypes[edge_idx.AsInt()] == PGCEdgeType::Sharp)
+				{
+					if (num_sharp < 2)
+					{
+						auto start_vert_idx = flat.EdgeStartVerts[edge_idx.AsInt()];
+
+						sharp_other_verts[num_sharp] = start_vert_idx == vert_idx ? flat.EdgeEndVerts[edge_idx.AsInt()] : start_vert_idx;
+					}
+
+					num_sharp++;
+				}
+			}
+
+			if (num_sharp < 2)
+			{
+				auto faces = flat.VertFacesOf(vert_idx);
+				float n = faces.Num();
+
+				// (pos * (n - 3) + R * 2 + F) / n, with F and R the averages of the face and edge points
+				AddScaled(vs, old, (n - 3) / n);
+
+				for (auto face_idx : faces)
+				{
+					AddScaled(vs, face_stencils[face_idx.AsInt()], 1 / (n * n));
+				}
+
+				for (auto edge_idx : flat.VertEdgesOf(vert_idx))
+				{
+					AddScaled(vs, edge_stencils[edge_idx.AsInt()], 2 / (n * n));
+				}
+			}
+			else if (num_sharp == 2)
+			{
+				AddScaled(vs, old, 0.75f);
+				AddScaled(vs, stencils[sharp_other_verts[0].AsInt()], 0.125f);
+				AddScaled(vs, stencils[sharp_other_verts[1].AsInt()], 0.125f);
+			}
+			else
+			{
+				vs = old;
+			}
+		}
+
+		for (int j = 0; j < flat.NumEdges(); j++)
+		{
+			next_stencil(points.EdgePoints[j]) = MoveTemp(edge_stencils[j]);
+		}
+
+		for (int j = 0; j < flat.NumFaces(); j++)
+		{
+			next_stencil(points.FacePoints[j]) = MoveTemp(face_stencils[j]);
+		}
+
+		next->CheckConsistent(true);
+
+		stencils = MoveTemp(next_stencils);
+		level = next;
+	}
+
+	ret->Result = level;
+
+	// the result's own Auto edges matter too, to the bakes' debug edges and the limit surface
+	{
+		FlatMesh flat(*level);
+
+		ret->ResolveAutoEdges(*level, flat, stencils);
+
+		if (limit)
+		{
+			ret->BuildLimit(flat, stencils);
+		}
+	}
+
+	for (auto& s : stencils)
+	{
+		ret->Refined.Push(s);
+	}
+
+	return ret;
+}
+
+void SubdivisionStencils::ResolveAutoEdges(const Mesh& level, FlatMesh& flat, const TArray<Stencil>& stencils)
+{
+	// the ones ResolveEffectiveEdgeTypes will work out from the positions, edges already resolved (as the base's
+	// are once prepared) are hashed by Matches instead, and open edges are Sharp whatever the positions
+	TArray<int> auto_edges;
+
+	for (int i = 0; i < flat.NumEdges(); i++)
+	{
+		if (flat.EdgeSetTypes[i] == PGCEdgeType::Auto && flat.EdgeEffectiveTypes[i] == PGCEdgeType::Unset
+			&& flat.EdgeForwardFaces[i].Valid() && flat.EdgeBackwardsFaces[i].Valid())
+		{
+			auto_edges.Push(i);
+		}
+	}
+
+	level.ResolveEffectiveEdgeTypes(flat);
+
+	if (AutoFaceStarts.Num() == 0)
+	{
+		AutoFaceStarts.Push(0);
+	}
+
+	for (auto i : auto_edges)
+	{
+		for (auto face_idx : { flat.EdgeForwardFaces[i], flat.EdgeBackwardsFaces[i] })
+		{
+			for (auto vert_idx : flat.FaceVertsOf(face_idx))
+			{
+				// Push sorts the row it is given
+				auto corner = stencils[vert_idx.AsInt()];
+
+				AutoCorners.Push(corner);
+			}
+
+			AutoFaceStarts.Push(AutoCorners.NumRows());
+		}
+
+		AutoSharp.Push(flat.EdgeEffectiveTypes[i] == PGCEdgeType::Sharp);
+	}
+}
+
+bool SubdivisionStencils::AutoEdgesAsBuilt(const TArray<FVector>& base_positions) const
+{
+	TFaceArray<FVector> corners;
+
+	for (int i = 0; i < AutoSharp.Num(); i++)
+	{
+		FVector normals[2];
+
+		for (int side = 0; side < 2; side++)
+		{
+			corners.Reset();
+
+			for (int row = AutoFaceStarts[i * 2 + side]; row < AutoFaceStarts[i * 2 + side + 1]; row++)
+			{
+				corners.Push(AutoCorners.Evaluate(base_positions, row));
+			}
+
+			normals[side] = Util::NewellPolyNormal(TArrayView<const FVector>(corners));
+		}
+
+		// as Mesh::ResolveEffectiveEdgeTypes
+		auto sharp = FVector::DotProduct(normals[0], normals[1]) < Result->CosAutoSharpAngle;
+
+		if (sharp != AutoSharp[i])
+			return false;
+	}
+
+	return true;
+}
+
+TSharedRef<FlatMesh> SubdivisionStencils::MakeBakeableFlat() const
+{
+	auto ret = MakeShared<FlatMesh>(*Result);
+
+	Result->ResolveEffectiveEdgeTypes(*ret);
+
+	return ret;
+}
+
+void SubdivisionStencils::BuildLimit(const FlatMesh& flat, const TArray<Stencil>& stencils)
+{
+	// one per face corner, only crease verts' corners get anything
+	TArray<Stencil> crease_across;
+	crease_across.SetNum(flat.FaceVerts.Num());
+
+	for (Idx<MeshVert> vert_idx{ 0 }; vert_idx.AsInt() < flat.NumVerts(); vert_idx++)
+	{
+		const auto& p = stencils[vert_idx.AsInt()];
+
+		Stencil limit;
+		Stencil tangent_u;
+		Stencil tangent_v;
+
+		int num_sharp = 0;
+		Idx<MeshVert> sharp_other_verts[2];
+
+		for (auto edge_idx : flat.VertEdgesOf(vert_idx))
+		{
+			if (flat.EdgeEffectiveTypes[edge_idx.AsInt()] == PGCEdgeType::Sharp)
+			{
+				if (num_sharp < 2)
+				{
+					auto start_vert_idx = flat.EdgeStartVerts[edge_idx.AsInt()];
+
+					sharp_other_verts[num_sharp] = start_vert_idx == vert_idx ? flat.EdgeEndVerts[edge_idx.AsInt()] : start_vert_idx;
+				}
+
+				num_sharp++;
+			}
+		}
+
+		// corners don't move, and don't need the ring
+		if (num_sharp > 2)
+		{
+			limit = p;
+
+			Limit.Push(limit);
+			TangentU.Push(tangent_u);
+			TangentV.Push(tangent_v);
+
+			continue;
+		}
+
+		// walk the faces round the vert, each face's next vert after us is the previous vert of the face after it
+		// ring_faces[i] is the i'th face, ring_verts[i] the neighbour along the edge between faces i and i + 1,
+		// ring_diagonals[i] the vert across face i + 1 from us, and ring_edge_sharp[i] whether the edge to ring_verts[i] is
+		auto n = flat.VertFacesOf(vert_idx).Num();
+
+		TArray<Idx<MeshFace>> ring_faces;
+		TArray<Idx<MeshVert>> ring_verts;
+		TArray<Idx<MeshVert>> ring_diagonals;
+		TArray<bool> ring_edge_sharp;
+
+		auto face_idx = flat.VertFacesOf(vert_idx)[0];
+
+		for (int i = 0; i < n; i++)
+		{
+			ring_faces.Push(face_idx);
+
+			auto verts = flat.FaceVertsOf(face_idx);
+			check(verts.Num() == 4);
+
+			auto corner = flat.Corner(face_idx, vert_idx);
+
+			ring_verts.Push(verts[(corner + 1) % 4]);
+
+			auto edge_idx = flat.FaceEdgesOf(face_idx)[corner];
+
+			ring_edge_sharp.Push(flat.EdgeEffectiveTypes[edge_idx.AsInt()] == PGCEdgeType::Sharp);
+
+			face_idx = flat.EdgeForwardFaces[edge_idx.AsInt()] == face_idx
+				? flat.EdgeBackwardsFaces[edge_idx.AsInt()]
+				: flat.EdgeForwardFaces[edge_idx.AsInt()];
+
+			auto next_verts = flat.FaceVertsOf(face_idx);
+			auto next_corner = flat.Corner(face_idx, vert_idx);
+
+			ring_diagonals.Push(next_verts[(next_corner + 2) % 4]);
+		}
+
+		// the ring must close, or the vert wasn't a simple fan
+		check(face_idx == flat.VertFacesOf(vert_idx)[0]);
+
+		if (num_sharp == 2)
+		{
+			// a crease is a cubic B-spline along its sharp edges
+			AddScaled(limit, p, 4.0f / 6);
+			AddScaled(limit, stencils[sharp_other_verts[0].AsInt()], 1.0f / 6);
+			AddScaled(limit, stencils[sharp_other_verts[1].AsInt()], 1.0f / 6);
+
+			// and its tangent runs between the verts either side, TangentV stays empty
+			AddScaled(tangent_u, stencils[sharp_other_verts[0].AsInt()], 1);
+			AddScaled(tangent_u, stencils[sharp_other_verts[1].AsInt()], -1);
+
+			// the sharp edges split the ring into two sides, each with its own surface, so its own way across the crease,
+			// which we take as the sum over the side's faces of their other corners less us
+			// (whatever of that runs along the crease drops out of the cross product with it)
+			int first_sharp = ring_edge_sharp.Find(true);
+
+			// from the face after one sharp edge up to the next sharp edge is one side
+			for (int i = 0; i < n; )
+			{
+				Stencil across;
+				TArray<int> side_faces;
+
+				do
+				{
+					auto j = (first_sharp + 1 + i) % n;
+
+					side_faces.Push(j);
+
+					AddScaled(across, stencils[ring_verts[(j + n - 1) % n].AsInt()], 1);
+					AddScaled(across, stencils[ring_verts[j].AsInt()], 1);
+					AddScaled(across, stencils[ring_diagonals[(j + n - 1) % n].AsInt()], 1);
+					AddScaled(across, p, -3);
+
+					i++;
+				}
+				while (!ring_edge_sharp[(first_sharp + i) % n]);
+
+				for (auto j : side_faces)
+				{
+					auto ring_face_idx = ring_faces[j];
+
+					crease_across[flat.FaceVertStarts[ring_face_idx.AsInt()] + flat.Corner(ring_face_idx, vert_idx)] = across;
+				}
+			}
+		}
+		else
+		{
+			// (n^2 p + 4 sum(edge neighbours) + sum(diagonals)) / (n (n + 5))
+			float nf = n;
+			float denom = nf * (nf + 5);
+
+			AddScaled(limit, p, nf * nf / denom);
+
+			for (int i = 0; i < n; i++)
+			{
+				AddScaled(limit, stencils[ring_verts[i].AsInt()], 4 / denom);
+				AddScaled(limit, stencils[ring_diagonals[i].AsInt()], 1 / denom);
+			}
+
+			// the standard Catmull-Clark limit tangent masks
+			auto angle = 2 * PI / nf;
+			auto a = 1 + FMath::Cos(angle) + FMath::Cos(angle / 2) * FMath::Sqrt(2 * (9 + FMath::Cos(angle)));
+
+			for (int i = 0; i < n; i++)
+			{
+				auto c0 = FMath::Cos(angle * i);
+				auto c1 = FMath::Cos(angle * (i + 1));
+				auto s0 = FMath::Sin(angle * i);
+				auto s1 = FMath::Sin(angle * (i + 1));
+
+				AddScaled(tangent_u, stencils[ring_verts[i].AsInt()], a * c0);
+				AddScaled(tangent_u, stencils[ring_diagonals[i].AsInt()], c0 + c1);
+				AddScaled(tangent_v, stencils[ring_verts[i].AsInt()], a * s0);
+				AddScaled(tangent_v, stencils[ring_diagonals[i].AsInt()], s0 + s1);
+			}
+		}
+
+		Limit.Push(limit);
+		TangentU.Push(tangent_u);
+		TangentV.Push(tangent_v);
+	}
+
+	for (auto& across : crease_across)
+	{
+		CreaseAcross.Push(across);
+	}
+}
+
+bool SubdivisionStencils::Matches(const Mesh& base) const
+{
+	check(base.NumDead == 0);
+
+	return HashTopology(base) == TopologyHash;
+}
+
+void SubdivisionStencils::BaseToPositions(const Mesh& base, TArray<FVector>& base_positions) const
+{
+	check(base.NumDead == 0);
+
+	check(base.Vertices.Num().AsInt() == NumBase);
+
+	base_positions.Reset(NumBase);
+
+	for (const auto& v : base.Vertices)
+	{
+		base_positions.Push(v.Pos);
+	}
+}
+
+bool SubdivisionStencils::Evaluate(const TArray<FVector>& base_positions, TArray<FVector>& out, bool parallel) const
+{
+	check(base_positions.Num() == NumBase);
+
+	if (!AutoEdgesAsBuilt(base_positions))
+		return false;
+
+	out.SetNum(NumVerts(), false);
+
+	ParallelFor(NumVerts(), [&](int32 i)
+	{
+		out[i] = Refined.Evaluate(base_positions, i);
+	}, !parallel);
+
+	return true;
+}
+
+TSharedPtr<Mesh> SubdivisionStencils::Evaluate(const Mesh& base, bool parallel) const
+{
+	TArray<FVector> base_positions;
+
+	BaseToPositions(base, base_positions);
+
+	TArray<FVector> positions;
+
+	if (!Evaluate(base_positions, positions, parallel))
+		return TSharedPtr<Mesh>();
+
+	auto ret = MakeShared<Mesh>(*Result);
+
+	for (Idx<MeshVert> vert_idx{ 0 }; vert_idx < ret->Vertices.Num(); vert_idx++)
+	{
+		ret->Vertices[vert_idx].Pos = positions[vert_idx.AsInt()];
+	}
+
+	// positions moved, so their hashes did
+	ret->RebuildLookups();
+
+	return ret;
+}
+
+TSharedPtr<Mesh> SubdivisionStencils::EvaluateLimit(const Mesh& base, TArray<FVector>& corner_normals, bool parallel) const
+{
+	check(HasLimit());
+
+	TArray<FVector> base_positions;
+
+	BaseToPositions(base, base_positions);
+
+	if (!AutoEdgesAsBuilt(base_positions))
+		return TSharedPtr<Mesh>();
+
+	TArray<FVector> positions;
+	TArray<FVector> vert_normals;
+
+	positions.SetNum(NumVerts());
+	vert_normals.SetNum(NumVerts());
+
+	ParallelFor(NumVerts(), [&](int32 i)
+	{
+		positions[i] = Limit.Evaluate(base_positions, i);
+
+		// crease and corner verts have no normal of their own, and get per-corner normals below
+		if (TangentV.IsEmpty(i))
+		{
+			vert_normals[i] = FVector{ 0, 0, 0 };
+		}
+		else
+		{
+			// the ring runs clockwise seen from outside, so V x U is outwards
+			auto u = TangentU.Evaluate(base_positions, i);
+			auto v = TangentV.Evaluate(base_positions, i);
+
+			vert_normals[i] = FVector::CrossProduct(v, u).GetSafeNormal();
+		}
+	}, !parallel);
+
+	auto ret = MakeShared<Mesh>(*Result);
+
+	for (Idx<MeshVert> vert_idx{ 0 }; vert_idx < ret->Vertices.Num(); vert_idx++)
+	{
+		ret->Vertices[vert_idx].Pos = positions[vert_idx.AsInt()];
+	}
+
+	ret->RebuildLookups();
+
+	corner_normals.Reset();
+
+	for (const auto& f : ret->Faces)
+	{
+		auto n = f.VertIdxs.Num();
+
+		for (int i = 0; i < n; i++)
+		{
+			auto vert_idx = f.VertIdxs[i];
+			auto corner = corner_normals.Num();
+
+			if (TangentV.IsEmpty(vert_idx.AsInt()))
+			{
+				const auto& pos = positions[vert_idx.AsInt()];
+				const auto& next = positions[f.VertIdxs[(i + 1) % n].AsInt()];
+				const auto& prev = positions[f.VertIdxs[(i + n - 1) % n].AsInt()];
+
+				// same handedness as Util::NewellPolyNormal
+				auto facet_normal = FVector::CrossProduct(next - pos, prev - pos).GetSafeNormal();
+
+				if (CreaseAcross.IsEmpty(corner))
+				{
+					// a corner, which has nothing better than the face it is on
+					corner_normals.Push(facet_normal);
+				}
+				else
+				{
+					// on a crease, this side's surface holds the crease's tangent and the side's way across it,
+					// every corner on the side evaluates the same rows, so gets exactly the same normal
+					auto along = TangentU.Evaluate(base_positions, vert_idx.AsInt());
+					auto across = CreaseAcross.Evaluate(base_positions, corner);
+					auto normal = FVector::CrossProduct(along, across).GetSafeNormal();
+
+					corner_normals.Push(FVector::DotProduct(normal, facet_normal) < 0 ? -normal : normal);
+				}
+			}
+			else
+			{
+				corner_normals.Push(vert_normals[vert_idx.AsInt()]);
+			}
+		}
+	}
+
+	return ret;
+}
+
+PRAGMA_ENABLE_OPTIMIZATION
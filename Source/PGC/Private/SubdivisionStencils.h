@@ -0,0 +1,112 @@
+#pragma once
+
+#include "Mesh.h"
+
+PRAGMA_DISABLE_OPTIMIZATION
+
+// every vert of a subdivided mesh is a fixed weighted sum of the verts of the mesh it came from,
+// as long as the topology and the resolved edge types don't change
+//
+// so when only positions move (e.g. nodes nudged without changing the graph) we can record those sums once,
+// as a sparse matrix from base verts to level-N verts, and re-evaluate that instead of subdividing again
+//
+// Auto edges are resolved against the positions, so a move big enough to flip one between Sharp and Rounded
+// changes the recipe: for the base mesh's own (already resolved) edges Matches sees that, for the ones we resolved
+// while building, on the levels we made, Evaluate does, and either means a rebuild (as does any change of topology)
+class SubdivisionStencils {
+public:
+	// subdivides "base" "count" times, keeping the result and recording how each of its verts is made
+	// "base" is only read (so can be a mesh from the cache), it must have no removals pending
+	// "limit" also records where infinite subdivision would take each vert, and its tangents there
+	// (needs count >= 1, so that everything is quads)
+	// invalid if any level had points land on top of each other, as those get merged by position
+	// and don't have a single recipe
+	static TSharedPtr<SubdivisionStencils> Build(const Mesh& base, int count, bool limit = false);
+
+	int NumBaseVerts() const { return NumBase; }
+	int NumVerts() const { return Refined.NumRows(); }
+	bool HasLimit() const { return Limit.NumRows() > 0; }
+
+	// whether "base" has the same topology, set edge types and effective edge types as the mesh we were built from,
+	// e.g. it was built the same way from moved nodes
+	bool Matches(const Mesh& base) const;
+
+	// the subdivided mesh, as built
+	TSharedRef<const Mesh> GetMesh() const { return Result.ToSharedRef(); }
+
+	// the same as a FlatMesh, with its effective edge types resolved, ready for the static Mesh bakes,
+	// Evaluate can then write new positions straight into its Positions
+	TSharedRef<FlatMesh> MakeBakeableFlat() const;
+
+	// the positions of the base verts, as the Evaluates want them
+	void BaseToPositions(const Mesh& base, TArray<FVector>& base_positions) const;
+
+	// positions of the subdivided verts for new positions of the base verts, "out" is only resized, so can be reused
+	// false (and "out" left alone) if the positions resolve an Auto edge on one of our levels the other way,
+	// so that subdividing them would give a different mesh
+	bool Evaluate(const TArray<FVector>& base_positions, TArray<FVector>& out, bool parallel) const;
+
+	// a copy of the subdivided mesh with its verts moved to follow "base", or null as for Evaluate
+	TSharedPtr<Mesh> Evaluate(const Mesh& base, bool parallel) const;
+
+	// as Evaluate, but with the verts on the limit surface, plus a limit normal for each face corner
+	// (in the same order as FlatMesh::FaceVerts of the returned mesh)
+	// normals are exact where the surface is smooth, at verts on creases and corners the surface has no single normal,
+	// so each corner gets the one for its own side: on a crease perpendicular to the crease's limit tangent,
+	// at a corner just that of its own face
+	TSharedPtr<Mesh> EvaluateLimit(const Mesh& base, TArray<FVector>& corner_normals, bool parallel) const;
+
+private:
+	// compressed sparse rows, row i is the sum over [Starts[i], Starts[i + 1]) of Weights[j] * (base vert BaseVerts[j])
+	struct SparseRows {
+		TArray<int> Starts;
+		TArray<int> BaseVerts;
+		TArray<float> Weights;
+
+		int NumRows() const { return FMath::Max(Starts.Num() - 1, 0); }
+		bool IsEmpty(int row) const { return Starts[row] == Starts[row + 1]; }
+
+		void Push(TMap<int, float>& row);
+
+		FVector Evaluate(const TArray<FVector>& base_positions, int row) const
+		{
+			FVector pos{ 0, 0, 0 };
+
+			for (int j = Starts[row]; j < Starts[row + 1]; j++)
+			{
+				pos += base_positions[BaseVerts[j]] * Weights[j];
+			}
+
+			return pos;
+		}
+	};
+
+	int NumBase = 0;
+	uint32 TopologyHash = 0;
+
+	SparseRows Refined;
+
+	// only with "limit", on a crease TangentU runs along the crease and TangentV is empty, at a corner both are empty
+	SparseRows Limit;
+	SparseRows TangentU;
+	SparseRows TangentV;
+	// only with "limit", a row per face corner of the result, for corners at crease verts the way across the crease
+	// on that corner's side (the same row for every corner on a side), empty for all others
+	SparseRows CreaseAcross;
+
+	// for each Auto edge we resolved ourselves, on any level including the result: the corners of its two faces
+	// (AutoFaceStarts[2 * i] to AutoFaceStarts[2 * i + 2], the first face's then the second's) and whether it went Sharp
+	SparseRows AutoCorners;
+	TArray<int> AutoFaceStarts;
+	TArray<bool> AutoSharp;
+
+	TSharedPtr<const Mesh> Result;
+
+	static uint32 HashTopology(const Mesh& base);
+	// resolves "flat"'s effective edge types, as level->ResolveEffectiveEdgeTypes does, noting the Auto ones
+	void ResolveAutoEdges(const Mesh& level, FlatMesh& flat, const TArray<TMap<int, float>>& stencils);
+	bool AutoEdgesAsBuilt(const TArray<FVector>& base_positions) const;
+	void BuildLimit(const FlatMesh& flat, const TArray<TMap<int, float>>& stencils);
+};
+
+PRAGMA_ENABLE_OPTIMIZATION
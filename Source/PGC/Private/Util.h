@@ -178,7 +178,7 @@ inline FQuat AxisAngleToQuaternion(FVector Axis, float Angle)
 	return q;
 }
 
-inline FVector NewellPolyNormal(const TArray<FVector>& verts)
+inline FVector NewellPolyNormal(TArrayView<const FVector> verts)
 {
 	auto prev_vert = verts.Last();
 	FVector sum{ 0, 0, 0 };
@@ -193,11 +193,16 @@ inline FVector NewellPolyNormal(const TArray<FVector>& verts)
 	return sum.GetSafeNormal();
 }
 
+inline FVector NewellPolyNormal(const TArray<FVector>& verts)
+{
+	return NewellPolyNormal(TArrayView<const FVector>(verts));
+}
+
 // modified from : http://geomalgorithms.com/a07-_distance.html
 // dist3D_Segment_to_Segment(): get the 3D minimum distance between 2 segments
 //    Input:  two 3D line segments S1 and S2
 //    Return: the shortest distance between S1 and S2
-double
+inline double
 dist3D_Segment_to_Segment(GVector P0, GVector P1, GVector Q0, GVector Q1)
 {
 	GVector   u = P1 - P0;
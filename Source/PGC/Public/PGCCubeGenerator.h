@@ -7,6 +7,7 @@
 
 #include "Runtime/Core/Public/Containers/Array.h"
 #include "Runtime/Core/Public/Templates/SharedPointer.h"
+#include "Runtime/Core/Public/HAL/CriticalSection.h"
 
 #include "PGCCube.h"
 #include "PGCGenerator.h"
@@ -14,6 +15,7 @@
 #include "PGCCubeGenerator.generated.h"
 
 class Mesh;
+class CubeChunks;
 
 UCLASS(BlueprintType)
 class PGC_API APGCCubeGenerator : public AActor, public IPGCGenerator
@@ -35,8 +37,21 @@ public:
 	UPROPERTY(EditAnywhere)
 	TArray<FPGCCube> Cubes;
 
+	// subdivision is done and kept in chunks of this many cells along each side,
+	// after an edit only the chunks within a cell of it are subdivided again (zero subdivides everything every time)
+	UPROPERTY(EditAnywhere)
+	int ChunkSize = 8;
+
 	virtual void MakeMesh(TSharedPtr<Mesh> mesh, const TSharedPtr<TArray<FPGCNodePosition>> Nodes,
 		PGCDebugMode dm) const override;
+	virtual bool MakeSubdividedMesh(TSharedPtr<Mesh> mesh, int NumDivisions, bool parallel,
+		PGCDebugMode dm) const override;
 	virtual uint32 SettingsHash() const override;
 	virtual FString GetName() const override { return "APGCCubeGenerator"; }
+
+private:
+	// conceptually const, just a cache, but every UPGCMesh using us can be generating on its own thread,
+	// so anything touching it holds ChunksLock
+	mutable TSharedPtr<CubeChunks> Chunks;
+	mutable FCriticalSection ChunksLock;
 };
@@ -42,6 +42,12 @@ public:
 	virtual void MakeMesh(TSharedPtr<Mesh> mesh, const TSharedPtr<TArray<FPGCNodePosition>> Nodes,
 		PGCDebugMode dm) const = 0;
 
+	// generators that can make the subdivided mesh more cheaply than subdividing all of MakeMesh's output
+	// (e.g. by reusing the parts an edit didn't touch) fill the empty "mesh" here and return true,
+	// otherwise the caller subdivides
+	virtual bool MakeSubdividedMesh(TSharedPtr<Mesh> /*mesh*/, int /*NumDivisions*/, bool /*parallel*/,
+		PGCDebugMode /*dm*/) const { return false; }
+
 	virtual uint32 SettingsHash() const = 0;
 	virtual FString GetName() const = 0;
 };
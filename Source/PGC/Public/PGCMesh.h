@@ -5,11 +5,17 @@
 #include "CoreMinimal.h"
 
 #include "Components/ActorComponent.h"
+#include "FlatMesh.h"
 #include "Mesh.h"
 #include "PGCGenerator.h"
+#include "SubdivisionStencils.h"
 
 #include "PGCMesh.generated.h"
 
+namespace Cache {
+class BakeableMesh;
+}
+
 UCLASS(BlueprintType)
 class PGC_API UPGCMesh : public UActorComponent
 {
@@ -20,9 +26,27 @@ class PGC_API UPGCMesh : public UActorComponent
 	TSharedPtr<Mesh> CurrentMesh;
 	TSharedPtr<TArray<FPGCNodePosition>> CurrentNodes;
 
+	// kept between GenerateLimitSurface calls, while the base mesh keeps the same topology
+	TSharedPtr<SubdivisionStencils> LimitStencils;
+	int LimitStencilsDivisions = -1;
+
+	// the same for the bakes, built the second time in a row a level is made (e.g. nodes being dragged, which changes
+	// the generator's hash but usually not the topology), after which the level is baked from the new base positions
+	// without subdividing and without going into the cache; "divisions" is the level last subdivided, even when there
+	// are no stencils for it
+	TSharedPtr<SubdivisionStencils> SubdivStencils;
+	int SubdivStencilsDivisions = -1;
+	// the result's topology, with the positions of the last evaluation, and the base positions that went into it
+	TSharedPtr<FlatMesh> SubdivStencilsFlat;
+	TArray<FVector> SubdivStencilsBase;
+
 	void Generate(int NumDivisions, bool Triangularise, PGCDebugMode dm);
 	void RealGenerate(const FString& generator_name, uint32 generator_hash,
 		int NumDivisions, bool Triangularise, PGCDebugMode dm);
+	// what the bakes need, from the cache file if it has it already, otherwise made from the Mesh once and stored
+	TSharedPtr<const Cache::BakeableMesh> GenerateBakeable(int NumDivisions, bool Triangularise, PGCDebugMode dm);
+	// null when there are no stencils for the level and it isn't time to build them
+	TSharedPtr<const Cache::BakeableMesh> BakeableFromStencils(int NumDivisions, bool Triangularise, PGCDebugMode dm);
 
 public:	
 	// Sets default values for this component's properties
@@ -36,6 +60,16 @@ public:
 	// Called every frame
 	virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
 
+	// spread subdivision over the task threads, the resulting mesh is the same either way
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "PGC")
+	bool ParallelSubdivision = true;
+
+	// keep every level of subdivision in the cache on the way up to the one asked for, otherwise only
+	// the undivided mesh and the levels asked for are kept, and the ones between are made in passing
+	// (which costs more when stepping up a level at a time, but holds a lot less memory at high levels)
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "PGC")
+	bool CacheIntermediateLevels = true;
+
 	UFUNCTION(BlueprintCallable, meta = (DisplayName = "Set GeneratorName", Keywords = "PGC, procedural"), Category = "PGC")
 		void SetGenerator(const TScriptInterface<IPGCGenerator>& gen);
 	
@@ -48,4 +82,10 @@ public:
 			PGCDebugMode dm,
 			int StartChannel, int EndChannel);
 
+	// as Generate, but with the verts pushed onto the limit surface and with limit normals,
+	// evaluated straight from the undivided mesh, without making the levels in between
+	UFUNCTION(BlueprintCallable, meta = (DisplayName = "Generate Limit Surface", Keywords = "PGC, procedural"), Category = "PGC")
+		FPGCMeshResult GenerateLimitSurface(int NumDivisions, bool InsideOut, PGCDebugEdgeType DebugEdges,
+			PGCDebugMode dm);
+
 };